@@ -0,0 +1,214 @@
+#ifndef ALLOCTRACK_H
+#define ALLOCTRACK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Counts heap allocations by phase, to prove the frame loop allocates nothing once it is warm.
+//
+// Only builds with ALLOC_TRACKING defined count anything; otherwise ALLOC_PHASE expands to
+// nothing. The implementation replaces malloc, calloc, realloc and the aligned variants for the
+// whole program, raylib and the GL driver included, and forwards to glibc's own. Every thread has
+// its own phase; threads that never set one count under ALLOC_PHASE_THREADS. A thread that forbids
+// allocating gets a backtrace on stderr for each of its first ALLOC_REPORTED_VIOLATIONS
+// allocations, and every one counts as a violation. Link with -rdynamic to get names in them.
+
+#define ALLOC_REPORTED_VIOLATIONS 8
+
+typedef enum AllocPhase
+{
+    ALLOC_PHASE_THREADS = 0, // threads other than main
+    ALLOC_PHASE_STARTUP,
+    ALLOC_PHASE_FRAME_START, // window resizes, trace dumps
+    ALLOC_PHASE_MENUS,       // menu, replay viewer and versus frames
+    ALLOC_PHASE_SIM,
+    ALLOC_PHASE_LAYOUT,
+    ALLOC_PHASE_DRAW,
+    ALLOC_PHASE_PRESENT,
+    ALLOC_PHASE_SHUTDOWN,
+    ALLOC_PHASE_COUNT,
+} AllocPhase;
+
+typedef struct AllocStats
+{
+    uint64_t allocations;
+    uint64_t bytes;
+} AllocStats;
+
+#ifdef ALLOC_TRACKING
+
+void allocSetPhase(AllocPhase phase);
+// Returns whether the calling thread was forbidden to allocate before.
+bool allocForbid(bool forbidden);
+AllocStats allocPhaseStats(AllocPhase phase);
+uint64_t allocViolations(void);
+// A line per phase, then the violations.
+void allocReport(FILE *file);
+
+#define ALLOC_PHASE(phase) allocSetPhase(phase)
+
+#else
+
+#define ALLOC_PHASE(phase)
+
+#endif // ALLOC_TRACKING
+
+#endif // ALLOCTRACK_H
+
+#if defined(ALLOC_TRACKING) && defined(ALLOCTRACK_IMPLEMENTATION) && !defined(ALLOCTRACK_IMPLEMENTED)
+#define ALLOCTRACK_IMPLEMENTED
+
+#include <errno.h>
+#include <execinfo.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <unistd.h>
+
+// glibc's allocator under its own names.
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *pointer, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *pointer);
+
+static const char *allocPhaseNames[ALLOC_PHASE_COUNT] = {
+    "threads", "startup", "frame start", "menus", "sim", "layout", "draw", "present", "shutdown",
+};
+
+static _Atomic uint64_t allocCounts[ALLOC_PHASE_COUNT];
+static _Atomic uint64_t allocBytes[ALLOC_PHASE_COUNT];
+static _Atomic uint64_t allocViolationCount;
+static _Thread_local AllocPhase allocPhase;
+static _Thread_local bool allocForbidden;
+// Set while a violation is reported, so the allocations backtrace makes are left alone.
+static _Thread_local bool allocReporting;
+
+static void allocCount(size_t size)
+{
+    if (allocReporting)
+    {
+        return;
+    }
+
+    atomic_fetch_add_explicit(&allocCounts[allocPhase], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&allocBytes[allocPhase], size, memory_order_relaxed);
+
+    if (!allocForbidden)
+    {
+        return;
+    }
+
+    uint64_t violation = atomic_fetch_add_explicit(&allocViolationCount, 1, memory_order_relaxed);
+
+    if (violation < ALLOC_REPORTED_VIOLATIONS)
+    {
+        allocReporting = true;
+
+        // No stdio, it may allocate.
+        char message[128];
+        int length = snprintf(message, sizeof(message), "allocation of %zu bytes in %s:\n", size, allocPhaseNames[allocPhase]);
+        ssize_t written = write(STDERR_FILENO, message, length);
+        (void)written;
+
+        void *frames[32];
+        int count = backtrace(frames, sizeof(frames) / sizeof(frames[0]));
+        backtrace_symbols_fd(frames, count, STDERR_FILENO);
+
+        allocReporting = false;
+    }
+}
+
+void *malloc(size_t size)
+{
+    allocCount(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    allocCount(count * size);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size)
+{
+    allocCount(size);
+    return __libc_realloc(pointer, size);
+}
+
+void free(void *pointer)
+{
+    __libc_free(pointer);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    allocCount(size);
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    allocCount(size);
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **pointer, size_t alignment, size_t size)
+{
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0)
+    {
+        return EINVAL;
+    }
+
+    allocCount(size);
+    void *memory = __libc_memalign(alignment, size);
+
+    if (memory == NULL)
+    {
+        return ENOMEM;
+    }
+
+    *pointer = memory;
+    return 0;
+}
+
+void allocSetPhase(AllocPhase phase)
+{
+    allocPhase = phase;
+}
+
+bool allocForbid(bool forbidden)
+{
+    bool was = allocForbidden;
+    allocForbidden = forbidden;
+    return was;
+}
+
+AllocStats allocPhaseStats(AllocPhase phase)
+{
+    return (AllocStats){
+        .allocations = atomic_load_explicit(&allocCounts[phase], memory_order_relaxed),
+        .bytes = atomic_load_explicit(&allocBytes[phase], memory_order_relaxed),
+    };
+}
+
+uint64_t allocViolations(void)
+{
+    return atomic_load_explicit(&allocViolationCount, memory_order_relaxed);
+}
+
+void allocReport(FILE *file)
+{
+    fprintf(file, "%-12s %12s %14s\n", "phase", "allocations", "bytes");
+
+    for (AllocPhase phase = 0; phase < ALLOC_PHASE_COUNT; phase++)
+    {
+        AllocStats stats = allocPhaseStats(phase);
+        fprintf(file, "%-12s %12llu %14llu\n", allocPhaseNames[phase], (unsigned long long)stats.allocations, (unsigned long long)stats.bytes);
+    }
+
+    fprintf(file, "%llu allocations where none were allowed\n", (unsigned long long)allocViolations());
+}
+
+#endif // ALLOCTRACK_IMPLEMENTATION
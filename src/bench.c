@@ -0,0 +1,1039 @@
+#define TETRIS_IMPLEMENTATION
+#include "tetris.h"
+
+#define EVAL_IMPLEMENTATION
+#include "eval.h"
+
+// The bench always counts allocations, gameStep must not make any.
+#define ALLOC_TRACKING
+#define ALLOCTRACK_IMPLEMENTATION
+#include "alloctrack.h"
+
+#define NET_IMPLEMENTATION
+#include "net.h"
+
+#define NETPLAY_IMPLEMENTATION
+#include "netplay.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_BATCHES 64
+#define BENCH_SECONDS 1.0
+#define BENCH_GAMES 64
+#define BENCH_INPUTS 4096
+
+// Micro-benchmarks: each runs for BENCH_WARMUP_SECONDS first, then BENCH_REPETITIONS times for
+// about BENCH_REPETITION_SECONDS each, over a corpus of BENCH_CORPUS boards.
+#define BENCH_WARMUP_SECONDS 0.1
+#define BENCH_REPETITIONS 31
+#define BENCH_REPETITION_SECONDS 0.005
+#define BENCH_CORPUS 64 // a power of two
+#define BENCH_CORPUS_SEED 0x5EED5EED5EED5EEDull
+#define BENCH_MAX_RESULTS 32
+// A change counts when it is larger than this many MADs of either run, and than BENCH_MIN_CHANGE.
+#define BENCH_NOISE_MADS 3.0
+#define BENCH_MIN_CHANGE 0.05
+
+// A versus match between two Netplay sides over a loopback that loses, delays and reorders packets.
+#define BENCH_NETPLAY_TICKS 3000
+#define BENCH_NETPLAY_SEED 0xBADC0FFEEull
+#define BENCH_NETPLAY_LATENCY 0.05
+#define BENCH_NETPLAY_JITTER 0.04
+#define BENCH_NETPLAY_LOSS 0.1
+
+static EvalBoards boards[BENCH_BATCHES];
+static EvalFeatures features[BENCH_BATCHES];
+static Game games[BENCH_GAMES];
+static GameInput inputs[BENCH_INPUTS];
+
+typedef struct BenchBoard
+{
+    Game game;
+    GridPiece landed;                       // the current piece where a hard drop puts it
+    Block locked[GRID_WIDTH * GRID_HEIGHT]; // the grid with the landed piece in it
+} BenchBoard;
+
+typedef struct BenchResult
+{
+    char name[32];
+    double medianNs; // per call
+    double madNs;    // median absolute deviation from it
+    uint32_t repetitions;
+    uint64_t iterations; // calls per repetition
+} BenchResult;
+
+static BenchBoard corpus[BENCH_CORPUS];
+static Game scratch[BENCH_CORPUS];
+static volatile uint64_t benchSink;
+
+static uint64_t benchRandomState = 0x9E3779B97F4A7C15ull;
+
+static uint32_t benchRandom(void)
+{
+    benchRandomState ^= benchRandomState << 13;
+    benchRandomState ^= benchRandomState >> 7;
+    benchRandomState ^= benchRandomState << 17;
+    return (uint32_t)(benchRandomState >> 32);
+}
+
+static double benchNow(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// Stacks that look like mid-game boards: a bumpy surface, mostly filled below it, a few holes.
+static void makeBoard(uint16_t rows[EVAL_BOARD_HEIGHT])
+{
+    int height = benchRandom() % 8;
+
+    memset(rows, 0, sizeof(uint16_t) * EVAL_BOARD_HEIGHT);
+
+    for (int x = 0; x < EVAL_BOARD_WIDTH; x++)
+    {
+        height += (int)(benchRandom() % 5) - 2;
+        height = height < 0 ? 0 : height > 16 ? 16 : height;
+
+        for (int y = EVAL_BOARD_HEIGHT - height; y < EVAL_BOARD_HEIGHT; y++)
+        {
+            if (benchRandom() % 10 != 0)
+            {
+                rows[y] |= 1 << x;
+            }
+        }
+    }
+}
+
+static bool featuresMatch(const EvalBoardFeatures *a, const EvalBoardFeatures *b)
+{
+    return memcmp(a, b, sizeof(*a)) == 0;
+}
+
+static bool checkAgainstReference(const char *name, void (*evaluate)(const EvalBoards *, EvalFeatures *))
+{
+    for (size_t batch = 0; batch < BENCH_BATCHES; batch++)
+    {
+        evaluate(&boards[batch], &features[batch]);
+
+        for (size_t i = 0; i < boards[batch].count; i++)
+        {
+            uint16_t rows[EVAL_BOARD_HEIGHT];
+            for (size_t y = 0; y < EVAL_BOARD_HEIGHT; y++)
+            {
+                rows[y] = boards[batch].rows[y][i];
+            }
+
+            EvalBoardFeatures expected;
+            evalBoardReference(rows, &expected);
+            EvalBoardFeatures actual = evalFeaturesAt(&features[batch], i);
+
+            if (!featuresMatch(&expected, &actual))
+            {
+                fprintf(stderr, "%s: board %zu of batch %zu differs from the reference\n", name, i, batch);
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static void referenceBatch(const EvalBoards *batch, EvalFeatures *out)
+{
+    for (size_t i = 0; i < batch->count; i++)
+    {
+        uint16_t rows[EVAL_BOARD_HEIGHT];
+        for (size_t y = 0; y < EVAL_BOARD_HEIGHT; y++)
+        {
+            rows[y] = batch->rows[y][i];
+        }
+
+        EvalBoardFeatures single;
+        evalBoardReference(rows, &single);
+
+        for (size_t x = 0; x < EVAL_BOARD_WIDTH; x++)
+        {
+            out->heights[x][i] = single.heights[x];
+        }
+        out->holes[i] = single.holes;
+        out->rowTransitions[i] = single.rowTransitions;
+        out->columnTransitions[i] = single.columnTransitions;
+        out->wells[i] = single.wells;
+        out->bumpiness[i] = single.bumpiness;
+    }
+}
+
+static void benchEvaluate(const char *name, void (*evaluate)(const EvalBoards *, EvalFeatures *))
+{
+    size_t evaluated = 0;
+    double start = benchNow();
+    double elapsed = 0;
+
+    while (elapsed < BENCH_SECONDS)
+    {
+        for (size_t batch = 0; batch < BENCH_BATCHES; batch++)
+        {
+            evaluate(&boards[batch], &features[batch]);
+            evaluated += boards[batch].count;
+        }
+        elapsed = benchNow() - start;
+    }
+
+    printf("%-16s %12.0f boards/s\n", name, evaluated / elapsed);
+}
+
+// Mashing keys: moves held for a while, a rotation or a drop every so often.
+static GameInput makeInput(GameInput held)
+{
+    uint32_t roll = benchRandom();
+
+    if (roll % 20 == 0)
+    {
+        held ^= GAME_INPUT_LEFT << (roll / 20 % 3);
+    }
+
+    GameInput input = held & GAME_INPUT_HELD_MASK;
+
+    if (roll % 30 == 1)
+    {
+        input |= GAME_INPUT_ROTATE;
+    }
+
+    if (roll % 90 == 2)
+    {
+        input |= GAME_INPUT_HARD_DROP;
+    }
+
+    return input;
+}
+
+static void makeGames(void)
+{
+    GameInput held = 0;
+
+    for (size_t i = 0; i < BENCH_INPUTS; i++)
+    {
+        inputs[i] = held = makeInput(held);
+    }
+
+    for (size_t i = 0; i < BENCH_GAMES; i++)
+    {
+        gameInit(&games[i], i + 1);
+
+        for (uint32_t tick = benchRandom() % 3000; tick > 0; tick--)
+        {
+            gameStep(&games[i], inputs[tick % BENCH_INPUTS] | (games[i].dead ? GAME_INPUT_RESTART : 0));
+        }
+    }
+}
+
+// Returns 0 if a step allocated.
+static double benchStep(void)
+{
+    static Game stepped[BENCH_GAMES];
+    size_t steps = 0;
+    double start = benchNow();
+    double elapsed = 0;
+
+    memcpy(stepped, games, sizeof(games));
+    allocSetPhase(ALLOC_PHASE_SIM);
+    allocForbid(true);
+
+    while (elapsed < BENCH_SECONDS)
+    {
+        for (size_t i = 0; i < BENCH_GAMES; i++)
+        {
+            for (size_t tick = 0; tick < 64; tick++)
+            {
+                gameStep(&stepped[i], inputs[(steps + tick) % BENCH_INPUTS] | (stepped[i].dead ? GAME_INPUT_RESTART : 0));
+            }
+        }
+
+        steps += BENCH_GAMES * 64;
+        elapsed = benchNow() - start;
+    }
+
+    allocForbid(false);
+    allocSetPhase(ALLOC_PHASE_STARTUP);
+
+    AllocStats allocations = allocPhaseStats(ALLOC_PHASE_SIM);
+    printf("%-16s %12.0f steps/s, %llu allocations\n", "game step", steps / elapsed, (unsigned long long)allocations.allocations);
+
+    if (allocations.allocations > 0)
+    {
+        fprintf(stderr, "game step: allocated %llu bytes in %zu steps\n", (unsigned long long)allocations.bytes, steps);
+        return 0;
+    }
+
+    return elapsed / steps;
+}
+
+// Plays both sides of a match over NetLoopback with a simulated clock, then checks that each board
+// ended the same on both sides, and the same as gameStep over the inputs that were actually made.
+// A rollback that restores the wrong state or skips a tick shows up as a different checksum.
+static bool checkNetplay(void)
+{
+    static NetLoopback loopback;
+    static Netplay sides[2];
+    static GameInput made[2][BENCH_NETPLAY_TICKS + 1];
+    NetTransport transports[2];
+    GameInput held[2] = {0};
+
+    netLoopbackInit(&loopback, BENCH_NETPLAY_LATENCY, BENCH_NETPLAY_JITTER, BENCH_NETPLAY_LOSS, BENCH_NETPLAY_SEED);
+    netLoopbackTransport(&transports[0], &loopback, 0);
+    netLoopbackTransport(&transports[1], &loopback, 1);
+    netplayHost(&sides[0], &transports[0], BENCH_NETPLAY_SEED, NETPLAY_INPUT_DELAY);
+    netplayJoin(&sides[1], &transports[1], 0);
+
+    double now = 0;
+    bool done = false;
+
+    for (int frame = 0; frame < 4 * BENCH_NETPLAY_TICKS && !done; frame++)
+    {
+        now += 1.0 / GAME_TICKS_PER_SECOND;
+        done = true;
+
+        for (int side = 0; side < 2; side++)
+        {
+            Netplay *netplay = &sides[side];
+            netplayPoll(netplay, now);
+
+            if (netplay->tick < BENCH_NETPLAY_TICKS && netplayReady(netplay))
+            {
+                held[side] = makeInput(held[side]);
+                GameInput input = held[side] | (netplayBoard(netplay, side)->dead ? GAME_INPUT_RESTART : 0);
+                made[side][netplay->tick + 1] = input;
+                netplayAdvance(netplay, input);
+            }
+
+            netplaySend(netplay, now);
+
+            done = done && netplay->status == NETPLAY_RUNNING && netplay->tick == BENCH_NETPLAY_TICKS &&
+                   netplay->received[1 - side] >= BENCH_NETPLAY_TICKS;
+        }
+    }
+
+    if (!done)
+    {
+        fprintf(stderr, "netplay: the match did not finish, status %d and %d at ticks %u and %u\n", sides[0].status, sides[1].status,
+                sides[0].tick, sides[1].tick);
+        return false;
+    }
+
+    // Each side plays its own inputs its delay later, with no input before that.
+    Game expected[2];
+
+    for (int side = 0; side < 2; side++)
+    {
+        gameInit(&expected[side], BENCH_NETPLAY_SEED);
+
+        for (uint32_t tick = 1; tick <= BENCH_NETPLAY_TICKS; tick++)
+        {
+            uint8_t delay = sides[side].delays[side];
+            gameStep(&expected[side], tick > delay ? made[side][tick - delay] : 0);
+        }
+    }
+
+    for (int board = 0; board < 2; board++)
+    {
+        uint64_t checksum = gameChecksum(&expected[board]);
+
+        if (gameChecksum(netplayBoard(&sides[0], board)) != checksum || gameChecksum(netplayBoard(&sides[1], board)) != checksum)
+        {
+            fprintf(stderr, "netplay: board %d differs between the sides or from a straight run of its inputs\n", board);
+            return false;
+        }
+    }
+
+    uint32_t rollbacks = sides[0].stats.rollbacks + sides[1].stats.rollbacks;
+
+    if (rollbacks == 0)
+    {
+        fprintf(stderr, "netplay: nothing was rolled back, the check did not check anything\n");
+        return false;
+    }
+
+    printf("%-16s %12u ticks, %u rollbacks, %u ticks simulated again, boards match\n", "netplay", BENCH_NETPLAY_TICKS, rollbacks,
+           sides[0].stats.resimulatedTicks + sides[1].stats.resimulatedTicks);
+
+    return true;
+}
+
+static void benchChecksum(double stepSeconds)
+{
+    volatile uint64_t sink = 0;
+    size_t checksums = 0;
+    double start = benchNow();
+    double elapsed = 0;
+
+    while (elapsed < BENCH_SECONDS)
+    {
+        for (size_t i = 0; i < BENCH_GAMES; i++)
+        {
+            sink ^= gameChecksum(&games[i]);
+        }
+
+        checksums += BENCH_GAMES;
+        elapsed = benchNow() - start;
+    }
+
+    double seconds = elapsed / checksums;
+
+    printf("%-16s %12.0f checksums/s, %.0f ns, %.1f%% of a step, %.4f%% of a tick\n", "game checksum", checksums / elapsed,
+           seconds * 1e9, seconds / stepSeconds * 100, seconds * GAME_TICKS_PER_SECOND * 100);
+}
+
+// Saves every game into a ring of snapshots and restores them in turn, like rollback does.
+static bool benchSnapshots(void)
+{
+    static uint8_t snapshots[BENCH_GAMES * 4][GAME_SNAPSHOT_SIZE];
+    static Game restored;
+    size_t saves = 0;
+    double start = benchNow();
+    double elapsed = 0;
+
+    while (elapsed < BENCH_SECONDS)
+    {
+        for (size_t i = 0; i < BENCH_GAMES * 4; i++)
+        {
+            gameSave(&games[i % BENCH_GAMES], snapshots[i]);
+        }
+
+        saves += BENCH_GAMES * 4;
+        elapsed = benchNow() - start;
+    }
+
+    printf("%-16s %12.0f snapshots/s, %.2f GB/s\n", "game save", saves / elapsed, saves * GAME_SNAPSHOT_SIZE / elapsed / 1e9);
+
+    size_t restores = 0;
+    start = benchNow();
+    elapsed = 0;
+
+    while (elapsed < BENCH_SECONDS)
+    {
+        for (size_t i = 0; i < BENCH_GAMES * 4; i++)
+        {
+            gameRestore(&restored, snapshots[i]);
+            __asm__ volatile("" : : "r"(&restored) : "memory");
+        }
+
+        restores += BENCH_GAMES * 4;
+        elapsed = benchNow() - start;
+    }
+
+    printf("%-16s %12.0f snapshots/s, %.2f GB/s\n", "game restore", restores / elapsed, restores * GAME_SNAPSHOT_SIZE / elapsed / 1e9);
+
+    if (memcmp(&restored, &games[BENCH_GAMES - 1], GAME_SNAPSHOT_SIZE) != 0)
+    {
+        fprintf(stderr, "game restore: the snapshot does not match the game it was taken from\n");
+        return false;
+    }
+
+    return true;
+}
+
+static void gridRows(const Block grid[GRID_WIDTH * GRID_HEIGHT], uint16_t rows[EVAL_BOARD_HEIGHT])
+{
+    for (int y = 0; y < GRID_HEIGHT; y++)
+    {
+        rows[y] = 0;
+
+        for (int x = 0; x < GRID_WIDTH; x++)
+        {
+            rows[y] |= isBlockInGrid(grid, (Vector2){x, y}) << x;
+        }
+    }
+}
+
+// Rotates, slides towards column and hard drops, the way a player would with the keys.
+static void playPlacement(Game *game, int rotations, int column)
+{
+    for (int i = 0; i < rotations && !game->dead; i++)
+    {
+        gameStep(game, GAME_INPUT_ROTATE);
+    }
+
+    // Taps, a key held down would auto shift past column.
+    for (int tick = 0; tick < 2 * GRID_WIDTH && !game->dead && (int)game->piece.origin.x != column; tick++)
+    {
+        GameInput input = (int)game->piece.origin.x < column ? GAME_INPUT_RIGHT : GAME_INPUT_LEFT;
+        gameStep(game, gameMovementReady(game, input) ? input : 0);
+    }
+
+    if (!game->dead)
+    {
+        gameStep(game, GAME_INPUT_HARD_DROP);
+    }
+}
+
+// Games played by a greedy player with a bit of noise, stopped a few dozen pieces in: stacks
+// with some holes and an uneven surface. The seed is fixed so every run measures the same boards.
+static void makeCorpus(void)
+{
+    benchRandomState = BENCH_CORPUS_SEED;
+
+    for (size_t i = 0; i < BENCH_CORPUS; i++)
+    {
+        BenchBoard *board = &corpus[i];
+        uint32_t pieces = 10 + benchRandom() % 50;
+        uint64_t seed = i + 1;
+
+        gameInit(&board->game, seed);
+
+        while (board->game.piecesLocked < pieces)
+        {
+            int bestRotations = 0;
+            int bestColumn = 0;
+            float bestScore = -1e9f;
+
+            for (int rotations = 0; rotations < 4; rotations++)
+            {
+                for (int column = -2; column < GRID_WIDTH; column++)
+                {
+                    Game tried = board->game;
+                    playPlacement(&tried, rotations, column);
+
+                    uint16_t rows[EVAL_BOARD_HEIGHT];
+                    EvalBoardFeatures features;
+                    gridRows(tried.grid, rows);
+                    evalBoardReference(rows, &features);
+
+                    float height = 0;
+
+                    for (int x = 0; x < EVAL_BOARD_WIDTH; x++)
+                    {
+                        height += features.heights[x];
+                    }
+
+                    float score = (tried.lines - board->game.lines) * 8.0f - height - features.holes * 6.0f - features.bumpiness * 1.5f -
+                                  tried.dead * 1000.0f + benchRandom() % 12;
+
+                    if (score > bestScore)
+                    {
+                        bestScore = score;
+                        bestRotations = rotations;
+                        bestColumn = column;
+                    }
+                }
+            }
+
+            playPlacement(&board->game, bestRotations, bestColumn);
+
+            // Noise and speed catch up with it sometimes. A restart keeps the level, so start a new game.
+            if (board->game.dead)
+            {
+                gameInit(&board->game, seed += BENCH_CORPUS);
+            }
+        }
+
+        board->landed = gameGhostPiece(&board->game);
+        board->landed.data.color = board->game.piece.data.color;
+        memcpy(board->locked, board->game.grid, sizeof(board->locked));
+
+        GridPieceParts parts = constructGridPieceParts(&board->landed);
+
+        for (size_t part = 0; part < PIECE_PARTS_COUNT_1D; part++)
+        {
+            board->locked[gridIndexFromCoordinate(parts.coordinates[part])] = (Block){.color = board->landed.data.color};
+        }
+    }
+}
+
+static uint64_t benchConstructParts(uint64_t iterations)
+{
+    uint64_t sink = 0;
+
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        GridPieceParts parts = constructGridPieceParts(&corpus[i % BENCH_CORPUS].game.piece);
+        sink += (uint64_t)parts.coordinates[i % PIECE_PARTS_COUNT_1D].x;
+    }
+
+    return sink;
+}
+
+// Every position the piece could be tested at on the way down, like rotation, moves and gravity do.
+static uint64_t benchCheckCollisions(uint64_t iterations)
+{
+    uint64_t sink = 0;
+
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        const BenchBoard *board = &corpus[i % BENCH_CORPUS];
+        GridPiece piece = board->game.piece;
+        piece.origin.y = (uint32_t)(i / BENCH_CORPUS) % ((uint32_t)board->landed.origin.y + 2);
+        sink += checkCollisions(board->game.grid, &piece);
+    }
+
+    return sink;
+}
+
+static uint64_t benchCheckLines(uint64_t iterations)
+{
+    uint64_t sink = 0;
+
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        const BenchBoard *board = &corpus[i % BENCH_CORPUS];
+        LinesResult lines = checkLines(board->locked, &board->landed);
+        sink += lines.destroyed[0] + lines.destroyed[3];
+    }
+
+    return sink;
+}
+
+// One to four lines cleared at the bottom. The cost does not depend on what the grid holds, so
+// the same grids are shifted over and over.
+static uint64_t benchApplyGravityToBlocks(uint64_t iterations)
+{
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        applyGravityToBlocks(scratch[i % BENCH_CORPUS].grid, GRID_HEIGHT - 1, 1 + i / BENCH_CORPUS % 4);
+    }
+
+    return scratch[0].grid[GRID_WIDTH * GRID_HEIGHT - 1].color.r;
+}
+
+// From where the piece is to where it lands, without locking it.
+static uint64_t benchHardDrop(uint64_t iterations)
+{
+    uint64_t sink = 0;
+
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        Game *game = &scratch[i % BENCH_CORPUS];
+        game->piece = corpus[i % BENCH_CORPUS].game.piece;
+        sink += dropPiece(game, true, false, false);
+    }
+
+    return sink;
+}
+
+// Each corpus piece to either wall in one go, as auto shift with an ARR of 0 does every tick.
+static uint64_t benchSlideToWall(uint64_t iterations)
+{
+    uint64_t sink = 0;
+
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        const Game *game = &corpus[i % BENCH_CORPUS].game;
+        GridPiece piece = game->piece;
+        slidePieceToWall(game->grid, &piece, i & 1 ? 1 : -1);
+        sink += (uint64_t)piece.origin.x;
+    }
+
+    return sink;
+}
+
+// slidePieceToWall has to land where moving a cell at a time does, for every corpus piece in every
+// orientation, both ways, from everywhere it fits.
+static bool checkSlideToWall(void)
+{
+    for (size_t i = 0; i < BENCH_CORPUS; i++)
+    {
+        const Game *game = &corpus[i].game;
+
+        for (int orientation = 0; orientation <= ORIENTATION_COUNT; orientation++)
+        {
+            for (int y = 0; y < GRID_HEIGHT; y++)
+            {
+                for (int direction = -1; direction <= 1; direction += 2)
+                {
+                    GridPiece expected = game->piece;
+                    expected.orientation = orientation;
+                    expected.origin.y = y;
+
+                    if (checkCollisions(game->grid, &expected) != NO_HIT)
+                    {
+                        continue;
+                    }
+
+                    GridPiece actual = expected;
+
+                    for (int step = 0; step < GRID_WIDTH; step++)
+                    {
+                        movePieceToSides(game->grid, &expected, direction);
+                    }
+
+                    slidePieceToWall(game->grid, &actual, direction);
+
+                    if (actual.origin.x != expected.origin.x)
+                    {
+                        fprintf(stderr, "slidePieceToWall: board %zu, row %d, direction %d stops at %d instead of %d\n", i, y, direction,
+                                (int)actual.origin.x, (int)expected.origin.x);
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+static uint64_t benchGhost(uint64_t iterations)
+{
+    uint64_t sink = 0;
+
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        sink += (uint64_t)gameGhostPiece(&corpus[i % BENCH_CORPUS].game).origin.y;
+    }
+
+    return sink;
+}
+
+static uint64_t benchDequeueNextPiece(uint64_t iterations)
+{
+    uint64_t sink = 0;
+
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        sink += dequeueNextPiece(&scratch[i % BENCH_CORPUS]).data.type;
+    }
+
+    return sink;
+}
+
+static uint64_t benchMakeRandomPiece(uint64_t iterations)
+{
+    uint64_t sink = 0;
+
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        sink += makeRandomPiece(&scratch[i % BENCH_CORPUS]).type;
+    }
+
+    return sink;
+}
+
+static int benchCompareDoubles(const void *a, const void *b)
+{
+    double left = *(const double *)a;
+    double right = *(const double *)b;
+    return (left > right) - (left < right);
+}
+
+static double benchMedian(double *values, size_t count)
+{
+    qsort(values, count, sizeof(double), benchCompareDoubles);
+    return count % 2 ? values[count / 2] : (values[count / 2 - 1] + values[count / 2]) / 2;
+}
+
+static BenchResult benchMicro(const char *name, uint64_t (*run)(uint64_t iterations))
+{
+    BenchResult result = {.repetitions = BENCH_REPETITIONS};
+    snprintf(result.name, sizeof(result.name), "%s", name);
+
+    for (size_t i = 0; i < BENCH_CORPUS; i++)
+    {
+        scratch[i] = corpus[i].game;
+    }
+
+    // Warm the caches and branch predictors, and find how many calls fill a repetition.
+    allocForbid(true);
+    uint64_t iterations = BENCH_CORPUS;
+    double start = benchNow();
+    double elapsed = 0;
+    uint64_t calls = 0;
+
+    while (elapsed < BENCH_WARMUP_SECONDS)
+    {
+        benchSink += run(iterations);
+        calls += iterations;
+        elapsed = benchNow() - start;
+    }
+
+    result.iterations = (uint64_t)(calls / elapsed * BENCH_REPETITION_SECONDS);
+    result.iterations = result.iterations < BENCH_CORPUS ? BENCH_CORPUS : result.iterations;
+
+    double perCall[BENCH_REPETITIONS];
+
+    for (size_t repetition = 0; repetition < BENCH_REPETITIONS; repetition++)
+    {
+        start = benchNow();
+        benchSink += run(result.iterations);
+        perCall[repetition] = (benchNow() - start) / result.iterations * 1e9;
+    }
+
+    allocForbid(false);
+
+    result.medianNs = benchMedian(perCall, BENCH_REPETITIONS);
+
+    for (size_t repetition = 0; repetition < BENCH_REPETITIONS; repetition++)
+    {
+        perCall[repetition] = fabs(perCall[repetition] - result.medianNs);
+    }
+
+    result.madNs = benchMedian(perCall, BENCH_REPETITIONS);
+
+    printf("%-24s %9.2f ns  ± %6.2f ns MAD  (%u x %llu calls)\n", result.name, result.medianNs, result.madNs, result.repetitions,
+           (unsigned long long)result.iterations);
+
+    return result;
+}
+
+static bool benchWriteJson(const char *path, const BenchResult *results, size_t count)
+{
+    FILE *file = fopen(path, "w");
+
+    if (file == NULL)
+    {
+        perror(path);
+        return false;
+    }
+
+    // One benchmark per line, benchReadJson relies on it.
+    fprintf(file, "{\"benchmarks\":[\n");
+
+    for (size_t i = 0; i < count; i++)
+    {
+        fprintf(file, "{\"name\":\"%s\",\"median_ns\":%.4f,\"mad_ns\":%.4f,\"repetitions\":%u,\"iterations\":%llu}%s\n", results[i].name,
+                results[i].medianNs, results[i].madNs, results[i].repetitions, (unsigned long long)results[i].iterations, i + 1 < count ? "," : "");
+    }
+
+    fprintf(file, "]}\n");
+
+    bool written = !ferror(file);
+    written &= fclose(file) == 0;
+
+    if (!written)
+    {
+        perror(path);
+    }
+
+    return written;
+}
+
+// Reads what benchWriteJson wrote, returns how many results, or -1.
+static int benchReadJson(const char *path, BenchResult *results, size_t capacity)
+{
+    FILE *file = fopen(path, "r");
+
+    if (file == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+
+    char line[512];
+    size_t count = 0;
+
+    while (fgets(line, sizeof(line), file) != NULL && count < capacity)
+    {
+        BenchResult *result = &results[count];
+        unsigned long long iterations = 0;
+
+        if (sscanf(line, "{\"name\":\"%31[^\"]\",\"median_ns\":%lf,\"mad_ns\":%lf,\"repetitions\":%u,\"iterations\":%llu", result->name,
+                   &result->medianNs, &result->madNs, &result->repetitions, &iterations) == 5)
+        {
+            result->iterations = iterations;
+            count++;
+        }
+    }
+
+    fclose(file);
+
+    if (count == 0)
+    {
+        fprintf(stderr, "%s: no benchmark results\n", path);
+        return -1;
+    }
+
+    return count;
+}
+
+// Returns the exit status: 1 when something got slower.
+static int benchCompare(const char *beforePath, const char *afterPath)
+{
+    BenchResult before[BENCH_MAX_RESULTS];
+    BenchResult after[BENCH_MAX_RESULTS];
+    int beforeCount = benchReadJson(beforePath, before, BENCH_MAX_RESULTS);
+    int afterCount = benchReadJson(afterPath, after, BENCH_MAX_RESULTS);
+
+    if (beforeCount < 0 || afterCount < 0)
+    {
+        return 2;
+    }
+
+    int slower = 0;
+
+    printf("%-24s %12s %12s %9s\n", "benchmark", "before ns", "after ns", "change");
+
+    for (int i = 0; i < afterCount; i++)
+    {
+        const BenchResult *old = NULL;
+
+        for (int j = 0; j < beforeCount; j++)
+        {
+            if (strcmp(before[j].name, after[i].name) == 0)
+            {
+                old = &before[j];
+            }
+        }
+
+        if (old == NULL)
+        {
+            printf("%-24s %12s %12.2f %9s\n", after[i].name, "-", after[i].medianNs, "new");
+            continue;
+        }
+
+        double change = after[i].medianNs - old->medianNs;
+        double noise = BENCH_NOISE_MADS * fmax(old->madNs, after[i].madNs);
+        bool significant = fabs(change) > noise && fabs(change) > BENCH_MIN_CHANGE * old->medianNs;
+
+        printf("%-24s %12.2f %12.2f %+8.1f%%%s\n", after[i].name, old->medianNs, after[i].medianNs, change / old->medianNs * 100,
+               !significant ? "" : change > 0 ? "  slower" : "  faster");
+
+        slower += significant && change > 0;
+    }
+
+    if (slower > 0)
+    {
+        printf("%d benchmark%s got slower\n", slower, slower == 1 ? "" : "s");
+    }
+
+    return slower > 0;
+}
+
+static bool benchMicros(const char *jsonPath)
+{
+    static const struct
+    {
+        const char *name;
+        uint64_t (*run)(uint64_t iterations);
+    } micros[] = {
+        {"constructGridPieceParts", benchConstructParts},
+        {"checkCollisions", benchCheckCollisions},
+        {"checkLines", benchCheckLines},
+        {"applyGravityToBlocks", benchApplyGravityToBlocks},
+        {"hard drop", benchHardDrop},
+        {"slidePieceToWall", benchSlideToWall},
+        {"gameGhostPiece", benchGhost},
+        {"dequeueNextPiece", benchDequeueNextPiece},
+        {"makeRandomPiece", benchMakeRandomPiece},
+    };
+    BenchResult results[sizeof(micros) / sizeof(micros[0])];
+
+    makeCorpus();
+
+    if (!checkSlideToWall())
+    {
+        return false;
+    }
+
+    allocSetPhase(ALLOC_PHASE_SIM);
+
+    for (size_t i = 0; i < sizeof(micros) / sizeof(micros[0]); i++)
+    {
+        results[i] = benchMicro(micros[i].name, micros[i].run);
+    }
+
+    allocSetPhase(ALLOC_PHASE_STARTUP);
+
+    if (allocViolations() > 0)
+    {
+        fprintf(stderr, "the engine allocated during the micro-benchmarks\n");
+        return false;
+    }
+
+    return jsonPath == NULL || benchWriteJson(jsonPath, results, sizeof(micros) / sizeof(micros[0]));
+}
+
+int main(int argc, char **argv)
+{
+    const char *jsonPath = NULL;
+    bool microOnly = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+        {
+            jsonPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--micro") == 0)
+        {
+            microOnly = true;
+        }
+        else if (strcmp(argv[i], "--compare") == 0 && i + 2 < argc)
+        {
+            return benchCompare(argv[i + 1], argv[i + 2]);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--micro] [--json <results.json>]\n"
+                            "       %s --compare <before.json> <after.json>\n",
+                    argv[0], argv[0]);
+            return 1;
+        }
+    }
+
+    if (microOnly)
+    {
+        return benchMicros(jsonPath) ? 0 : 1;
+    }
+
+    for (size_t batch = 0; batch < BENCH_BATCHES; batch++)
+    {
+        boards[batch].count = EVAL_BATCH_SIZE;
+
+        for (size_t i = 0; i < EVAL_BATCH_SIZE; i++)
+        {
+            uint16_t rows[EVAL_BOARD_HEIGHT];
+            makeBoard(rows);
+
+            for (size_t y = 0; y < EVAL_BOARD_HEIGHT; y++)
+            {
+                boards[batch].rows[y][i] = rows[y];
+            }
+        }
+    }
+
+    bool avx2 = evalHasAvx2();
+
+    if (!checkAgainstReference("eval scalar", evalBatchScalar) || (avx2 && !checkAgainstReference("eval avx2", evalBatchAvx2)))
+    {
+        return 1;
+    }
+
+    benchEvaluate("eval reference", referenceBatch);
+    benchEvaluate("eval scalar", evalBatchScalar);
+
+    if (avx2)
+    {
+        benchEvaluate("eval avx2", evalBatchAvx2);
+    }
+    else
+    {
+        printf("%-16s %12s\n", "eval avx2", "unsupported");
+    }
+
+    makeGames();
+    double stepSeconds = benchStep();
+
+    if (stepSeconds == 0)
+    {
+        return 1;
+    }
+
+    benchChecksum(stepSeconds);
+
+    if (!benchSnapshots() || !checkNetplay())
+    {
+        return 1;
+    }
+
+    printf("\n");
+
+    if (!benchMicros(jsonPath))
+    {
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,482 @@
+#ifndef BOT_H
+#define BOT_H
+
+#include "botapi.h"
+#include "eval.h"
+
+// Built-in bot. It only sees the game through a TetrisBotView, so the same code runs in-process
+// and as the bots/builtin.c plugin.
+
+typedef struct BotWeights
+{
+    float landingHeight;
+    float linesCleared;
+    float holes;
+    float rowTransitions;
+    float columnTransitions;
+    float wells;
+    float bumpiness;
+} BotWeights;
+
+extern const BotWeights BOT_DEFAULT_WEIGHTS;
+
+typedef struct BotBoard
+{
+    uint16_t rows[EVAL_BOARD_HEIGHT];
+} BotBoard;
+
+typedef struct BotPlacement
+{
+    bool usesHold;
+    int rotations;
+    int startX;
+    int x;
+    int y;
+    int linesCleared;
+} BotPlacement;
+
+// The search deepens one queued piece at a time. Each round places the next piece on the
+// BOT_BEAM_WIDTH best boards of the previous round, and only a round that finishes before the
+// deadline replaces the best answer so far.
+#define BOT_BEAM_WIDTH 32
+#define BOT_MAX_PIECE_PLACEMENTS (TETRIS_BOT_ORIENTATIONS * EVAL_BOARD_WIDTH)
+#define BOT_MAX_NODES (BOT_BEAM_WIDTH * BOT_MAX_PIECE_PLACEMENTS)
+
+typedef struct BotNode
+{
+    BotBoard board;
+    float path;         // landing height and lines cleared terms of every placement on the way here
+    float value;        // path plus the features of board
+    uint16_t root;      // index of the first placement on the way here
+    uint8_t nextPiece;  // queue index of the piece to place next
+} BotNode;
+
+typedef struct Bot
+{
+    BotWeights weights;
+    EvalBoards candidates;
+    EvalFeatures features;
+    BotPlacement placements[2 * BOT_MAX_PIECE_PLACEMENTS];
+    BotNode nodes[2][BOT_MAX_NODES];
+    uint32_t evaluated;
+} Bot;
+
+void botInit(Bot *bot);
+int32_t botDecide(Bot *bot, const TetrisBotView *view, TetrisBotOutput *output);
+const TetrisBotInterface *botBuiltinInterface(void);
+
+#endif // BOT_H
+
+#if defined(BOT_IMPLEMENTATION) && !defined(BOT_IMPLEMENTED)
+#define BOT_IMPLEMENTED
+
+#include <stdlib.h>
+
+// Dellacherie's weights, with lines cleared standing in for eroded cells.
+const BotWeights BOT_DEFAULT_WEIGHTS = {
+    .landingHeight = -4.500158825082766f,
+    .linesCleared = 3.4181268101392694f,
+    .holes = -7.899265427351652f,
+    .rowTransitions = -3.2178882868487753f,
+    .columnTransitions = -9.348695305445199f,
+    .wells = -3.3855972247263626f,
+    .bumpiness = -0.2f,
+};
+
+typedef struct BotShape
+{
+    uint16_t rows[TETRIS_BOT_SHAPE_SIZE];
+} BotShape;
+
+static BotShape botShape(const TetrisBotView *view, int type, int orientation)
+{
+    BotShape shape = {0};
+
+    for (int i = 0; i < TETRIS_BOT_SHAPE_SIZE * TETRIS_BOT_SHAPE_SIZE; i++)
+    {
+        if (view->shapes[type][orientation][i])
+        {
+            shape.rows[i / TETRIS_BOT_SHAPE_SIZE] |= 1 << (i % TETRIS_BOT_SHAPE_SIZE);
+        }
+    }
+
+    return shape;
+}
+
+static bool botShiftRow(uint16_t row, int x, uint16_t *shifted)
+{
+    if (x >= 0)
+    {
+        *shifted = row << x;
+        return (*shifted & ~EVAL_FULL_ROW) == 0;
+    }
+
+    if (row & ((1 << -x) - 1))
+    {
+        return false;
+    }
+
+    *shifted = row >> -x;
+    return true;
+}
+
+static bool botFits(const BotBoard *board, const BotShape *shape, int x, int y)
+{
+    for (int r = 0; r < TETRIS_BOT_SHAPE_SIZE; r++)
+    {
+        if (!shape->rows[r])
+        {
+            continue;
+        }
+
+        uint16_t shifted;
+        if (y + r < 0 || y + r >= EVAL_BOARD_HEIGHT || !botShiftRow(shape->rows[r], x, &shifted))
+        {
+            return false;
+        }
+
+        if (board->rows[y + r] & shifted)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static int botPlace(BotBoard *board, const BotShape *shape, int x, int y)
+{
+    for (int r = 0; r < TETRIS_BOT_SHAPE_SIZE; r++)
+    {
+        uint16_t shifted;
+        if (shape->rows[r] && botShiftRow(shape->rows[r], x, &shifted))
+        {
+            board->rows[y + r] |= shifted;
+        }
+    }
+
+    int destination = EVAL_BOARD_HEIGHT - 1;
+    for (int source = EVAL_BOARD_HEIGHT - 1; source >= 0; source--)
+    {
+        if (board->rows[source] != EVAL_FULL_ROW)
+        {
+            board->rows[destination--] = board->rows[source];
+        }
+    }
+
+    int lines = destination + 1;
+    for (; destination >= 0; destination--)
+    {
+        board->rows[destination] = 0;
+    }
+
+    return lines;
+}
+
+static float botLandingHeight(const BotShape *shape, int y)
+{
+    int top = -1;
+    int bottom = 0;
+
+    for (int r = 0; r < TETRIS_BOT_SHAPE_SIZE; r++)
+    {
+        if (shape->rows[r])
+        {
+            top = top < 0 ? r : top;
+            bottom = r;
+        }
+    }
+
+    return EVAL_BOARD_HEIGHT - (y + (top + bottom) / 2.0f);
+}
+
+static BotBoard botBoardFromView(const TetrisBotView *view)
+{
+    BotBoard board = {0};
+
+    for (int y = 0; y < view->height; y++)
+    {
+        for (int x = 0; x < view->width; x++)
+        {
+            TetrisBotColor cell = view->cells[y * view->width + x];
+            bool empty = cell.r == view->emptyCell.r && cell.g == view->emptyCell.g && cell.b == view->emptyCell.b && cell.a == view->emptyCell.a;
+
+            if (!empty)
+            {
+                board.rows[y] |= 1 << x;
+            }
+        }
+    }
+
+    return board;
+}
+
+// Every placement reachable by rotating in place, sliding sideways and dropping. Fills in the
+// boards and path terms of nodes, and placements when it is not NULL. Returns how many were added.
+static size_t botExpand(const Bot *bot, const TetrisBotView *view, const BotBoard *board, int type, int orientation, int x, int y, BotNode *nodes, BotPlacement *placements)
+{
+    size_t count = 0;
+
+    for (int rotations = 0; rotations < TETRIS_BOT_ORIENTATIONS; rotations++)
+    {
+        BotShape shape = botShape(view, type, (orientation + rotations) % TETRIS_BOT_ORIENTATIONS);
+
+        if (!botFits(board, &shape, x, y))
+        {
+            break;
+        }
+
+        int left = x;
+        while (botFits(board, &shape, left - 1, y))
+        {
+            left--;
+        }
+
+        int right = x;
+        while (botFits(board, &shape, right + 1, y))
+        {
+            right++;
+        }
+
+        for (int targetX = left; targetX <= right; targetX++)
+        {
+            int targetY = y;
+            while (botFits(board, &shape, targetX, targetY + 1))
+            {
+                targetY++;
+            }
+
+            BotNode *node = &nodes[count];
+            node->board = *board;
+            int lines = botPlace(&node->board, &shape, targetX, targetY);
+            node->path = botLandingHeight(&shape, targetY) * bot->weights.landingHeight + lines * bot->weights.linesCleared;
+
+            if (placements != NULL)
+            {
+                placements[count] = (BotPlacement){
+                    .rotations = rotations,
+                    .startX = x,
+                    .x = targetX,
+                    .y = targetY,
+                    .linesCleared = lines,
+                };
+            }
+
+            count++;
+        }
+    }
+
+    return count;
+}
+
+static float botScoreFeatures(const BotWeights *weights, const EvalFeatures *features, size_t i)
+{
+    return features->holes[i] * weights->holes +
+           features->rowTransitions[i] * weights->rowTransitions +
+           features->columnTransitions[i] * weights->columnTransitions +
+           features->wells[i] * weights->wells +
+           features->bumpiness[i] * weights->bumpiness;
+}
+
+static void botAppendInput(TetrisBotOutput *output, TetrisBotInput input)
+{
+    if (output->count < TETRIS_BOT_MAX_INPUTS)
+    {
+        output->inputs[output->count++] = input;
+    }
+}
+
+// Scores nodes a batch at a time. With a view, gives up and returns false once it asks to stop.
+static bool botEvaluate(Bot *bot, const TetrisBotView *view, BotNode *nodes, size_t count)
+{
+    for (size_t start = 0; start < count; start += EVAL_BATCH_SIZE)
+    {
+        if (view != NULL && view->shouldStop(view->context))
+        {
+            return false;
+        }
+
+        bot->candidates.count = count - start < EVAL_BATCH_SIZE ? count - start : EVAL_BATCH_SIZE;
+
+        for (size_t i = 0; i < bot->candidates.count; i++)
+        {
+            for (int row = 0; row < EVAL_BOARD_HEIGHT; row++)
+            {
+                bot->candidates.rows[row][i] = nodes[start + i].board.rows[row];
+            }
+        }
+
+        evalBatch(&bot->candidates, &bot->features);
+
+        for (size_t i = 0; i < bot->candidates.count; i++)
+        {
+            nodes[start + i].value = nodes[start + i].path + botScoreFeatures(&bot->weights, &bot->features, i);
+        }
+
+        bot->evaluated += bot->candidates.count;
+    }
+
+    return true;
+}
+
+static int botCompareNodes(const void *a, const void *b)
+{
+    float left = ((const BotNode *)a)->value;
+    float right = ((const BotNode *)b)->value;
+    return (left < right) - (left > right);
+}
+
+void botInit(Bot *bot)
+{
+    bot->weights = BOT_DEFAULT_WEIGHTS;
+    bot->candidates.count = 0;
+    bot->evaluated = 0;
+}
+
+int32_t botDecide(Bot *bot, const TetrisBotView *view, TetrisBotOutput *output)
+{
+    output->count = 0;
+
+    if (view->abiVersion != TETRIS_BOT_ABI_VERSION || view->width != EVAL_BOARD_WIDTH || view->height != EVAL_BOARD_HEIGHT)
+    {
+        return -1;
+    }
+
+    const BotBoard board = botBoardFromView(view);
+    const TetrisBotGridPiece *active = view->active;
+    BotNode *roots = bot->nodes[0];
+
+    size_t count = botExpand(bot, view, &board, active->piece.type, active->orientation, (int)active->x, (int)active->y, roots, bot->placements);
+    size_t held = count;
+
+    const TetrisBotPiece *swapped = view->hold != NULL ? view->hold : view->queueLength > 0 ? &view->queue[0] : NULL;
+    if (view->holdAvailable && swapped != NULL)
+    {
+        count += botExpand(bot, view, &board, swapped->type, 0, view->width / 2 - 1, 0, &roots[held], &bot->placements[held]);
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        bot->placements[i].usesHold = i >= held;
+        roots[i].root = i;
+        // Holding with nothing held takes the first queued piece out of the queue.
+        roots[i].nextPiece = i >= held && view->hold == NULL ? 1 : 0;
+    }
+
+    bot->evaluated = 0;
+
+    if (count == 0)
+    {
+        botAppendInput(output, TETRIS_BOT_INPUT_HARD_DROP);
+        return 0;
+    }
+
+    // The first round always completes, so there is an answer however short the budget.
+    botEvaluate(bot, NULL, roots, count);
+    qsort(roots, count, sizeof(BotNode), botCompareNodes);
+
+    size_t best = roots[0].root;
+    int depth = 1;
+
+    for (int layer = 0; depth <= view->queueLength; layer ^= 1)
+    {
+        const BotNode *parents = bot->nodes[layer];
+        BotNode *children = bot->nodes[layer ^ 1];
+        size_t beam = count < BOT_BEAM_WIDTH ? count : BOT_BEAM_WIDTH;
+        size_t childCount = 0;
+
+        for (size_t i = 0; i < beam; i++)
+        {
+            const BotNode *parent = &parents[i];
+
+            if (parent->nextPiece >= view->queueLength)
+            {
+                continue;
+            }
+
+            size_t added = botExpand(bot, view, &parent->board, view->queue[parent->nextPiece].type, 0, view->width / 2 - 1, 0, &children[childCount], NULL);
+
+            for (size_t j = childCount; j < childCount + added; j++)
+            {
+                children[j].path += parent->path;
+                children[j].root = parent->root;
+                children[j].nextPiece = parent->nextPiece + 1;
+            }
+
+            childCount += added;
+        }
+
+        if (childCount == 0 || !botEvaluate(bot, view, children, childCount))
+        {
+            break;
+        }
+
+        qsort(children, childCount, sizeof(BotNode), botCompareNodes);
+
+        best = children[0].root;
+        count = childCount;
+        depth++;
+    }
+
+    const BotPlacement *placement = &bot->placements[best];
+
+    if (placement->usesHold)
+    {
+        botAppendInput(output, TETRIS_BOT_INPUT_HOLD);
+    }
+
+    for (int i = 0; i < placement->rotations; i++)
+    {
+        botAppendInput(output, TETRIS_BOT_INPUT_ROTATE);
+    }
+
+    int shift = placement->x - placement->startX;
+    for (int i = 0; i < abs(shift); i++)
+    {
+        botAppendInput(output, shift < 0 ? TETRIS_BOT_INPUT_LEFT : TETRIS_BOT_INPUT_RIGHT);
+    }
+
+    botAppendInput(output, TETRIS_BOT_INPUT_HARD_DROP);
+
+    output->depth = depth;
+    output->nodes = bot->evaluated;
+
+    return 0;
+}
+
+static void *botCreate(void)
+{
+    Bot *bot = malloc(sizeof(Bot));
+
+    if (bot != NULL)
+    {
+        botInit(bot);
+    }
+
+    return bot;
+}
+
+static int32_t botInterfaceDecide(void *bot, const TetrisBotView *view, TetrisBotOutput *output)
+{
+    return botDecide(bot, view, output);
+}
+
+static void botDestroy(void *bot)
+{
+    free(bot);
+}
+
+const TetrisBotInterface *botBuiltinInterface(void)
+{
+    static const TetrisBotInterface interface = {
+        .abiVersion = TETRIS_BOT_ABI_VERSION,
+        .name = "builtin",
+        .create = botCreate,
+        .decide = botInterfaceDecide,
+        .destroy = botDestroy,
+    };
+
+    return &interface;
+}
+
+#endif // BOT_IMPLEMENTATION
@@ -0,0 +1,109 @@
+#ifndef BOTAPI_H
+#define BOTAPI_H
+
+#include <stdint.h>
+
+// C interface between the game and bots built as shared objects.
+//
+// A bot exports TETRIS_BOT_ENTRY_POINT, which returns its TetrisBotInterface. For every piece the
+// game calls decide() on a worker thread with a read-only view into a copy of the game the host
+// keeps for it; the view stays valid and unchanged until decide() returns, even past the
+// deadline. Structures only grow at the end, and TETRIS_BOT_ABI_VERSION changes whenever the
+// meaning of an existing field does.
+
+#define TETRIS_BOT_ABI_VERSION 1
+#define TETRIS_BOT_ENTRY_POINT "tetrisBotGetInterface"
+
+#define TETRIS_BOT_PIECE_TYPES 7
+#define TETRIS_BOT_ORIENTATIONS 4
+#define TETRIS_BOT_SHAPE_SIZE 4
+#define TETRIS_BOT_MAX_INPUTS 32
+
+// ROTATE turns clockwise around the 4x4 box and is refused when the result collides, there are
+// no kicks. LEFT, RIGHT and SOFT_DROP move one cell. HARD_DROP locks the piece and ends the plan.
+// HOLD swaps the active piece with the held one (or the first queued one when nothing is held);
+// the remaining inputs then apply to the piece that spawns.
+typedef enum TetrisBotInput
+{
+    TETRIS_BOT_INPUT_ROTATE = 0,
+    TETRIS_BOT_INPUT_LEFT,
+    TETRIS_BOT_INPUT_RIGHT,
+    TETRIS_BOT_INPUT_SOFT_DROP,
+    TETRIS_BOT_INPUT_HARD_DROP,
+    TETRIS_BOT_INPUT_HOLD,
+} TetrisBotInput;
+
+typedef struct TetrisBotColor
+{
+    uint8_t r, g, b, a;
+} TetrisBotColor;
+
+// type: 0 O, 1 I, 2 S, 3 Z, 4 L, 5 J, 6 T
+typedef struct TetrisBotPiece
+{
+    TetrisBotColor color;
+    int32_t type;
+} TetrisBotPiece;
+
+// x and y are the grid coordinates of the top left corner of the piece's 4x4 box.
+typedef struct TetrisBotGridPiece
+{
+    TetrisBotPiece piece;
+    int32_t orientation;
+    float x;
+    float y;
+} TetrisBotGridPiece;
+
+typedef struct TetrisBotView
+{
+    uint32_t abiVersion;
+    int32_t width;
+    int32_t height;
+
+    // width * height cells, row by row, row 0 at the top. Empty cells are exactly emptyCell.
+    const TetrisBotColor *cells;
+    TetrisBotColor emptyCell;
+
+    // shapes[type][orientation][y * 4 + x] is 1 when the piece covers that cell of its box.
+    const uint8_t (*shapes)[TETRIS_BOT_ORIENTATIONS][TETRIS_BOT_SHAPE_SIZE * TETRIS_BOT_SHAPE_SIZE];
+
+    const TetrisBotGridPiece *active;
+    const TetrisBotPiece *hold; // NULL while nothing is held
+    int32_t holdAvailable;
+    const TetrisBotPiece *queue;
+    int32_t queueLength;
+
+    int32_t level;
+    int32_t score;
+
+    // Wall-clock time the host allows for this decision. Answers arriving later are discarded.
+    double budgetSeconds;
+
+    // Returns non-zero once the bot should return whatever it has.
+    int32_t (*shouldStop)(const void *context);
+    const void *context;
+} TetrisBotView;
+
+typedef struct TetrisBotOutput
+{
+    int32_t count;
+    uint8_t inputs[TETRIS_BOT_MAX_INPUTS];
+
+    // Optional search statistics, logged by the host. Left at 0 by bots that do not search.
+    int32_t depth;  // pieces looked ahead by the last search that completed
+    uint32_t nodes; // placements evaluated
+} TetrisBotOutput;
+
+typedef struct TetrisBotInterface
+{
+    uint32_t abiVersion;
+    const char *name;
+    void *(*create)(void);
+    // Returns 0 and fills output on success.
+    int32_t (*decide)(void *bot, const TetrisBotView *view, TetrisBotOutput *output);
+    void (*destroy)(void *bot);
+} TetrisBotInterface;
+
+typedef const TetrisBotInterface *(*TetrisBotGetInterface)(void);
+
+#endif // BOTAPI_H
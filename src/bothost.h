@@ -0,0 +1,554 @@
+#ifndef BOTHOST_H
+#define BOTHOST_H
+
+#include "botapi.h"
+#include "tetris.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+// Runs a bot on its own thread so a slow decision never holds up a frame.
+//
+// The view handed to the bot points into the host's own copy of the Game passed to botHostRequest,
+// so the caller's game is free to go on. Bots are asked to stop once their budget runs out. Once
+// the budget and BOT_HOST_DEADLINE_SLACK have passed, botHostPoll reports BOT_HOST_TIMED_OUT
+// whether or not the bot has returned, and the answer of a bot that is still thinking is dropped
+// when it comes. botHostRequest refuses new work until then.
+
+#define BOT_HOST_LATENCY_SAMPLES 1024
+
+// A budget of 0 gives the bot this fraction of the time a piece takes to fall one row, so it
+// thinks longer at low levels and never holds a fast game up for long.
+#define BOT_HOST_GRAVITY_BUDGET 0.25
+// How long after the deadline an answer is still accepted, to cover the bot noticing it.
+#define BOT_HOST_DEADLINE_SLACK 0.002
+
+typedef enum BotHostStatus
+{
+    BOT_HOST_IDLE = 0,
+    BOT_HOST_THINKING,
+    BOT_HOST_READY,
+    BOT_HOST_TIMED_OUT,
+    BOT_HOST_FAILED,
+    BOT_HOST_ABANDONED, // TIMED_OUT was reported but decide() has not returned yet, polls as IDLE
+} BotHostStatus;
+
+typedef struct BotHost
+{
+    const TetrisBotInterface *interface;
+    void *library;
+    void *bot;
+    double budgetSeconds;
+
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;
+    bool started;
+    bool running;
+    bool hasRequest;
+
+    Game game; // what view points into, only written while the bot thread is idle
+    TetrisBotView view;
+    TetrisBotOutput output;
+    _Atomic int status;
+    atomic_bool cancelled;
+    double budget;
+    double deadline;
+    double elapsed;
+    FILE *log;
+
+    float latencies[BOT_HOST_LATENCY_SAMPLES];
+    uint32_t decisions;
+    uint32_t timeouts;
+} BotHost;
+
+// For bots built as shared objects: dlopen()s path and checks its ABI version.
+bool botHostLoad(BotHost *host, const char *path, double budgetSeconds);
+bool botHostStart(BotHost *host, const TetrisBotInterface *interface, double budgetSeconds);
+void botHostStop(BotHost *host);
+// Appends a CSV line per decision to path, written from the bot thread.
+bool botHostOpenLog(BotHost *host, const char *path);
+
+// Copies game for the bot. Fails while a request is in flight, including one that timed out and
+// that the bot is still working on.
+bool botHostRequest(BotHost *host, const Game *game);
+void botHostCancel(BotHost *host);
+// READY, TIMED_OUT and FAILED are reported once, after which the host is IDLE again.
+BotHostStatus botHostPoll(BotHost *host, TetrisBotOutput *output);
+
+// Decision latency over the last BOT_HOST_LATENCY_SAMPLES decisions, in seconds.
+double botHostLatencyPercentile(const BotHost *host, double percentile);
+
+// Plays a bot's plan one input per tick, asking for a new one whenever a piece spawns.
+typedef struct BotPlayer
+{
+    BotHost host;
+    TetrisBotOutput plan;
+    int32_t planIndex;
+    uint32_t plannedGame;
+    uint32_t plannedPiece;
+    bool hasPlan;
+} BotPlayer;
+
+// Returns false while the bot is still thinking within its budget, the game must not be stepped
+// until it returns true. Past the deadline, and until a late bot returns, gravity plays the piece.
+bool botPlayerInput(BotPlayer *player, const Game *game, GameInput *input);
+
+// Where the piece ends up if the plan is played from this state, ignoring gravity on the way.
+GridPiece botPlanLanding(const Game *game, const TetrisBotOutput *plan);
+
+#endif // BOTHOST_H
+
+#if defined(BOTHOST_IMPLEMENTATION) && !defined(BOTHOST_IMPLEMENTED)
+#define BOTHOST_IMPLEMENTED
+
+#include "sort.h"
+
+#include <dlfcn.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+_Static_assert(sizeof(Block) == sizeof(TetrisBotColor), "grid cells are shared with bots");
+_Static_assert(sizeof(Piece) == sizeof(TetrisBotPiece), "pieces are shared with bots");
+_Static_assert(offsetof(Piece, type) == offsetof(TetrisBotPiece, type), "pieces are shared with bots");
+_Static_assert(sizeof(PieceType) == sizeof(int32_t), "pieces are shared with bots");
+_Static_assert(offsetof(GridPiece, orientation) == offsetof(TetrisBotGridPiece, orientation), "the active piece is shared with bots");
+_Static_assert(offsetof(GridPiece, origin) == offsetof(TetrisBotGridPiece, x), "the active piece is shared with bots");
+_Static_assert(sizeof(GridPiece) == sizeof(TetrisBotGridPiece), "the active piece is shared with bots");
+
+static uint8_t botHostShapes[TETRIS_BOT_PIECE_TYPES][TETRIS_BOT_ORIENTATIONS][TETRIS_BOT_SHAPE_SIZE * TETRIS_BOT_SHAPE_SIZE];
+static pthread_once_t botHostShapesOnce = PTHREAD_ONCE_INIT;
+
+static void botHostInitShapes(void)
+{
+    for (int type = 0; type < TETRIS_BOT_PIECE_TYPES; type++)
+    {
+        for (int orientation = 0; orientation < TETRIS_BOT_ORIENTATIONS; orientation++)
+        {
+            bool *parts = piecePartsForOrientation(orientation, type);
+
+            for (int i = 0; i < PIECE_PARTS_COUNT; i++)
+            {
+                botHostShapes[type][orientation][i] = parts[i];
+            }
+        }
+    }
+}
+
+static double botHostNow(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static int32_t botHostShouldStop(const void *context)
+{
+    BotHost *host = (BotHost *)context;
+    return atomic_load(&host->cancelled) || botHostNow() > host->deadline;
+}
+
+static void *botHostThread(void *argument)
+{
+    BotHost *host = argument;
+
+    pthread_mutex_lock(&host->mutex);
+
+    while (true)
+    {
+        while (host->running && !host->hasRequest)
+        {
+            pthread_cond_wait(&host->wake, &host->mutex);
+        }
+
+        if (!host->running)
+        {
+            break;
+        }
+
+        host->hasRequest = false;
+        pthread_mutex_unlock(&host->mutex);
+
+        double start = botHostNow();
+        TetrisBotOutput output = {0};
+        int32_t result = host->interface->decide(host->bot, &host->view, &output);
+        double elapsed = botHostNow() - start;
+
+        pthread_mutex_lock(&host->mutex);
+
+        host->output = output;
+        host->elapsed = elapsed;
+
+        int status = result != 0 ? BOT_HOST_FAILED : (elapsed > host->budget + BOT_HOST_DEADLINE_SLACK || atomic_load(&host->cancelled)) ? BOT_HOST_TIMED_OUT
+                                                                                                                                        : BOT_HOST_READY;
+        int expected = BOT_HOST_THINKING;
+
+        // botHostPoll already gave up on this decision and reported it, the answer goes nowhere.
+        if (!atomic_compare_exchange_strong(&host->status, &expected, status))
+        {
+            status = BOT_HOST_TIMED_OUT;
+            atomic_store(&host->status, BOT_HOST_IDLE);
+        }
+
+        if (host->log != NULL)
+        {
+            fprintf(host->log, "%d,%.3f,%.3f,%d,%u,%s\n", host->view.level, host->budget * 1000, elapsed * 1000, output.depth, output.nodes,
+                    status == BOT_HOST_READY ? "ready" : status == BOT_HOST_TIMED_OUT ? "timeout" : "failed");
+        }
+    }
+
+    pthread_mutex_unlock(&host->mutex);
+
+    return NULL;
+}
+
+bool botHostStart(BotHost *host, const TetrisBotInterface *interface, double budgetSeconds)
+{
+    if (interface == NULL || interface->abiVersion != TETRIS_BOT_ABI_VERSION)
+    {
+        return false;
+    }
+
+    pthread_once(&botHostShapesOnce, botHostInitShapes);
+
+    host->interface = interface;
+    host->budgetSeconds = budgetSeconds;
+    host->bot = interface->create();
+
+    if (host->bot == NULL)
+    {
+        fprintf(stderr, "bot: %s could not be created\n", interface->name != NULL ? interface->name : "the bot");
+        return false;
+    }
+
+    host->running = true;
+    host->hasRequest = false;
+    host->decisions = 0;
+    host->timeouts = 0;
+    atomic_store(&host->status, BOT_HOST_IDLE);
+    atomic_store(&host->cancelled, false);
+
+    pthread_mutex_init(&host->mutex, NULL);
+    pthread_cond_init(&host->wake, NULL);
+
+    host->started = pthread_create(&host->thread, NULL, botHostThread, host) == 0;
+
+    // The bot's code may be unloaded next, so nothing of it may be left behind.
+    if (!host->started)
+    {
+        pthread_cond_destroy(&host->wake);
+        pthread_mutex_destroy(&host->mutex);
+        interface->destroy(host->bot);
+        host->bot = NULL;
+    }
+
+    return host->started;
+}
+
+bool botHostLoad(BotHost *host, const char *path, double budgetSeconds)
+{
+    host->library = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+
+    if (host->library == NULL)
+    {
+        fprintf(stderr, "bot: %s\n", dlerror());
+        return false;
+    }
+
+    TetrisBotGetInterface getInterface = (TetrisBotGetInterface)dlsym(host->library, TETRIS_BOT_ENTRY_POINT);
+    const TetrisBotInterface *interface = getInterface != NULL ? getInterface() : NULL;
+
+    if (interface == NULL || interface->abiVersion != TETRIS_BOT_ABI_VERSION)
+    {
+        fprintf(stderr, "bot: %s does not export a version %d bot\n", path, TETRIS_BOT_ABI_VERSION);
+        dlclose(host->library);
+        host->library = NULL;
+        return false;
+    }
+
+    if (!botHostStart(host, interface, budgetSeconds))
+    {
+        dlclose(host->library);
+        host->library = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+void botHostStop(BotHost *host)
+{
+    if (host->started)
+    {
+        atomic_store(&host->cancelled, true);
+
+        pthread_mutex_lock(&host->mutex);
+        host->running = false;
+        pthread_cond_signal(&host->wake);
+        pthread_mutex_unlock(&host->mutex);
+
+        pthread_join(host->thread, NULL);
+        pthread_cond_destroy(&host->wake);
+        pthread_mutex_destroy(&host->mutex);
+
+        host->interface->destroy(host->bot);
+        host->started = false;
+    }
+
+    if (host->log != NULL)
+    {
+        fclose(host->log);
+        host->log = NULL;
+    }
+
+    if (host->library != NULL)
+    {
+        dlclose(host->library);
+        host->library = NULL;
+    }
+}
+
+bool botHostOpenLog(BotHost *host, const char *path)
+{
+    host->log = fopen(path, "w");
+
+    if (host->log == NULL)
+    {
+        perror(path);
+        return false;
+    }
+
+    fprintf(host->log, "level,budget_ms,elapsed_ms,depth,nodes,status\n");
+
+    return true;
+}
+
+bool botHostRequest(BotHost *host, const Game *game)
+{
+    if (!host->started || atomic_load(&host->status) != BOT_HOST_IDLE)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&host->mutex);
+
+    host->game = *game;
+    game = &host->game;
+    host->budget = host->budgetSeconds > 0 ? host->budgetSeconds : BOT_HOST_GRAVITY_BUDGET * gravityInterval(game->level);
+    host->view = (TetrisBotView){
+        .abiVersion = TETRIS_BOT_ABI_VERSION,
+        .width = GRID_WIDTH,
+        .height = GRID_HEIGHT,
+        .cells = (const TetrisBotColor *)game->grid,
+        .emptyCell = {INVALID_BLOCK_COLOR.r, INVALID_BLOCK_COLOR.g, INVALID_BLOCK_COLOR.b, INVALID_BLOCK_COLOR.a},
+        .shapes = (const uint8_t (*)[TETRIS_BOT_ORIENTATIONS][TETRIS_BOT_SHAPE_SIZE * TETRIS_BOT_SHAPE_SIZE])botHostShapes,
+        .active = (const TetrisBotGridPiece *)&game->piece,
+        .hold = game->hasSavedPiece ? (const TetrisBotPiece *)&game->savedPiece : NULL,
+        .holdAvailable = !game->savedThisPiece,
+        .queue = (const TetrisBotPiece *)game->nextPieces,
+        .queueLength = NEXT_PIECES_COUNT,
+        .level = game->level,
+        .score = game->score,
+        .budgetSeconds = host->budget,
+        .shouldStop = botHostShouldStop,
+        .context = host,
+    };
+
+    atomic_store(&host->cancelled, false);
+    atomic_store(&host->status, BOT_HOST_THINKING);
+    host->deadline = botHostNow() + host->budget;
+    host->hasRequest = true;
+
+    pthread_cond_signal(&host->wake);
+    pthread_mutex_unlock(&host->mutex);
+
+    return true;
+}
+
+void botHostCancel(BotHost *host)
+{
+    atomic_store(&host->cancelled, true);
+}
+
+BotHostStatus botHostPoll(BotHost *host, TetrisBotOutput *output)
+{
+    BotHostStatus status = atomic_load(&host->status);
+
+    if (status == BOT_HOST_THINKING && botHostNow() > host->deadline + BOT_HOST_DEADLINE_SLACK)
+    {
+        int expected = BOT_HOST_THINKING;
+
+        // The bot thread swaps in its answer the same way, so only one of the two gets there.
+        if (atomic_compare_exchange_strong(&host->status, &expected, BOT_HOST_ABANDONED))
+        {
+            atomic_store(&host->cancelled, true);
+            host->latencies[host->decisions % BOT_HOST_LATENCY_SAMPLES] = botHostNow() - (host->deadline - host->budget);
+            host->decisions++;
+            host->timeouts++;
+            return BOT_HOST_TIMED_OUT;
+        }
+
+        status = expected;
+    }
+
+    if (status == BOT_HOST_IDLE || status == BOT_HOST_THINKING || status == BOT_HOST_ABANDONED)
+    {
+        return status == BOT_HOST_ABANDONED ? BOT_HOST_IDLE : status;
+    }
+
+    pthread_mutex_lock(&host->mutex);
+    *output = host->output;
+    host->latencies[host->decisions % BOT_HOST_LATENCY_SAMPLES] = host->elapsed;
+    atomic_store(&host->status, BOT_HOST_IDLE);
+    pthread_mutex_unlock(&host->mutex);
+
+    host->decisions++;
+    if (status == BOT_HOST_TIMED_OUT)
+    {
+        host->timeouts++;
+    }
+
+    return status;
+}
+
+double botHostLatencyPercentile(const BotHost *host, double percentile)
+{
+    size_t count = host->decisions < BOT_HOST_LATENCY_SAMPLES ? host->decisions : BOT_HOST_LATENCY_SAMPLES;
+
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    float sorted[BOT_HOST_LATENCY_SAMPLES];
+    memcpy(sorted, host->latencies, count * sizeof(float));
+    sortFloats(sorted, count);
+
+    size_t index = (size_t)(percentile / 100.0 * (count - 1) + 0.5);
+    return sorted[index];
+}
+
+static GameInput botPlayerTranslate(uint8_t input)
+{
+    switch (input)
+    {
+    case TETRIS_BOT_INPUT_ROTATE:
+        return GAME_INPUT_ROTATE;
+    case TETRIS_BOT_INPUT_LEFT:
+        return GAME_INPUT_LEFT;
+    case TETRIS_BOT_INPUT_RIGHT:
+        return GAME_INPUT_RIGHT;
+    case TETRIS_BOT_INPUT_SOFT_DROP:
+        return GAME_INPUT_SOFT_DROP;
+    case TETRIS_BOT_INPUT_HARD_DROP:
+        return GAME_INPUT_HARD_DROP;
+    case TETRIS_BOT_INPUT_HOLD:
+        return GAME_INPUT_HOLD;
+    }
+
+    return 0;
+}
+
+bool botPlayerInput(BotPlayer *player, const Game *game, GameInput *input)
+{
+    if (game->dead || game->paused)
+    {
+        return true;
+    }
+
+    BotHostStatus status = botHostPoll(&player->host, &player->plan);
+
+    if (status == BOT_HOST_THINKING)
+    {
+        return false;
+    }
+
+    if (status == BOT_HOST_READY)
+    {
+        player->hasPlan = true;
+        player->planIndex = 0;
+    }
+    else if (status == BOT_HOST_TIMED_OUT || status == BOT_HOST_FAILED)
+    {
+        // Let gravity place the piece.
+        player->hasPlan = true;
+        player->planIndex = player->plan.count;
+    }
+
+    if (!player->hasPlan || player->plannedGame != game->games || player->plannedPiece != game->piecesLocked)
+    {
+        player->hasPlan = false;
+
+        // A bot that ran late is still on its last piece, gravity plays this one until it is free.
+        if (!botHostRequest(&player->host, game))
+        {
+            return true;
+        }
+
+        player->plannedGame = game->games;
+        player->plannedPiece = game->piecesLocked;
+        return false;
+    }
+
+    if (player->planIndex >= player->plan.count)
+    {
+        return true;
+    }
+
+    GameInput next = botPlayerTranslate(player->plan.inputs[player->planIndex]);
+
+    if ((next & GAME_INPUT_HELD_MASK) && next != GAME_INPUT_HOLD && !gameMovementReady(game, next))
+    {
+        return true;
+    }
+
+    *input |= next;
+    player->planIndex++;
+
+    return true;
+}
+
+GridPiece botPlanLanding(const Game *game, const TetrisBotOutput *plan)
+{
+    GridPiece piece = game->piece;
+
+    for (int32_t i = 0; i < plan->count; i++)
+    {
+        switch (plan->inputs[i])
+        {
+        case TETRIS_BOT_INPUT_ROTATE:
+            rotatePiece(game->grid, &piece);
+            break;
+        case TETRIS_BOT_INPUT_LEFT:
+            movePieceToSides(game->grid, &piece, -1);
+            break;
+        case TETRIS_BOT_INPUT_RIGHT:
+            movePieceToSides(game->grid, &piece, 1);
+            break;
+        case TETRIS_BOT_INPUT_SOFT_DROP:
+            applyGravity(game->grid, &piece);
+            break;
+        case TETRIS_BOT_INPUT_HOLD:
+            piece = spawnPiece(game->hasSavedPiece ? game->savedPiece : game->nextPieces[0]);
+            break;
+        case TETRIS_BOT_INPUT_HARD_DROP:
+            while (applyGravity(game->grid, &piece) == NO_HIT)
+            {
+                ;
+            }
+            return piece;
+        }
+    }
+
+    while (applyGravity(game->grid, &piece) == NO_HIT)
+    {
+        ;
+    }
+
+    return piece;
+}
+
+#endif // BOTHOST_IMPLEMENTATION
@@ -0,0 +1,12 @@
+// The built-in bot packaged as a plugin, an example of a bot loaded with --bot.
+
+#define EVAL_IMPLEMENTATION
+#include "../eval.h"
+
+#define BOT_IMPLEMENTATION
+#include "../bot.h"
+
+__attribute__((visibility("default"))) const TetrisBotInterface *tetrisBotGetInterface(void)
+{
+    return botBuiltinInterface();
+}
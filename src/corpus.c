@@ -0,0 +1,183 @@
+#define TETRIS_IMPLEMENTATION
+#include "tetris.h"
+
+#define REPLAY_IMPLEMENTATION
+#include "replay.h"
+
+#define CORPUS_IMPLEMENTATION
+#include "corpus.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int usage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s add <corpus> [replay...]   append replays, with none only repairs the index\n"
+            "       %s list <corpus> [--min-score n] [--min-lines n]\n"
+            "       %s get <corpus> <game> <replay>   extract game number <game>\n",
+            program, program, program);
+    return 1;
+}
+
+static uint8_t *readFile(const char *path, size_t *size)
+{
+    FILE *file = fopen(path, "rb");
+
+    if (file == NULL)
+    {
+        perror(path);
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    uint8_t *data = length >= 0 ? malloc(length + 1) : NULL;
+
+    if (data == NULL || fread(data, 1, length, file) != (size_t)length)
+    {
+        perror(path);
+        free(data);
+        data = NULL;
+    }
+
+    *size = length;
+    fclose(file);
+
+    return data;
+}
+
+static int add(const char *path, char **replayPaths, int count)
+{
+    const uint8_t **replays = calloc(count + 1, sizeof(uint8_t *));
+    size_t *sizes = calloc(count + 1, sizeof(size_t));
+    int loaded = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        uint8_t *data = readFile(replayPaths[i], &sizes[loaded]);
+
+        if (data != NULL)
+        {
+            replays[loaded++] = data;
+        }
+    }
+
+    bool ok = corpusAppend(path, replays, sizes, loaded);
+
+    for (int i = 0; i < loaded; i++)
+    {
+        free((void *)replays[i]);
+    }
+
+    free(replays);
+    free(sizes);
+
+    return ok && loaded == count ? 0 : 1;
+}
+
+static int list(const Corpus *corpus, uint32_t minScore, uint32_t minLines)
+{
+    printf("game,seed,score,lines,seconds,bytes\n");
+
+    for (size_t i = 0; i < corpus->count; i++)
+    {
+        const CorpusEntry *entry = &corpus->entries[i];
+
+        if (entry->score >= minScore && entry->lines >= minLines)
+        {
+            printf("%zu,%llu,%u,%u,%.1f,%u\n", i, (unsigned long long)entry->seed, entry->score, entry->lines,
+                   (double)entry->ticks / GAME_TICKS_PER_SECOND, entry->length);
+        }
+    }
+
+    return 0;
+}
+
+static int get(const Corpus *corpus, size_t game, const char *path)
+{
+    size_t size;
+    const uint8_t *replay = corpusReplay(corpus, game, &size);
+
+    if (replay == NULL)
+    {
+        fprintf(stderr, "there are only %zu games\n", corpus->count);
+        return 1;
+    }
+
+    FILE *file = fopen(path, "wb");
+
+    if (file == NULL || fwrite(replay, 1, size, file) != size)
+    {
+        perror(path);
+
+        if (file != NULL)
+        {
+            fclose(file);
+        }
+
+        return 1;
+    }
+
+    return fclose(file) == 0 ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        return usage(argv[0]);
+    }
+
+    const char *command = argv[1];
+    const char *path = argv[2];
+
+    if (strcmp(command, "add") == 0)
+    {
+        return add(path, argv + 3, argc - 3);
+    }
+
+    Corpus corpus;
+
+    if (!corpusOpen(&corpus, path))
+    {
+        return 1;
+    }
+
+    int result = 1;
+
+    if (strcmp(command, "list") == 0)
+    {
+        uint32_t minScore = 0;
+        uint32_t minLines = 0;
+
+        for (int i = 3; i + 1 < argc; i += 2)
+        {
+            if (strcmp(argv[i], "--min-score") == 0)
+            {
+                minScore = strtoul(argv[i + 1], NULL, 10);
+            }
+            else if (strcmp(argv[i], "--min-lines") == 0)
+            {
+                minLines = strtoul(argv[i + 1], NULL, 10);
+            }
+        }
+
+        result = list(&corpus, minScore, minLines);
+    }
+    else if (strcmp(command, "get") == 0 && argc == 5)
+    {
+        result = get(&corpus, strtoull(argv[3], NULL, 10), argv[4]);
+    }
+    else
+    {
+        result = usage(argv[0]);
+    }
+
+    corpusClose(&corpus);
+
+    return result;
+}
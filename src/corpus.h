@@ -0,0 +1,449 @@
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Many replays in one file, read through mmap.
+//
+// Layout, native little endian:
+//   header   "TRPC", u32 version, u64 reserved
+//   records  "TRRC", u32 length, u32 checksum, then the replay, back to back
+//   index    zero padding to 8 bytes, then one CorpusEntry per record
+//   trailer  CorpusTrailer, the last bytes of the file
+//
+// Appending cuts the index off, adds records, syncs, then writes a new index and trailer and
+// syncs again. A crash in between leaves whole records followed by at most one torn one, so when
+// the trailer does not check out the index is rebuilt by walking the records.
+
+#define CORPUS_MAGIC "TRPC"
+#define CORPUS_RECORD_MAGIC "TRRC"
+#define CORPUS_TRAILER_MAGIC "TRPI"
+#define CORPUS_VERSION 1
+
+typedef struct CorpusHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t reserved;
+} CorpusHeader;
+
+typedef struct CorpusRecord
+{
+    char magic[4];
+    uint32_t length;
+    uint32_t checksum;
+} CorpusRecord;
+
+typedef struct CorpusEntry
+{
+    uint64_t offset; // of the replay itself, past its CorpusRecord
+    uint64_t seed;
+    uint32_t length;
+    uint32_t score;
+    uint32_t lines;
+    uint32_t ticks;
+} CorpusEntry;
+
+typedef struct CorpusTrailer
+{
+    uint64_t indexOffset;
+    uint64_t count;
+    uint32_t indexChecksum;
+    char magic[4];
+} CorpusTrailer;
+
+typedef struct Corpus
+{
+    int fd;
+    const uint8_t *data;
+    size_t size;
+
+    // Points into the mapping, or at rebuilt when the index had to be rebuilt.
+    const CorpusEntry *entries;
+    size_t count;
+    CorpusEntry *rebuilt;
+    size_t recordsEnd;
+} Corpus;
+
+bool corpusOpen(Corpus *corpus, const char *path);
+void corpusClose(Corpus *corpus);
+// The replay of game index, straight from the mapping.
+const uint8_t *corpusReplay(const Corpus *corpus, size_t index, size_t *size);
+
+// Adds replays to path, creating it when needed. With count 0 it only rewrites the index.
+bool corpusAppend(const char *path, const uint8_t *const *replays, const size_t *sizes, size_t count);
+
+uint32_t corpusChecksum(const uint8_t *data, size_t size);
+
+#endif // CORPUS_H
+
+#if defined(CORPUS_IMPLEMENTATION) && !defined(CORPUS_IMPLEMENTED)
+#define CORPUS_IMPLEMENTED
+
+#include "replay.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+_Static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "corpus files are mapped as little endian structs");
+_Static_assert(sizeof(CorpusHeader) == 16, "corpus header layout");
+_Static_assert(sizeof(CorpusRecord) == 12, "corpus record layout");
+_Static_assert(sizeof(CorpusEntry) == 32, "corpus index layout");
+_Static_assert(sizeof(CorpusTrailer) == 24, "corpus trailer layout");
+
+#define CORPUS_INDEX_ALIGNMENT 8
+
+// FNV-1a.
+uint32_t corpusChecksum(const uint8_t *data, size_t size)
+{
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+// Fills in everything but the offset from the replay's header and trailer.
+static bool corpusDescribe(const uint8_t *replay, size_t size, CorpusEntry *entry)
+{
+    ReplayReader reader;
+
+    if (!replayReaderOpen(&reader, replay, size))
+    {
+        return false;
+    }
+
+    replayReaderSkipToEnd(&reader);
+
+    *entry = (CorpusEntry){
+        .seed = reader.header.seed,
+        .length = size,
+        .score = reader.score,
+        .lines = reader.lines,
+        .ticks = reader.complete ? reader.endTick : reader.eventTick,
+    };
+
+    return true;
+}
+
+static bool corpusIndexIsValid(const Corpus *corpus, const CorpusTrailer *trailer)
+{
+    if (corpus->size < sizeof(CorpusHeader) + sizeof(CorpusTrailer) || memcmp(trailer->magic, CORPUS_TRAILER_MAGIC, 4) != 0)
+    {
+        return false;
+    }
+
+    size_t indexEnd = corpus->size - sizeof(CorpusTrailer);
+
+    if (trailer->indexOffset % CORPUS_INDEX_ALIGNMENT != 0 || trailer->indexOffset < sizeof(CorpusHeader) || trailer->indexOffset > indexEnd ||
+        trailer->count != (indexEnd - trailer->indexOffset) / sizeof(CorpusEntry) ||
+        (indexEnd - trailer->indexOffset) % sizeof(CorpusEntry) != 0)
+    {
+        return false;
+    }
+
+    if (corpusChecksum(corpus->data + trailer->indexOffset, indexEnd - trailer->indexOffset) != trailer->indexChecksum)
+    {
+        return false;
+    }
+
+    // The checksum only says the index is what was written. Every replay it points at must also
+    // lie after the previous one and before the index, or corpusReplay would read past the mapping.
+    const CorpusEntry *entries = (const CorpusEntry *)(corpus->data + trailer->indexOffset);
+    uint64_t previousEnd = sizeof(CorpusHeader);
+
+    for (uint64_t i = 0; i < trailer->count; i++)
+    {
+        if (entries[i].offset < previousEnd + sizeof(CorpusRecord) || entries[i].offset > trailer->indexOffset ||
+            entries[i].length > trailer->indexOffset - entries[i].offset)
+        {
+            return false;
+        }
+
+        previousEnd = entries[i].offset + entries[i].length;
+    }
+
+    return true;
+}
+
+// Walks the records from the start, stopping at the first one that is cut short or damaged.
+static bool corpusRebuildIndex(Corpus *corpus)
+{
+    size_t capacity = 0;
+    size_t position = sizeof(CorpusHeader);
+
+    corpus->count = 0;
+
+    while (position + sizeof(CorpusRecord) <= corpus->size)
+    {
+        CorpusRecord record;
+        memcpy(&record, corpus->data + position, sizeof(record));
+
+        size_t start = position + sizeof(CorpusRecord);
+        CorpusEntry entry;
+
+        if (memcmp(record.magic, CORPUS_RECORD_MAGIC, 4) != 0 || record.length > corpus->size - start ||
+            corpusChecksum(corpus->data + start, record.length) != record.checksum ||
+            !corpusDescribe(corpus->data + start, record.length, &entry))
+        {
+            break;
+        }
+
+        if (corpus->count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 1024;
+            CorpusEntry *entries = realloc(corpus->rebuilt, capacity * sizeof(CorpusEntry));
+
+            if (entries == NULL)
+            {
+                return false;
+            }
+
+            corpus->rebuilt = entries;
+        }
+
+        entry.offset = start;
+        corpus->rebuilt[corpus->count++] = entry;
+        position = start + record.length;
+    }
+
+    corpus->entries = corpus->rebuilt;
+    corpus->recordsEnd = position;
+
+    return true;
+}
+
+bool corpusOpen(Corpus *corpus, const char *path)
+{
+    memset(corpus, 0, sizeof(*corpus));
+    corpus->fd = open(path, O_RDONLY);
+
+    struct stat info;
+
+    if (corpus->fd < 0 || fstat(corpus->fd, &info) != 0)
+    {
+        perror(path);
+        corpusClose(corpus);
+        return false;
+    }
+
+    corpus->size = info.st_size;
+
+    if (corpus->size < sizeof(CorpusHeader))
+    {
+        fprintf(stderr, "%s: not a replay corpus\n", path);
+        corpusClose(corpus);
+        return false;
+    }
+
+    void *data = mmap(NULL, corpus->size, PROT_READ, MAP_SHARED, corpus->fd, 0);
+
+    if (data == MAP_FAILED)
+    {
+        perror(path);
+        corpusClose(corpus);
+        return false;
+    }
+
+    corpus->data = data;
+
+    const CorpusHeader *header = (const CorpusHeader *)corpus->data;
+
+    if (memcmp(header->magic, CORPUS_MAGIC, 4) != 0 || header->version != CORPUS_VERSION)
+    {
+        fprintf(stderr, "%s: not a version %d replay corpus\n", path, CORPUS_VERSION);
+        corpusClose(corpus);
+        return false;
+    }
+
+    CorpusTrailer trailer = {0};
+
+    if (corpus->size >= sizeof(CorpusHeader) + sizeof(CorpusTrailer))
+    {
+        memcpy(&trailer, corpus->data + corpus->size - sizeof(CorpusTrailer), sizeof(trailer));
+    }
+
+    if (corpusIndexIsValid(corpus, &trailer))
+    {
+        corpus->entries = (const CorpusEntry *)(corpus->data + trailer.indexOffset);
+        corpus->count = trailer.count;
+        corpus->recordsEnd = corpus->count ? corpus->entries[corpus->count - 1].offset + corpus->entries[corpus->count - 1].length : sizeof(CorpusHeader);
+
+        return true;
+    }
+
+    fprintf(stderr, "%s: the index is missing or damaged, rebuilding it\n", path);
+
+    if (!corpusRebuildIndex(corpus))
+    {
+        corpusClose(corpus);
+        return false;
+    }
+
+    return true;
+}
+
+void corpusClose(Corpus *corpus)
+{
+    if (corpus->data != NULL)
+    {
+        munmap((void *)corpus->data, corpus->size);
+    }
+
+    if (corpus->fd >= 0)
+    {
+        close(corpus->fd);
+    }
+
+    free(corpus->rebuilt);
+    memset(corpus, 0, sizeof(*corpus));
+    corpus->fd = -1;
+}
+
+const uint8_t *corpusReplay(const Corpus *corpus, size_t index, size_t *size)
+{
+    if (index >= corpus->count)
+    {
+        return NULL;
+    }
+
+    *size = corpus->entries[index].length;
+
+    return corpus->data + corpus->entries[index].offset;
+}
+
+static bool corpusWriteAll(int fd, const void *data, size_t size, size_t offset)
+{
+    const uint8_t *bytes = data;
+
+    while (size > 0)
+    {
+        ssize_t written = pwrite(fd, bytes, size, offset);
+
+        if (written <= 0)
+        {
+            return false;
+        }
+
+        bytes += written;
+        size -= written;
+        offset += written;
+    }
+
+    return true;
+}
+
+bool corpusAppend(const char *path, const uint8_t *const *replays, const size_t *sizes, size_t count)
+{
+    Corpus corpus = {.fd = -1};
+    bool exists = access(path, F_OK) == 0;
+
+    if (exists && !corpusOpen(&corpus, path))
+    {
+        return false;
+    }
+
+    size_t existing = corpus.count;
+    size_t position = exists ? corpus.recordsEnd : sizeof(CorpusHeader);
+    CorpusEntry *entries = malloc((existing + count) * sizeof(CorpusEntry) + 1);
+
+    if (entries != NULL && existing > 0)
+    {
+        memcpy(entries, corpus.entries, existing * sizeof(CorpusEntry));
+    }
+
+    if (exists)
+    {
+        corpusClose(&corpus);
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+
+    if (entries == NULL || fd < 0)
+    {
+        perror(path);
+        free(entries);
+
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+
+        return false;
+    }
+
+    bool ok = true;
+
+    if (!exists)
+    {
+        CorpusHeader header = {.version = CORPUS_VERSION};
+        memcpy(header.magic, CORPUS_MAGIC, 4);
+        ok &= corpusWriteAll(fd, &header, sizeof(header), 0);
+    }
+
+    // Drops the old index, and whatever a crash left after the last whole record.
+    ok &= ftruncate(fd, position) == 0;
+
+    size_t added = existing;
+
+    for (size_t i = 0; i < count && ok; i++)
+    {
+        CorpusEntry entry;
+
+        if (!corpusDescribe(replays[i], sizes[i], &entry))
+        {
+            fprintf(stderr, "%s: skipping replay %zu, it is not a replay or newer than version %d\n", path, i, REPLAY_FORMAT_VERSION);
+            continue;
+        }
+
+        CorpusRecord record = {.length = sizes[i], .checksum = corpusChecksum(replays[i], sizes[i])};
+        memcpy(record.magic, CORPUS_RECORD_MAGIC, 4);
+
+        ok &= corpusWriteAll(fd, &record, sizeof(record), position);
+        ok &= corpusWriteAll(fd, replays[i], sizes[i], position + sizeof(record));
+
+        entry.offset = position + sizeof(record);
+        entries[added++] = entry;
+        position = entry.offset + sizes[i];
+    }
+
+    // The records have to be on disk before an index that points at them.
+    ok &= fsync(fd) == 0;
+
+    size_t indexOffset = (position + CORPUS_INDEX_ALIGNMENT - 1) / CORPUS_INDEX_ALIGNMENT * CORPUS_INDEX_ALIGNMENT;
+    const uint8_t padding[CORPUS_INDEX_ALIGNMENT] = {0};
+
+    CorpusTrailer trailer = {
+        .indexOffset = indexOffset,
+        .count = added,
+        .indexChecksum = corpusChecksum((const uint8_t *)entries, added * sizeof(CorpusEntry)),
+    };
+    memcpy(trailer.magic, CORPUS_TRAILER_MAGIC, 4);
+
+    ok &= corpusWriteAll(fd, padding, indexOffset - position, position);
+    ok &= corpusWriteAll(fd, entries, added * sizeof(CorpusEntry), indexOffset);
+    ok &= corpusWriteAll(fd, &trailer, sizeof(trailer), indexOffset + added * sizeof(CorpusEntry));
+    ok &= fsync(fd) == 0;
+
+    if (!ok)
+    {
+        perror(path);
+    }
+
+    close(fd);
+    free(entries);
+
+    return ok;
+}
+
+#endif // CORPUS_IMPLEMENTATION
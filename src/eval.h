@@ -0,0 +1,346 @@
+#ifndef EVAL_H
+#define EVAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Board features used by the bot, computed for many candidate boards at once.
+//
+// Boards are bitboards: one uint16_t per row, bit x set when column x is filled, row 0 at the top.
+// A batch stores them as a structure of arrays (rows[y][board]) so that the same row of 16
+// consecutive boards sits in one AVX2 register.
+
+#define EVAL_BOARD_WIDTH 10
+#define EVAL_BOARD_HEIGHT 20
+#define EVAL_FULL_ROW ((uint16_t)((1u << EVAL_BOARD_WIDTH) - 1))
+
+#define EVAL_LANES 16
+#define EVAL_BATCH_SIZE 256
+
+typedef struct EvalBoards
+{
+    uint16_t rows[EVAL_BOARD_HEIGHT][EVAL_BATCH_SIZE];
+    size_t count;
+} EvalBoards;
+
+typedef struct EvalFeatures
+{
+    uint16_t heights[EVAL_BOARD_WIDTH][EVAL_BATCH_SIZE];
+    uint16_t holes[EVAL_BATCH_SIZE];
+    uint16_t rowTransitions[EVAL_BATCH_SIZE];
+    uint16_t columnTransitions[EVAL_BATCH_SIZE];
+    uint16_t wells[EVAL_BATCH_SIZE];
+    uint16_t bumpiness[EVAL_BATCH_SIZE];
+} EvalFeatures;
+
+typedef struct EvalBoardFeatures
+{
+    uint16_t heights[EVAL_BOARD_WIDTH];
+    uint16_t holes;
+    uint16_t rowTransitions;
+    uint16_t columnTransitions;
+    uint16_t wells;
+    uint16_t bumpiness;
+} EvalBoardFeatures;
+
+// Cell by cell definition of every feature, the other paths must match it exactly.
+void evalBoardReference(const uint16_t rows[EVAL_BOARD_HEIGHT], EvalBoardFeatures *features);
+
+void evalBatchScalar(const EvalBoards *boards, EvalFeatures *features);
+bool evalHasAvx2(void);
+void evalBatchAvx2(const EvalBoards *boards, EvalFeatures *features);
+
+// Picks the AVX2 path when the CPU has it, the scalar one otherwise.
+void evalBatch(const EvalBoards *boards, EvalFeatures *features);
+
+EvalBoardFeatures evalFeaturesAt(const EvalFeatures *features, size_t board);
+
+#endif // EVAL_H
+
+#if defined(EVAL_IMPLEMENTATION) && !defined(EVAL_IMPLEMENTED)
+#define EVAL_IMPLEMENTED
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define EVAL_HAS_AVX2_PATH 1
+#include <immintrin.h>
+#endif
+
+static bool evalCellFilled(const uint16_t rows[EVAL_BOARD_HEIGHT], int x, int y)
+{
+    if (x < 0 || x >= EVAL_BOARD_WIDTH || y >= EVAL_BOARD_HEIGHT)
+    {
+        return true;
+    }
+
+    if (y < 0)
+    {
+        return false;
+    }
+
+    return (rows[y] >> x) & 1;
+}
+
+void evalBoardReference(const uint16_t rows[EVAL_BOARD_HEIGHT], EvalBoardFeatures *features)
+{
+    *features = (EvalBoardFeatures){0};
+
+    for (int x = 0; x < EVAL_BOARD_WIDTH; x++)
+    {
+        bool covered = false;
+        uint16_t depth = 0;
+
+        for (int y = 0; y < EVAL_BOARD_HEIGHT; y++)
+        {
+            bool filled = evalCellFilled(rows, x, y);
+
+            if (filled && !covered)
+            {
+                features->heights[x] = EVAL_BOARD_HEIGHT - y;
+            }
+
+            if (!filled && covered)
+            {
+                features->holes++;
+            }
+
+            covered = covered || filled;
+
+            bool isWell = !covered && evalCellFilled(rows, x - 1, y) && evalCellFilled(rows, x + 1, y);
+            depth = isWell ? depth + 1 : 0;
+            features->wells += depth;
+        }
+
+        for (int y = -1; y < EVAL_BOARD_HEIGHT; y++)
+        {
+            if (evalCellFilled(rows, x, y) != evalCellFilled(rows, x, y + 1))
+            {
+                features->columnTransitions++;
+            }
+        }
+    }
+
+    for (int y = 0; y < EVAL_BOARD_HEIGHT; y++)
+    {
+        for (int x = -1; x < EVAL_BOARD_WIDTH; x++)
+        {
+            if (evalCellFilled(rows, x, y) != evalCellFilled(rows, x + 1, y))
+            {
+                features->rowTransitions++;
+            }
+        }
+    }
+
+    for (int x = 0; x < EVAL_BOARD_WIDTH - 1; x++)
+    {
+        int difference = features->heights[x] - features->heights[x + 1];
+        features->bumpiness += difference < 0 ? -difference : difference;
+    }
+}
+
+// Row with a filled wall on each side: bit 0 is the left wall, bit x + 1 is column x.
+static inline uint32_t evalRowWithWalls(uint16_t row)
+{
+    return ((uint32_t)row << 1) | 1u | (1u << (EVAL_BOARD_WIDTH + 1));
+}
+
+void evalBatchScalar(const EvalBoards *boards, EvalFeatures *features)
+{
+    for (size_t i = 0; i < boards->count; i++)
+    {
+        uint16_t seen = 0;
+        uint16_t previous = 0;
+        uint16_t heights[EVAL_BOARD_WIDTH] = {0};
+        uint16_t depths[EVAL_BOARD_WIDTH] = {0};
+        uint16_t holes = 0;
+        uint16_t rowTransitions = 0;
+        uint16_t columnTransitions = 0;
+        uint16_t wells = 0;
+
+        for (size_t y = 0; y < EVAL_BOARD_HEIGHT; y++)
+        {
+            const uint16_t row = boards->rows[y][i];
+            const uint32_t walled = evalRowWithWalls(row);
+
+            holes += __builtin_popcount(~row & seen & EVAL_FULL_ROW);
+            seen |= row;
+
+            rowTransitions += __builtin_popcount((walled ^ (walled >> 1)) & ((1u << (EVAL_BOARD_WIDTH + 1)) - 1));
+            columnTransitions += __builtin_popcount(previous ^ row);
+            previous = row;
+
+            const uint16_t wellCells = ~seen & walled & (walled >> 2) & EVAL_FULL_ROW;
+
+            for (size_t x = 0; x < EVAL_BOARD_WIDTH; x++)
+            {
+                heights[x] += (seen >> x) & 1;
+                depths[x] = ((wellCells >> x) & 1) ? depths[x] + 1 : 0;
+                wells += depths[x];
+            }
+        }
+
+        columnTransitions += __builtin_popcount(~previous & EVAL_FULL_ROW);
+
+        uint16_t bumpiness = 0;
+        for (size_t x = 0; x < EVAL_BOARD_WIDTH; x++)
+        {
+            features->heights[x][i] = heights[x];
+            if (x + 1 < EVAL_BOARD_WIDTH)
+            {
+                bumpiness += heights[x] > heights[x + 1] ? heights[x] - heights[x + 1] : heights[x + 1] - heights[x];
+            }
+        }
+
+        features->holes[i] = holes;
+        features->rowTransitions[i] = rowTransitions;
+        features->columnTransitions[i] = columnTransitions;
+        features->wells[i] = wells;
+        features->bumpiness[i] = bumpiness;
+    }
+}
+
+#ifdef EVAL_HAS_AVX2_PATH
+
+bool evalHasAvx2(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+__attribute__((target("avx2"))) static inline __m256i evalPopcount16(__m256i v)
+{
+    const __m256i nibbleCounts = _mm256_setr_epi8(
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i lowNibble = _mm256_set1_epi8(0x0F);
+
+    __m256i low = _mm256_shuffle_epi8(nibbleCounts, _mm256_and_si256(v, lowNibble));
+    __m256i high = _mm256_shuffle_epi8(nibbleCounts, _mm256_and_si256(_mm256_srli_epi16(v, 4), lowNibble));
+    __m256i bytes = _mm256_add_epi8(low, high);
+
+    return _mm256_add_epi16(_mm256_and_si256(bytes, _mm256_set1_epi16(0x00FF)), _mm256_srli_epi16(bytes, 8));
+}
+
+__attribute__((target("avx2"))) void evalBatchAvx2(const EvalBoards *boards, EvalFeatures *features)
+{
+    const __m256i full = _mm256_set1_epi16(EVAL_FULL_ROW);
+    const __m256i walls = _mm256_set1_epi16((1 << 0) | (1 << (EVAL_BOARD_WIDTH + 1)));
+    const __m256i transitionMask = _mm256_set1_epi16((1 << (EVAL_BOARD_WIDTH + 1)) - 1);
+    const __m256i one = _mm256_set1_epi16(1);
+
+    __m256i columnBits[EVAL_BOARD_WIDTH];
+    for (size_t x = 0; x < EVAL_BOARD_WIDTH; x++)
+    {
+        columnBits[x] = _mm256_set1_epi16(1 << x);
+    }
+
+    for (size_t i = 0; i < boards->count; i += EVAL_LANES)
+    {
+        __m256i seen = _mm256_setzero_si256();
+        __m256i previous = _mm256_setzero_si256();
+        __m256i heights[EVAL_BOARD_WIDTH];
+        __m256i depths[EVAL_BOARD_WIDTH];
+        __m256i holes = _mm256_setzero_si256();
+        __m256i rowTransitions = _mm256_setzero_si256();
+        __m256i columnTransitions = _mm256_setzero_si256();
+        __m256i wells = _mm256_setzero_si256();
+
+        for (size_t x = 0; x < EVAL_BOARD_WIDTH; x++)
+        {
+            heights[x] = _mm256_setzero_si256();
+            depths[x] = _mm256_setzero_si256();
+        }
+
+        for (size_t y = 0; y < EVAL_BOARD_HEIGHT; y++)
+        {
+            const __m256i row = _mm256_loadu_si256((const __m256i *)&boards->rows[y][i]);
+            const __m256i walled = _mm256_or_si256(_mm256_slli_epi16(row, 1), walls);
+
+            holes = _mm256_add_epi16(holes, evalPopcount16(_mm256_andnot_si256(row, _mm256_and_si256(seen, full))));
+            seen = _mm256_or_si256(seen, row);
+
+            const __m256i rowChanges = _mm256_and_si256(_mm256_xor_si256(walled, _mm256_srli_epi16(walled, 1)), transitionMask);
+            rowTransitions = _mm256_add_epi16(rowTransitions, evalPopcount16(rowChanges));
+            columnTransitions = _mm256_add_epi16(columnTransitions, evalPopcount16(_mm256_xor_si256(previous, row)));
+            previous = row;
+
+            const __m256i wellCells = _mm256_andnot_si256(
+                seen,
+                _mm256_and_si256(_mm256_and_si256(walled, _mm256_srli_epi16(walled, 2)), full));
+
+            for (size_t x = 0; x < EVAL_BOARD_WIDTH; x++)
+            {
+                // cmpeq yields -1 in every lane that has the bit, subtracting it counts the lane.
+                heights[x] = _mm256_sub_epi16(heights[x], _mm256_cmpeq_epi16(_mm256_and_si256(seen, columnBits[x]), columnBits[x]));
+
+                const __m256i isWell = _mm256_cmpeq_epi16(_mm256_and_si256(wellCells, columnBits[x]), columnBits[x]);
+                depths[x] = _mm256_and_si256(_mm256_add_epi16(depths[x], one), isWell);
+                wells = _mm256_add_epi16(wells, depths[x]);
+            }
+        }
+
+        columnTransitions = _mm256_add_epi16(columnTransitions, evalPopcount16(_mm256_andnot_si256(previous, full)));
+
+        __m256i bumpiness = _mm256_setzero_si256();
+        for (size_t x = 0; x < EVAL_BOARD_WIDTH; x++)
+        {
+            _mm256_storeu_si256((__m256i *)&features->heights[x][i], heights[x]);
+            if (x + 1 < EVAL_BOARD_WIDTH)
+            {
+                bumpiness = _mm256_add_epi16(bumpiness, _mm256_abs_epi16(_mm256_sub_epi16(heights[x], heights[x + 1])));
+            }
+        }
+
+        _mm256_storeu_si256((__m256i *)&features->holes[i], holes);
+        _mm256_storeu_si256((__m256i *)&features->rowTransitions[i], rowTransitions);
+        _mm256_storeu_si256((__m256i *)&features->columnTransitions[i], columnTransitions);
+        _mm256_storeu_si256((__m256i *)&features->wells[i], wells);
+        _mm256_storeu_si256((__m256i *)&features->bumpiness[i], bumpiness);
+    }
+}
+
+#else
+
+bool evalHasAvx2(void)
+{
+    return false;
+}
+
+void evalBatchAvx2(const EvalBoards *boards, EvalFeatures *features)
+{
+    evalBatchScalar(boards, features);
+}
+
+#endif // EVAL_HAS_AVX2_PATH
+
+void evalBatch(const EvalBoards *boards, EvalFeatures *features)
+{
+    if (evalHasAvx2())
+    {
+        evalBatchAvx2(boards, features);
+    }
+    else
+    {
+        evalBatchScalar(boards, features);
+    }
+}
+
+EvalBoardFeatures evalFeaturesAt(const EvalFeatures *features, size_t board)
+{
+    EvalBoardFeatures result = {
+        .holes = features->holes[board],
+        .rowTransitions = features->rowTransitions[board],
+        .columnTransitions = features->columnTransitions[board],
+        .wells = features->wells[board],
+        .bumpiness = features->bumpiness[board],
+    };
+
+    for (size_t x = 0; x < EVAL_BOARD_WIDTH; x++)
+    {
+        result.heights[x] = features->heights[x][board];
+    }
+
+    return result;
+}
+
+#endif // EVAL_IMPLEMENTATION
@@ -0,0 +1,434 @@
+#ifndef FLIGHT_H
+#define FLIGHT_H
+
+#include "perf.h"
+#include "tetris.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Always-on flight recorder for hitches: frames that take far longer than they should.
+//
+// The game hands it every frame's timings (see perf.h) and every tick's input, and it keeps the
+// last few seconds of both in rings, along with the engine events of each tick and a snapshot of
+// the game every second. When a frame takes longer than the threshold, the rings are copied to a
+// dump buffer and a writer thread saves them, so the game never waits for the disk. Nothing is
+// allocated after flightRecorderOpen.
+//
+// A dump holds the frames, the snapshot taken before the oldest tick kept and the inputs of every
+// tick since, so src/hitch.c can play the segment offline and check it ends in the same state.
+//
+// Layout, in the byte order of the machine that wrote it, like the snapshot inside:
+//   header    "THIT", u16 format version, u16 GAME_RULES_VERSION, u8 width, u8 height,
+//             u16 0, f32 threshold in seconds, u32 frame count, u32 tick count
+//   frames    frame count FlightFrame, oldest first, the hitch last
+//   snapshot  GAME_SNAPSHOT_SIZE bytes, the game before the first tick
+//   ticks     tick count FlightTick, oldest first
+//   trailer   u64 gameChecksum after the last tick
+
+#define FLIGHT_MAGIC "THIT"
+#define FLIGHT_FORMAT_VERSION 1
+#define FLIGHT_HEADER_SIZE 24
+
+#define FLIGHT_SECONDS 5
+// Enough frames for FLIGHT_SECONDS at 200 frames per second.
+#define FLIGHT_FRAMES 1024
+#define FLIGHT_SNAPSHOT_INTERVAL GAME_TICKS_PER_SECOND
+#define FLIGHT_SNAPSHOTS (FLIGHT_SECONDS + 2)
+// FLIGHT_SECONDS of ticks after the oldest snapshot kept, a power of two.
+#define FLIGHT_TICKS 512
+// How often the writer thread looks for a dump to write.
+#define FLIGHT_WRITER_INTERVAL 0.1
+
+// Engine events, what changed in the tick.
+typedef enum FlightEvent
+{
+    FLIGHT_EVENT_LOCK = 1 << 0,
+    FLIGHT_EVENT_LINES = 1 << 1,
+    FLIGHT_EVENT_HOLD = 1 << 2,
+    FLIGHT_EVENT_LEVEL = 1 << 3,
+    FLIGHT_EVENT_DEATH = 1 << 4,
+    FLIGHT_EVENT_RESTART = 1 << 5,
+    FLIGHT_EVENT_PAUSE = 1 << 6,
+} FlightEvent;
+
+typedef struct FlightTick
+{
+    uint32_t tick;
+    GameInput input;
+    uint8_t events;
+    uint8_t lines; // cleared in this tick
+    uint8_t reserved;
+} FlightTick;
+
+typedef struct FlightFrame
+{
+    double end;
+    float seconds[PERF_TIMING_COUNT];
+    uint32_t drawCalls;
+    uint32_t vertices;
+    uint32_t collisionChecks;
+    uint32_t gravitySteps;
+    uint32_t tick; // the game's tick when the frame ended
+} FlightFrame;
+
+typedef struct FlightDump
+{
+    uint32_t frameCount;
+    uint32_t tickCount;
+    FlightFrame frames[FLIGHT_FRAMES];
+    uint8_t snapshot[GAME_SNAPSHOT_SIZE];
+    FlightTick ticks[FLIGHT_TICKS];
+    uint64_t checksum;
+    uint32_t hitchTick;
+} FlightDump;
+
+typedef struct FlightRecorder
+{
+    char directory[256];
+    double threshold;
+    double cooldownUntil;
+
+    FlightFrame frames[FLIGHT_FRAMES];
+    uint64_t frameCount;
+    FlightTick ticks[FLIGHT_TICKS];
+    uint64_t tickCount;
+    uint8_t snapshots[FLIGHT_SNAPSHOTS][GAME_SNAPSHOT_SIZE];
+    uint64_t snapshotTicks[FLIGHT_SNAPSHOTS]; // tickCount when each snapshot was taken
+    uint64_t snapshotCount;
+    Game last;
+
+    // Filled by the game thread while pending is false, written out by the writer thread.
+    FlightDump dump;
+    atomic_bool pending;
+    atomic_bool running;
+    pthread_t thread;
+    uint32_t dumps;
+    uint32_t skipped; // hitches while the previous dump was still being written
+} FlightRecorder;
+
+// Dumps go to directory. threshold is in seconds, 0 disables the recorder.
+bool flightRecorderOpen(FlightRecorder *recorder, const char *directory, double threshold);
+// Waits for a dump being written, then stops the writer thread.
+void flightRecorderClose(FlightRecorder *recorder);
+// Forgets what was recorded, for a game that does not follow on from it, and snapshots game.
+void flightRecorderReset(FlightRecorder *recorder, const Game *game);
+// Records the input of the gameStep that just ran on game.
+void flightRecorderTick(FlightRecorder *recorder, GameInput input, const Game *game);
+// Records a frame and dumps the recording when it took longer than the threshold. Returns true
+// when it did.
+bool flightRecorderFrame(FlightRecorder *recorder, const PerfFrame *frame, const Game *game);
+
+// Reads a dump written by the recorder. Fails on a bad header or a truncated file.
+bool flightDumpRead(FlightDump *dump, double *threshold, const uint8_t *data, size_t size);
+
+#endif // FLIGHT_H
+
+#if defined(FLIGHT_IMPLEMENTATION) && !defined(FLIGHT_IMPLEMENTED)
+#define FLIGHT_IMPLEMENTED
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+_Static_assert((FLIGHT_TICKS & (FLIGHT_TICKS - 1)) == 0, "the tick ring size must be a power of two");
+_Static_assert(FLIGHT_TICKS >= FLIGHT_SNAPSHOT_INTERVAL * (FLIGHT_SECONDS + 1), "the ticks must reach back to a snapshot");
+_Static_assert(sizeof(FlightTick) == 8, "FlightTick has padding");
+_Static_assert(sizeof(FlightFrame) == sizeof(double) + sizeof(float) * PERF_TIMING_COUNT + sizeof(uint32_t) * 5, "FlightFrame has padding");
+
+static void *flightWriterThread(void *argument)
+{
+    FlightRecorder *recorder = argument;
+    const struct timespec interval = {
+        .tv_sec = 0,
+        .tv_nsec = (long)(FLIGHT_WRITER_INTERVAL * 1e9),
+    };
+
+    while (true)
+    {
+        bool running = atomic_load(&recorder->running);
+
+        if (atomic_load_explicit(&recorder->pending, memory_order_acquire))
+        {
+            const FlightDump *dump = &recorder->dump;
+            char path[512];
+            snprintf(path, sizeof(path), "%s/hitch-%lld-%u.thd", recorder->directory, (long long)time(NULL), dump->hitchTick);
+
+            FILE *file = fopen(path, "wb");
+
+            if (file != NULL)
+            {
+                uint8_t header[FLIGHT_HEADER_SIZE] = {0};
+                uint16_t versions[2] = {FLIGHT_FORMAT_VERSION, GAME_RULES_VERSION};
+                float threshold = recorder->threshold;
+
+                memcpy(header, FLIGHT_MAGIC, 4);
+                memcpy(header + 4, versions, sizeof(versions));
+                header[8] = GRID_WIDTH;
+                header[9] = GRID_HEIGHT;
+                memcpy(header + 12, &threshold, sizeof(threshold));
+                memcpy(header + 16, &dump->frameCount, sizeof(uint32_t));
+                memcpy(header + 20, &dump->tickCount, sizeof(uint32_t));
+
+                fwrite(header, 1, sizeof(header), file);
+                fwrite(dump->frames, sizeof(FlightFrame), dump->frameCount, file);
+                fwrite(dump->snapshot, 1, GAME_SNAPSHOT_SIZE, file);
+                fwrite(dump->ticks, sizeof(FlightTick), dump->tickCount, file);
+                fwrite(&dump->checksum, sizeof(dump->checksum), 1, file);
+
+                if (ferror(file) | (fclose(file) != 0))
+                {
+                    perror(path);
+                }
+                else
+                {
+                    fprintf(stderr, "hitch at tick %u written to %s\n", dump->hitchTick, path);
+                }
+            }
+            else
+            {
+                perror(path);
+            }
+
+            atomic_store_explicit(&recorder->pending, false, memory_order_release);
+        }
+
+        if (!running)
+        {
+            return NULL;
+        }
+
+        nanosleep(&interval, NULL);
+    }
+}
+
+bool flightRecorderOpen(FlightRecorder *recorder, const char *directory, double threshold)
+{
+    memset(recorder, 0, sizeof(*recorder));
+
+    if (threshold <= 0)
+    {
+        return true;
+    }
+
+    snprintf(recorder->directory, sizeof(recorder->directory), "%s", directory);
+    recorder->threshold = threshold;
+    atomic_store(&recorder->running, true);
+
+    if (pthread_create(&recorder->thread, NULL, flightWriterThread, recorder) != 0)
+    {
+        atomic_store(&recorder->running, false);
+        recorder->threshold = 0;
+        return false;
+    }
+
+    return true;
+}
+
+void flightRecorderClose(FlightRecorder *recorder)
+{
+    if (atomic_load(&recorder->running))
+    {
+        atomic_store(&recorder->running, false);
+        pthread_join(recorder->thread, NULL);
+    }
+
+    recorder->threshold = 0;
+}
+
+static void flightRecorderSnapshot(FlightRecorder *recorder, const Game *game)
+{
+    size_t slot = recorder->snapshotCount++ % FLIGHT_SNAPSHOTS;
+
+    gameSave(game, recorder->snapshots[slot]);
+    recorder->snapshotTicks[slot] = recorder->tickCount;
+}
+
+void flightRecorderReset(FlightRecorder *recorder, const Game *game)
+{
+    recorder->tickCount = 0;
+    recorder->snapshotCount = 0;
+    recorder->last = *game;
+
+    if (recorder->threshold > 0)
+    {
+        flightRecorderSnapshot(recorder, game);
+    }
+}
+
+void flightRecorderTick(FlightRecorder *recorder, GameInput input, const Game *game)
+{
+    if (recorder->threshold <= 0)
+    {
+        return;
+    }
+
+    const Game *last = &recorder->last;
+    uint8_t events = 0;
+    uint32_t lines = game->lines - last->lines;
+
+    events |= game->piecesLocked != last->piecesLocked ? FLIGHT_EVENT_LOCK : 0;
+    events |= game->games == last->games && lines > 0 ? FLIGHT_EVENT_LINES : 0;
+    events |= game->savedThisPiece && !last->savedThisPiece ? FLIGHT_EVENT_HOLD : 0;
+    events |= game->level != last->level ? FLIGHT_EVENT_LEVEL : 0;
+    events |= game->dead && !last->dead ? FLIGHT_EVENT_DEATH : 0;
+    events |= game->games != last->games ? FLIGHT_EVENT_RESTART : 0;
+    events |= game->paused != last->paused ? FLIGHT_EVENT_PAUSE : 0;
+
+    recorder->ticks[recorder->tickCount++ % FLIGHT_TICKS] = (FlightTick){
+        .tick = game->tick,
+        .input = input,
+        .events = events,
+        .lines = events & FLIGHT_EVENT_LINES ? lines : 0,
+    };
+
+    // Only the fields compared above are needed, the grid is left alone.
+    recorder->last.piecesLocked = game->piecesLocked;
+    recorder->last.lines = game->lines;
+    recorder->last.games = game->games;
+    recorder->last.savedThisPiece = game->savedThisPiece;
+    recorder->last.level = game->level;
+    recorder->last.dead = game->dead;
+    recorder->last.paused = game->paused;
+
+    if (recorder->tickCount % FLIGHT_SNAPSHOT_INTERVAL == 0)
+    {
+        flightRecorderSnapshot(recorder, game);
+    }
+}
+
+// The oldest snapshot whose ticks are all still in the ring, -1 when there is none.
+static int flightRecorderOldestSnapshot(const FlightRecorder *recorder)
+{
+    int oldest = -1;
+    uint64_t first = recorder->snapshotCount > FLIGHT_SNAPSHOTS ? recorder->snapshotCount - FLIGHT_SNAPSHOTS : 0;
+
+    for (uint64_t i = recorder->snapshotCount; i-- > first;)
+    {
+        size_t slot = i % FLIGHT_SNAPSHOTS;
+
+        if (recorder->tickCount - recorder->snapshotTicks[slot] > FLIGHT_TICKS)
+        {
+            break;
+        }
+
+        oldest = slot;
+    }
+
+    return oldest;
+}
+
+bool flightRecorderFrame(FlightRecorder *recorder, const PerfFrame *frame, const Game *game)
+{
+    if (recorder->threshold <= 0)
+    {
+        return false;
+    }
+
+    FlightFrame *recorded = &recorder->frames[recorder->frameCount++ % FLIGHT_FRAMES];
+    *recorded = (FlightFrame){
+        .end = frame->end,
+        .drawCalls = frame->drawCalls,
+        .vertices = frame->vertices,
+        .collisionChecks = frame->collisionChecks,
+        .gravitySteps = frame->gravitySteps,
+        .tick = game->tick,
+    };
+    memcpy(recorded->seconds, frame->seconds, sizeof(recorded->seconds));
+
+    // One dump covers the seconds before it, the next hitch has to be past them to add anything.
+    if (frame->seconds[PERF_TIMING_FRAME] <= recorder->threshold || frame->end < recorder->cooldownUntil)
+    {
+        return false;
+    }
+
+    int snapshot = flightRecorderOldestSnapshot(recorder);
+
+    if (snapshot < 0 || atomic_load_explicit(&recorder->pending, memory_order_acquire))
+    {
+        recorder->skipped++;
+        return false;
+    }
+
+    FlightDump *dump = &recorder->dump;
+    uint64_t firstTick = recorder->snapshotTicks[snapshot];
+    uint64_t firstFrame = recorder->frameCount > FLIGHT_FRAMES ? recorder->frameCount - FLIGHT_FRAMES : 0;
+
+    dump->frameCount = 0;
+
+    for (uint64_t i = firstFrame; i < recorder->frameCount; i++)
+    {
+        const FlightFrame *kept = &recorder->frames[i % FLIGHT_FRAMES];
+
+        if (kept->end >= frame->end - FLIGHT_SECONDS)
+        {
+            dump->frames[dump->frameCount++] = *kept;
+        }
+    }
+
+    memcpy(dump->snapshot, recorder->snapshots[snapshot], GAME_SNAPSHOT_SIZE);
+    dump->tickCount = recorder->tickCount - firstTick;
+
+    for (uint64_t i = firstTick; i < recorder->tickCount; i++)
+    {
+        dump->ticks[i - firstTick] = recorder->ticks[i % FLIGHT_TICKS];
+    }
+
+    dump->checksum = gameChecksum(game);
+    dump->hitchTick = game->tick;
+
+    atomic_store_explicit(&recorder->pending, true, memory_order_release);
+    recorder->cooldownUntil = frame->end + FLIGHT_SECONDS;
+    recorder->dumps++;
+
+    return true;
+}
+
+bool flightDumpRead(FlightDump *dump, double *threshold, const uint8_t *data, size_t size)
+{
+    uint16_t versions[2];
+    float headerThreshold;
+
+    if (size < FLIGHT_HEADER_SIZE || memcmp(data, FLIGHT_MAGIC, 4) != 0)
+    {
+        return false;
+    }
+
+    memcpy(versions, data + 4, sizeof(versions));
+    memcpy(&headerThreshold, data + 12, sizeof(headerThreshold));
+    memcpy(&dump->frameCount, data + 16, sizeof(uint32_t));
+    memcpy(&dump->tickCount, data + 20, sizeof(uint32_t));
+
+    if (versions[0] != FLIGHT_FORMAT_VERSION || versions[1] != GAME_RULES_VERSION || data[8] != GRID_WIDTH || data[9] != GRID_HEIGHT ||
+        dump->frameCount > FLIGHT_FRAMES || dump->tickCount > FLIGHT_TICKS)
+    {
+        return false;
+    }
+
+    size_t framesSize = dump->frameCount * sizeof(FlightFrame);
+    size_t ticksSize = dump->tickCount * sizeof(FlightTick);
+
+    if (size != FLIGHT_HEADER_SIZE + framesSize + GAME_SNAPSHOT_SIZE + ticksSize + sizeof(uint64_t))
+    {
+        return false;
+    }
+
+    const uint8_t *position = data + FLIGHT_HEADER_SIZE;
+
+    memcpy(dump->frames, position, framesSize);
+    position += framesSize;
+    memcpy(dump->snapshot, position, GAME_SNAPSHOT_SIZE);
+    position += GAME_SNAPSHOT_SIZE;
+    memcpy(dump->ticks, position, ticksSize);
+    position += ticksSize;
+    memcpy(&dump->checksum, position, sizeof(uint64_t));
+
+    dump->hitchTick = dump->tickCount > 0 ? dump->ticks[dump->tickCount - 1].tick : 0;
+    *threshold = headerThreshold;
+
+    return true;
+}
+
+#endif // FLIGHT_IMPLEMENTATION
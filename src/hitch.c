@@ -0,0 +1,178 @@
+#define TETRIS_IMPLEMENTATION
+#include "tetris.h"
+
+#define PERF_IMPLEMENTATION
+#include "perf.h"
+
+#define FLIGHT_IMPLEMENTATION
+#include "flight.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Reads a hitch dump written by the game's flight recorder: prints the frames around the hitch and
+// the ticks that led up to it, then plays the ticks again from the snapshot, timing every
+// gameStep, and checks the game ends up in the state it was in when the hitch happened.
+
+#define HITCH_SLOWEST_FRAMES 10
+#define HITCH_LAST_TICKS 30
+
+static double hitchNow(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void hitchPrintFrame(const FlightFrame *frame, double hitchEnd)
+{
+    printf("%8.3f s  tick %6u  frame %7.2f ms  sim %6.2f  layout %5.2f  draw %6.2f  present %6.2f  draw calls %4u  vertices %6u  collisions %4u  gravity %3u\n",
+           frame->end - hitchEnd, frame->tick, frame->seconds[PERF_TIMING_FRAME] * 1000.0, frame->seconds[PERF_TIMING_SIM] * 1000.0,
+           frame->seconds[PERF_TIMING_LAYOUT] * 1000.0, frame->seconds[PERF_TIMING_DRAW] * 1000.0, frame->seconds[PERF_TIMING_PRESENT] * 1000.0,
+           frame->drawCalls, frame->vertices, frame->collisionChecks, frame->gravitySteps);
+}
+
+static void hitchPrintTick(const FlightTick *tick)
+{
+    static const char *inputs[] = {"rotate", "left", "right", "soft", "hard", "hold", "pause", "restart"};
+    static const char *events[] = {"lock", "lines", "hold", "level", "death", "restart", "pause"};
+
+    printf("  tick %6u  input", tick->tick);
+
+    for (int bit = 0; bit < 8; bit++)
+    {
+        if (tick->input & (1 << bit))
+        {
+            printf(" %s", inputs[bit]);
+        }
+    }
+
+    printf(tick->input ? "" : " -");
+
+    for (int bit = 0; bit < 7; bit++)
+    {
+        if (tick->events & (1 << bit))
+        {
+            printf(bit == 1 ? "  [%s %u]" : "  [%s]", events[bit], tick->lines);
+        }
+    }
+
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: %s <hitch.thd>\n", argv[0]);
+        return 1;
+    }
+
+    FILE *file = fopen(argv[1], "rb");
+    uint8_t *data = NULL;
+    long size = 0;
+
+    if (file == NULL || fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) < 0 || fseek(file, 0, SEEK_SET) != 0 ||
+        (data = malloc(size)) == NULL || fread(data, 1, size, file) != (size_t)size)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    fclose(file);
+
+    static FlightDump dump;
+    double threshold = 0;
+
+    if (!flightDumpRead(&dump, &threshold, data, size))
+    {
+        fprintf(stderr, "%s: not a hitch dump this build can read\n", argv[1]);
+        return 1;
+    }
+
+    free(data);
+
+    if (dump.frameCount == 0)
+    {
+        fprintf(stderr, "%s: no frames\n", argv[1]);
+        return 1;
+    }
+
+    const FlightFrame *hitch = &dump.frames[dump.frameCount - 1];
+
+    printf("hitch: %.2f ms frame at tick %u, threshold %.2f ms, %u frames and %u ticks recorded\n\n",
+           hitch->seconds[PERF_TIMING_FRAME] * 1000.0, hitch->tick, threshold * 1000.0, dump.frameCount, dump.tickCount);
+    hitchPrintFrame(hitch, hitch->end);
+
+    // The slowest frames before it, to tell a one-off from a pattern.
+    printf("\nslowest frames before it:\n");
+
+    bool printed[FLIGHT_FRAMES] = {false};
+
+    for (int n = 0; n < HITCH_SLOWEST_FRAMES; n++)
+    {
+        int slowest = -1;
+
+        for (uint32_t i = 0; i + 1 < dump.frameCount; i++)
+        {
+            if (!printed[i] && (slowest < 0 || dump.frames[i].seconds[PERF_TIMING_FRAME] > dump.frames[slowest].seconds[PERF_TIMING_FRAME]))
+            {
+                slowest = i;
+            }
+        }
+
+        if (slowest < 0)
+        {
+            break;
+        }
+
+        printed[slowest] = true;
+        hitchPrintFrame(&dump.frames[slowest], hitch->end);
+    }
+
+    printf("\nlast ticks:\n");
+
+    for (uint32_t i = dump.tickCount > HITCH_LAST_TICKS ? dump.tickCount - HITCH_LAST_TICKS : 0; i < dump.tickCount; i++)
+    {
+        hitchPrintTick(&dump.ticks[i]);
+    }
+
+    // Play the segment again. A slow tick here points at the engine, none points at the rest.
+    Game game;
+    gameRestore(&game, dump.snapshot);
+
+    double slowest = 0;
+    uint32_t slowestTick = 0;
+    double total = 0;
+
+    for (uint32_t i = 0; i < dump.tickCount; i++)
+    {
+        if (dump.ticks[i].tick != game.tick + 1)
+        {
+            fprintf(stderr, "\nthe recording skips from tick %u to %u\n", game.tick, dump.ticks[i].tick);
+            return 1;
+        }
+
+        double start = hitchNow();
+        gameStep(&game, dump.ticks[i].input);
+        double elapsed = hitchNow() - start;
+
+        total += elapsed;
+
+        if (elapsed > slowest)
+        {
+            slowest = elapsed;
+            slowestTick = game.tick;
+        }
+    }
+
+    bool matches = gameChecksum(&game) == dump.checksum;
+
+    printf("\nreplayed %u ticks from the snapshot at tick %u in %.3f ms, slowest gameStep %.3f us at tick %u\n",
+           dump.tickCount, dump.tickCount > 0 ? dump.ticks[0].tick - 1 : game.tick, total * 1000.0, slowest * 1e6, slowestTick);
+    printf("final state %s the game at the hitch\n", matches ? "matches" : "DIFFERS from");
+
+    return matches ? 0 : 1;
+}
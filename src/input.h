@@ -0,0 +1,191 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Every key press and release, timestamped, as it is read from the window system.
+//
+// raylib reads the keyboard once per frame and keeps only the state at that moment, so a tap
+// shorter than a frame never shows up and a press waits for the end of the frame. The sampler
+// puts its own key callback in front of raylib's and passes every event to a sink as soon as it
+// is read, with the time of the poll that read it. inputSampleUntil reads the window system every
+// INPUT_SAMPLE_INTERVAL until a deadline, so the wait between frames becomes sampling time.
+//
+// Polling between frames moves raylib's idea of the previous frame's keys along, so IsKeyPressed
+// may miss keys pressed while sampling; inputKeyPressed does not. IsKeyDown is still right.
+
+#define INPUT_SAMPLE_INTERVAL 0.001
+// Events kept while the sink is full, a power of two.
+#define INPUT_PENDING_EVENTS 64
+// GLFW_KEY_LAST is 348, raylib's keys have the same values.
+#define INPUT_KEYS 512
+
+typedef struct InputEvent
+{
+    double time; // CLOCK_MONOTONIC seconds, within INPUT_SAMPLE_INTERVAL of the key
+    int16_t key; // a raylib KeyboardKey
+    bool pressed;
+} InputEvent;
+
+// Returns false when it cannot take the event now; it is offered again after the next poll.
+typedef bool (*InputSink)(void *context, const InputEvent *event);
+
+typedef struct InputSampler
+{
+    InputSink sink;
+    void *context;
+    void (*chained)(void *window, int key, int scancode, int action, int mods);
+
+    InputEvent pending[INPUT_PENDING_EVENTS];
+    uint32_t pendingHead;
+    uint32_t pendingTail;
+    uint32_t dropped; // events lost because pending was full
+
+    uint8_t presses[INPUT_KEYS]; // since inputKeyPressed last looked, saturating
+} InputSampler;
+
+// Call after InitWindow, from the thread that polls the window. Only one sampler is installed.
+void inputSamplerInstall(InputSampler *sampler, InputSink sink, void *context);
+// Offers the events the sink refused earlier again.
+void inputFlush(InputSampler *sampler);
+// Polls every INPUT_SAMPLE_INTERVAL until deadline, at least once.
+void inputSampleUntil(InputSampler *sampler, double deadline);
+// Whether key was pressed since the last call for it.
+bool inputKeyPressed(InputSampler *sampler, int key);
+// Forgets presses nobody asked about, for a screen that starts looking at keys.
+void inputClearPresses(InputSampler *sampler);
+double inputNow(void);
+
+#endif // INPUT_H
+
+#if defined(INPUT_IMPLEMENTATION) && !defined(INPUT_IMPLEMENTED)
+#define INPUT_IMPLEMENTED
+
+#include "raylib.h"
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+// From the GLFW inside libraylib.a, which raylib does not expose.
+#define INPUT_GLFW_RELEASE 0
+#define INPUT_GLFW_PRESS 1
+
+typedef void (*InputGlfwKeyCallback)(void *window, int key, int scancode, int action, int mods);
+extern InputGlfwKeyCallback glfwSetKeyCallback(void *window, InputGlfwKeyCallback callback);
+
+static InputSampler *inputInstalled;
+
+double inputNow(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+void inputFlush(InputSampler *sampler)
+{
+    while (sampler->pendingHead != sampler->pendingTail)
+    {
+        if (!sampler->sink(sampler->context, &sampler->pending[sampler->pendingHead % INPUT_PENDING_EVENTS]))
+        {
+            return;
+        }
+
+        sampler->pendingHead++;
+    }
+}
+
+static void inputKeyCallback(void *window, int key, int scancode, int action, int mods)
+{
+    InputSampler *sampler = inputInstalled;
+
+    if (sampler->chained != NULL)
+    {
+        sampler->chained(window, key, scancode, action, mods);
+    }
+
+    // Repeats are the window system's own auto repeat, the game has its own.
+    if (key < 0 || key >= INPUT_KEYS || (action != INPUT_GLFW_PRESS && action != INPUT_GLFW_RELEASE))
+    {
+        return;
+    }
+
+    if (action == INPUT_GLFW_PRESS && sampler->presses[key] < UINT8_MAX)
+    {
+        sampler->presses[key]++;
+    }
+
+    InputEvent event = {
+        .time = inputNow(),
+        .key = key,
+        .pressed = action == INPUT_GLFW_PRESS,
+    };
+
+    // Events go in order, nothing overtakes those still pending.
+    inputFlush(sampler);
+
+    if (sampler->pendingHead == sampler->pendingTail && sampler->sink(sampler->context, &event))
+    {
+        return;
+    }
+
+    if (sampler->pendingTail - sampler->pendingHead == INPUT_PENDING_EVENTS)
+    {
+        sampler->dropped++;
+        return;
+    }
+
+    sampler->pending[sampler->pendingTail++ % INPUT_PENDING_EVENTS] = event;
+}
+
+void inputSamplerInstall(InputSampler *sampler, InputSink sink, void *context)
+{
+    sampler->sink = sink;
+    sampler->context = context;
+    inputInstalled = sampler;
+    sampler->chained = glfwSetKeyCallback(GetWindowHandle(), inputKeyCallback);
+}
+
+void inputSampleUntil(InputSampler *sampler, double deadline)
+{
+    for (;;)
+    {
+        PollInputEvents();
+        inputFlush(sampler);
+
+        double now = inputNow();
+
+        if (now >= deadline)
+        {
+            return;
+        }
+
+        double wait = deadline - now < INPUT_SAMPLE_INTERVAL ? deadline - now : INPUT_SAMPLE_INTERVAL;
+        struct timespec duration = {.tv_sec = 0, .tv_nsec = (long)(wait * 1e9)};
+
+        while (nanosleep(&duration, &duration) == -1 && errno == EINTR)
+        {
+            ;
+        }
+    }
+}
+
+bool inputKeyPressed(InputSampler *sampler, int key)
+{
+    if (key < 0 || key >= INPUT_KEYS || sampler->presses[key] == 0)
+    {
+        return false;
+    }
+
+    sampler->presses[key] = 0;
+    return true;
+}
+
+void inputClearPresses(InputSampler *sampler)
+{
+    memset(sampler->presses, 0, sizeof(sampler->presses));
+}
+
+#endif // INPUT_IMPLEMENTATION
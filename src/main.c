@@ -1,699 +1,1064 @@
 #include "raylib.h"
 #include "raymath.h"
+#include "rlgl.h"
 
 #define RAYGUI_IMPLEMENTATION
 #include "raygui.h"
 
+#define TETRIS_IMPLEMENTATION
+#include "tetris.h"
+
+#define RENDER_IMPLEMENTATION
+#include "render.h"
+
+#define EVAL_IMPLEMENTATION
+#include "eval.h"
+
+#define BOT_IMPLEMENTATION
+#include "bot.h"
+
+#define BOTHOST_IMPLEMENTATION
+#include "bothost.h"
+
+#define REPLAY_IMPLEMENTATION
+#include "replay.h"
+
+#define REWIND_IMPLEMENTATION
+#include "rewind.h"
+
+#define NET_IMPLEMENTATION
+#include "net.h"
+
+#define NETPLAY_IMPLEMENTATION
+#include "netplay.h"
+
+#define SPECTATE_IMPLEMENTATION
+#include "spectate.h"
+
+#define SHMRING_IMPLEMENTATION
+#include "shmring.h"
+
+#define PERF_IMPLEMENTATION
+#include "perf.h"
+
+#define TRACE_IMPLEMENTATION
+#include "trace.h"
+
+#define FLIGHT_IMPLEMENTATION
+#include "flight.h"
+
+#define METRICS_IMPLEMENTATION
+#include "metrics.h"
+
+#define ALLOCTRACK_IMPLEMENTATION
+#include "alloctrack.h"
+
+#define INPUT_IMPLEMENTATION
+#include "input.h"
+
+#define SIMTHREAD_IMPLEMENTATION
+#include "simthread.h"
+
 #include <time.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 const int defaultScreenWidth = 800;
-const int defaultScreenHeight = 600;
+const int defaultScreenHeight = RENDER_DESIGN_HEIGHT;
 
 const Color backgroundColor = DARKGRAY;
 
+#define TARGET_FPS 60
+
+// Ticks to catch up on in one frame after a stall, the rest are dropped.
+#define MAX_TICKS_PER_FRAME 5
+
 typedef enum GameState
 {
     GAME_STATE_MAIN_MENU = 0,
     GAME_STATE_RUNNING,
     GAME_STATE_PAUSED,
+    GAME_STATE_REPLAY,
+    GAME_STATE_VERSUS,
 } GameState;
 
-typedef enum PieceType
-{
-    PIECE_O,
-    PIECE_I,
-    PIECE_S,
-    PIECE_Z,
-    PIECE_L,
-    PIECE_J,
-    PIECE_T,
-    PIECE_COUNT = PIECE_T
-} PieceType;
-
-typedef enum Orientation
-{
-    ORIENTATION_NORMAL = 0,
-    ORIENTATION_90,
-    ORIENTATION_180,
-    ORIENTATION_270,
-    ORIENTATION_COUNT = ORIENTATION_270,
-} Orientation;
-
-typedef struct Block
-{
-    Color color;
-} Block;
-
-const Color INVALID_BLOCK_COLOR = (Color){
-    .r = 0xDE,
-    .g = 0xAD,
-    .b = 0xBE,
-    .a = 0xEF,
-};
-
-typedef struct Piece
-{
-    Color color;
-    PieceType type;
-} Piece;
+// Always counted, only served with --metrics-port.
+Metrics metrics;
 
-typedef struct GridPiece
+// EndDrawing sends what is left of the batch, swaps and waits for the next frame.
+void endDrawing(void)
 {
-    Piece data;
-    Orientation orientation;
-    Vector2 origin;
-} GridPiece;
-
-#define PIECE_PARTS_COUNT_1D 4
-#define PIECE_PARTS_COUNT (PIECE_PARTS_COUNT_1D * PIECE_PARTS_COUNT_1D)
-
-bool PIECE_O_PARTS[PIECE_PARTS_COUNT] = {
-    0, 1, 1, 0, //
-    0, 1, 1, 0, //
-    0, 0, 0, 0, //
-    0, 0, 0, 0, //
-};
+    TRACE_SCOPE("EndDrawing");
+    EndDrawing();
 
-bool PIECE_I_PARTS_NORMAL[PIECE_PARTS_COUNT] = {
-    0, 0, 1, 0, //
-    0, 0, 1, 0, //
-    0, 0, 1, 0, //
-    0, 0, 1, 0, //
-};
-
-bool PIECE_I_PARTS_90[PIECE_PARTS_COUNT] = {
-    0, 0, 0, 0, //
-    0, 0, 0, 0, //
-    1, 1, 1, 1, //
-    0, 0, 0, 0, //
-};
-
-bool PIECE_I_PARTS_180[PIECE_PARTS_COUNT] = {
-    0, 1, 0, 0, //
-    0, 1, 0, 0, //
-    0, 1, 0, 0, //
-    0, 1, 0, 0, //
-};
-
-bool PIECE_I_PARTS_270[PIECE_PARTS_COUNT] = {
-    0, 0, 0, 0, //
-    1, 1, 1, 1, //
-    0, 0, 0, 0, //
-    0, 0, 0, 0, //
-};
+    atomic_fetch_add_explicit(&metrics.framesRendered, 1, memory_order_relaxed);
+    metricsObserve(&metrics.frameSeconds, GetFrameTime());
+}
 
-bool PIECE_S_PARTS_NORMAL[PIECE_PARTS_COUNT] = {
-    0, 1, 1, 0, //
-    1, 1, 0, 0, //
-    0, 0, 0, 0, //
-    0, 0, 0, 0, //
+typedef struct KeyBinding
+{
+    KeyboardKey key;
+    GameInputFlag input;
+} KeyBinding;
+
+const KeyBinding keyBindings[] = {
+    {KEY_W, GAME_INPUT_ROTATE},
+    {KEY_A, GAME_INPUT_LEFT},
+    {KEY_D, GAME_INPUT_RIGHT},
+    {KEY_S, GAME_INPUT_SOFT_DROP},
+    {KEY_SPACE, GAME_INPUT_HARD_DROP},
+    {KEY_Q, GAME_INPUT_HOLD},
+    {KEY_ESCAPE, GAME_INPUT_PAUSE},
+    {KEY_R, GAME_INPUT_RESTART},
 };
 
-bool PIECE_S_PARTS_90[PIECE_PARTS_COUNT] = {
-    0, 1, 0, 0, //
-    0, 1, 1, 0, //
-    0, 0, 1, 0, //
-    0, 0, 0, 0, //
-};
+GameInput keyGameInput(int key)
+{
+    for (size_t i = 0; i < sizeof(keyBindings) / sizeof(keyBindings[0]); i++)
+    {
+        if ((int)keyBindings[i].key == key)
+        {
+            return keyBindings[i].input;
+        }
+    }
 
-bool PIECE_S_PARTS_180[PIECE_PARTS_COUNT] = {
-    0, 0, 0, 0, //
-    0, 1, 1, 0, //
-    1, 1, 0, 0, //
-    0, 0, 0, 0, //
-};
+    return 0;
+}
 
-bool PIECE_S_PARTS_270[PIECE_PARTS_COUNT] = {
-    1, 0, 0, 0, //
-    1, 1, 0, 0, //
-    0, 1, 0, 0, //
-    0, 0, 0, 0, //
-};
+// The keyboard as raylib saw it this frame, for versus, which takes input once per frame.
+GameInput pollKeyboardInput(void)
+{
+    TRACE_SCOPE("pollKeyboardInput");
 
-bool PIECE_Z_PARTS_NORMAL[PIECE_PARTS_COUNT] = {
-    1, 1, 0, 0, //
-    0, 1, 1, 0, //
-    0, 0, 0, 0, //
-    0, 0, 0, 0, //
-};
+    GameInput input = 0;
 
-bool PIECE_Z_PARTS_90[PIECE_PARTS_COUNT] = {
-    0, 0, 1, 0, //
-    0, 1, 1, 0, //
-    0, 1, 0, 0, //
-    0, 0, 0, 0, //
-};
+    for (size_t i = 0; i < sizeof(keyBindings) / sizeof(keyBindings[0]); i++)
+    {
+        const KeyBinding *binding = &keyBindings[i];
+        bool held = binding->input & GAME_INPUT_HELD_MASK;
 
-bool PIECE_Z_PARTS_180[PIECE_PARTS_COUNT] = {
-    0, 0, 0, 0, //
-    1, 1, 0, 0, //
-    0, 1, 1, 0, //
-    0, 0, 0, 0, //
-};
+        if (held ? IsKeyDown(binding->key) : IsKeyPressed(binding->key))
+        {
+            input |= binding->input;
+        }
+    }
 
-bool PIECE_Z_PARTS_270[PIECE_PARTS_COUNT] = {
-    0, 1, 0, 0, //
-    1, 1, 0, 0, //
-    1, 0, 0, 0, //
-    0, 0, 0, 0, //
-};
+    return input;
+}
 
-bool PIECE_L_PARTS_NORMAL[PIECE_PARTS_COUNT] = {
-    0, 1, 0, 0, //
-    0, 1, 0, 0, //
-    0, 1, 1, 0, //
-    0, 0, 0, 0, //
+Game game;
+
+BotPlayer botPlayer;
+bool botEnabled = false;
+
+// Hints: the built-in bot thinks about a copy of the game on its own thread. The copy is only
+// replaced once the previous search has returned, so the render thread never waits for it.
+BotHost hintHost;
+Game hintGame;
+bool hintsEnabled = false;
+bool hintRequested = false;
+bool hasHint = false;
+GridPiece hintPiece;
+
+const Color hintColor = {
+    .r = 0xFF,
+    .g = 0xFF,
+    .b = 0xFF,
+    .a = 0x50,
 };
 
-bool PIECE_L_PARTS_90[PIECE_PARTS_COUNT] = {
-    0, 0, 0, 0, //
-    0, 1, 1, 1, //
-    0, 1, 0, 0, //
-    0, 0, 0, 0, //
-};
+// Attract mode: the built-in bot plays a fixed game behind the main menu.
+#define ATTRACT_SEED 0x7E7215
 
-bool PIECE_L_PARTS_180[PIECE_PARTS_COUNT] = {
-    1, 1, 0, 0, //
-    0, 1, 0, 0, //
-    0, 1, 0, 0, //
-    0, 0, 0, 0, //
-};
+BotPlayer attractPlayer;
+Game attractGame;
+bool attractRunning = false;
+double attractNextTick;
 
-bool PIECE_L_PARTS_270[PIECE_PARTS_COUNT] = {
-    0, 0, 1, 0, //
-    1, 1, 1, 0, //
-    0, 0, 0, 0, //
-    0, 0, 0, 0, //
-};
+void updateAttract(double now)
+{
+    if (!attractRunning)
+    {
+        attractRunning = attractPlayer.host.started || botHostStart(&attractPlayer.host, botBuiltinInterface(), 0);
+        gameInit(&attractGame, ATTRACT_SEED);
+        attractNextTick = now;
 
-bool PIECE_J_PARTS_NORMAL[PIECE_PARTS_COUNT] = {
-    0, 1, 0, 0, //
-    0, 1, 0, 0, //
-    1, 1, 0, 0, //
-    0, 0, 0, 0, //
-};
+        if (!attractRunning)
+        {
+            return;
+        }
+    }
 
-bool PIECE_J_PARTS_90[PIECE_PARTS_COUNT] = {
-    1, 0, 0, 0, //
-    1, 1, 1, 0, //
-    0, 0, 0, 0, //
-    0, 0, 0, 0, //
-};
+    for (int ticks = 0; attractNextTick <= now && ticks < MAX_TICKS_PER_FRAME; ticks++)
+    {
+        GameInput input = 0;
 
-bool PIECE_J_PARTS_180[PIECE_PARTS_COUNT] = {
-    0, 1, 1, 0, //
-    0, 1, 0, 0, //
-    0, 1, 0, 0, //
-    0, 0, 0, 0, //
-};
+        if (!botPlayerInput(&attractPlayer, &attractGame, &input))
+        {
+            attractNextTick = now;
+            break;
+        }
 
-bool PIECE_J_PARTS_270[PIECE_PARTS_COUNT] = {
-    0, 0, 0, 0, //
-    1, 1, 1, 0, //
-    0, 0, 1, 0, //
-    0, 0, 0, 0, //
-};
+        gameStep(&attractGame, input);
+        attractNextTick += 1.0 / GAME_TICKS_PER_SECOND;
+    }
 
-bool PIECE_T_PARTS_NORMAL[PIECE_PARTS_COUNT] = {
-    0, 0, 0, 0, //
-    1, 1, 1, 0, //
-    0, 1, 0, 0, //
-    0, 0, 0, 0, //
-};
+    if (attractNextTick < now)
+    {
+        attractNextTick = now;
+    }
 
-bool PIECE_T_PARTS_90[PIECE_PARTS_COUNT] = {
-    0, 1, 0, 0, //
-    1, 1, 0, 0, //
-    0, 1, 0, 0, //
-    0, 0, 0, 0, //
-};
+    if (attractGame.dead)
+    {
+        gameInit(&attractGame, ATTRACT_SEED);
+    }
+}
 
-bool PIECE_T_PARTS_180[PIECE_PARTS_COUNT] = {
-    0, 1, 0, 0, //
-    1, 1, 1, 0, //
-    0, 0, 0, 0, //
-    0, 0, 0, 0, //
-};
+// Whether the hint was asked for the piece now in play, wherever it has moved since.
+bool hintSamePiece(const Game *hint, const Game *game)
+{
+    return hint->games == game->games &&
+           hint->piecesLocked == game->piecesLocked &&
+           hint->savedThisPiece == game->savedThisPiece;
+}
 
-bool PIECE_T_PARTS_270[PIECE_PARTS_COUNT] = {
-    0, 1, 0, 0, //
-    0, 1, 1, 0, //
-    0, 1, 0, 0, //
-    0, 0, 0, 0, //
-};
+bool hintMatches(const Game *hint, const Game *game)
+{
+    return hintSamePiece(hint, game) && memcmp(&hint->piece, &game->piece, sizeof(game->piece)) == 0;
+}
 
-bool *piecePartsForOrientation(const Orientation orientation, const PieceType pieceType)
+void updateHint(const Game *game)
 {
-    switch (pieceType)
+    TetrisBotOutput plan;
+    BotHostStatus status = botHostPoll(&hintHost, &plan);
+    bool current = hintRequested && hintMatches(&hintGame, game);
+
+    if (status == BOT_HOST_READY && current)
     {
-    case PIECE_O:
+        hintPiece = botPlanLanding(&hintGame, &plan);
+        hintPiece.data.color = hintColor;
+        hasHint = true;
+    }
+
+    if (current)
     {
-        return PIECE_O_PARTS;
+        return;
     }
-    case PIECE_I:
+
+    // A piece that only moved keeps its hint until the search from where it is now returns.
+    if (!hintSamePiece(&hintGame, game))
     {
-        return (bool *[4]){PIECE_I_PARTS_NORMAL, PIECE_I_PARTS_90, PIECE_I_PARTS_180, PIECE_I_PARTS_270}[orientation];
+        hasHint = false;
     }
-    case PIECE_S:
+
+    if (status == BOT_HOST_THINKING)
     {
-        return (bool *[4]){PIECE_S_PARTS_NORMAL, PIECE_S_PARTS_90, PIECE_S_PARTS_180, PIECE_S_PARTS_270}[orientation];
+        botHostCancel(&hintHost);
     }
-    case PIECE_Z:
+    else if (!game->dead && !game->paused)
     {
-        return (bool *[4]){PIECE_Z_PARTS_NORMAL, PIECE_Z_PARTS_90, PIECE_Z_PARTS_180, PIECE_Z_PARTS_270}[orientation];
+        hintGame = *game;
+        hintRequested = botHostRequest(&hintHost, &hintGame);
     }
-    case PIECE_L:
+}
+
+// Versus: two boards kept in sync by rollback netcode, against a peer over UDP or against the
+// built-in bot through an in-process loopback that behaves like a slow network. The bot plays its
+// side with no input delay on its own copy of the board, which sees the same inputs from the same
+// seed and so stays identical to the one in the match.
+#define VERSUS_LOOPBACK_JITTER 0.25
+#define VERSUS_LOOPBACK_LOSS 0.02
+
+Netplay versus;
+NetTransport versusTransport;
+NetLoopback versusLoopback;
+
+Netplay sparring;
+NetTransport sparringTransport;
+BotPlayer sparringPlayer;
+Game sparringGame;
+bool sparringEnabled = false;
+bool sparringStarted = false;
+double sparringNextTick;
+
+void updateSparring(double now)
+{
+    if (!sparringPlayer.host.started && !botHostStart(&sparringPlayer.host, botBuiltinInterface(), 0))
     {
-        return (bool *[4]){PIECE_L_PARTS_NORMAL, PIECE_L_PARTS_90, PIECE_L_PARTS_180, PIECE_L_PARTS_270}[orientation];
+        return;
     }
-    case PIECE_J:
+
+    netplayPoll(&sparring, now);
+
+    if (!sparringStarted && sparring.status == NETPLAY_RUNNING)
     {
-        return (bool *[4]){PIECE_J_PARTS_NORMAL, PIECE_J_PARTS_90, PIECE_J_PARTS_180, PIECE_J_PARTS_270}[orientation];
+        gameInit(&sparringGame, sparring.seed);
+        sparringStarted = true;
+        sparringNextTick = now;
     }
-    case PIECE_T:
+
+    for (int ticks = 0; sparringStarted && sparringNextTick <= now && ticks < MAX_TICKS_PER_FRAME; ticks++)
     {
-        return (bool *[4]){PIECE_T_PARTS_NORMAL, PIECE_T_PARTS_90, PIECE_T_PARTS_180, PIECE_T_PARTS_270}[orientation];
+        GameInput input = sparringGame.dead ? GAME_INPUT_RESTART : 0;
+
+        if (!netplayReady(&sparring) || !botPlayerInput(&sparringPlayer, &sparringGame, &input))
+        {
+            sparringNextTick = now;
+            break;
+        }
+
+        gameStep(&sparringGame, input);
+        netplayAdvance(&sparring, input);
+        sparringNextTick += 1.0 / GAME_TICKS_PER_SECOND;
     }
+
+    if (sparringNextTick < now)
+    {
+        sparringNextTick = now;
     }
 
-    assert(0);
+    netplaySend(&sparring, now);
 }
 
-const Color colors[] = {
-    RED,
-    BLUE,
-    GREEN,
-    ORANGE,
-    YELLOW,
-};
-
-const uint8_t colorsLength = sizeof(colors) / sizeof(colors[1]);
-
-// TODO: better name for this function?
-Vector2 partCoordinatesFromIndex(size_t i, const Vector2 origin)
+void drawVersusStats(Vector2 origin, uint8_t fontSize, double rollbackTime, double netTime)
 {
-    return (Vector2){
-        .x = origin.x + (i % 4),
-        .y = origin.y + (i / 4),
+    const NetplayStats *stats = &versus.stats;
+    const char *lines[] = {
+        TextFormat("Rollbacks: %u, %u ticks simulated again, longest %u", stats->rollbacks, stats->resimulatedTicks, stats->longestRollback),
+        TextFormat("Rollback: %.3f ms this frame, longest %.3f ms", rollbackTime * 1000.0, stats->longestRollbackTime * 1000.0),
+        TextFormat("Netcode and ticks: %.3f ms of a %.2f ms frame, waited %u ticks", netTime * 1000.0, GetFrameTime() * 1000.0, stats->waits),
     };
+
+    for (size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); i++)
+    {
+        DrawText(lines[i], origin.x, origin.y + fontSize * i, fontSize, BLACK);
+    }
 }
 
-typedef struct GridPieceParts
-{
-    Vector2 coordinates[PIECE_PARTS_COUNT_1D];
-} GridPieceParts;
+// Performance overlay, toggled with F3 during a game.
+#define PERF_GRAPH_FRAMES 240
+#define PERF_REFRESH_SECONDS 0.25
 
-GridPieceParts constructGridPieceParts(const GridPiece *piece)
-{
-    GridPieceParts gridPieceParts;
+PerfRing perfRing;
+bool perfHudEnabled = false;
+double perfLastEnd = 0;
+double perfNextRefresh = 0;
+PerfSummary perfSummaries[PERF_TIMING_COUNT];
 
-    bool *hasPart = piecePartsForOrientation(piece->orientation, piece->data.type);
-    size_t index = 0;
+#ifdef ALLOC_TRACKING
+// Running frames that may allocate while textures, fonts and driver state are first used, and as
+// many wakes of the simulation thread. Every one after must not.
+#define ALLOC_WARMUP_FRAMES 120
 
-    for (size_t i = 0; i < PIECE_PARTS_COUNT; i++)
-    {
-        if (!hasPart[i])
-        {
-            continue;
-        }
+uint32_t allocRunningFrames = 0;
+#endif
 
-        Vector2 pieceCoordinates = partCoordinatesFromIndex(i, piece->origin);
-        gridPieceParts.coordinates[index++] = pieceCoordinates;
-    }
+// Hitch flight recorder, on unless --hitch-ms is 0.
+#define HITCH_DEFAULT_MILLISECONDS 100
 
-    return gridPieceParts;
-};
+FlightRecorder flight;
 
-void drawGridPiece(const Vector2 gridOrigin, const Vector2 blockSize, const GridPiece *piece)
-{
-    GridPieceParts parts = constructGridPieceParts(piece);
+const char *perfTimingNames[PERF_TIMING_COUNT] = {"Frame", "Sim", "Layout", "Draw", "Present"};
+const Color perfTimingColors[PERF_TIMING_COUNT] = {RAYWHITE, RED, YELLOW, GREEN, SKYBLUE};
 
-    for (size_t i = 0; i < PIECE_PARTS_COUNT_1D; i++)
-    {
-        Vector2 pieceCoordinates = parts.coordinates[i];
-        Vector2 coordinates = Vector2Add(Vector2Multiply(pieceCoordinates, blockSize), gridOrigin);
+// rlgl submits its batches through the GL functions glad loaded, so wrapping the two it draws
+// with counts every draw call and vertex that reaches the driver.
+typedef void (*PerfDrawArrays)(unsigned int mode, int first, int count);
+typedef void (*PerfDrawElements)(unsigned int mode, int count, unsigned int type, const void *indices);
+extern PerfDrawArrays glad_glDrawArrays;
+extern PerfDrawElements glad_glDrawElements;
 
-        DrawRectangleV(coordinates, blockSize, piece->data.color);
-    }
-}
+PerfDrawArrays perfDrawArrays;
+PerfDrawElements perfDrawElements;
+uint32_t perfDrawCalls;
+uint32_t perfVertices;
 
-void drawNextPiece(const Vector2 origin, size_t slot, const Vector2 blockSize, const uint16_t padding, const Piece piece)
+void perfCountDrawArrays(unsigned int mode, int first, int count)
 {
-    GridPieceParts parts = constructGridPieceParts(&(GridPiece){
-        .data = piece,
-        .orientation = ORIENTATION_NORMAL,
-        .origin = (Vector2){
-            .x = 0,
-            .y = PIECE_PARTS_COUNT_1D * slot,
-        },
-    });
-
-    for (size_t i = 0; i < PIECE_PARTS_COUNT_1D; i++)
-    {
-        const Vector2 coordinates = Vector2Add(
-            Vector2Add(
-                Vector2Multiply(parts.coordinates[i], blockSize),
-                origin),
-            (Vector2){
-                .x = 0,
-                .y = padding * slot,
-            });
-        DrawRectangleV(coordinates, blockSize, piece.color);
-        DrawRectangleLines(coordinates.x, coordinates.y, blockSize.x, blockSize.y, BLACK);
-    }
+    perfDrawCalls++;
+    perfVertices += count;
+    perfDrawArrays(mode, first, count);
 }
 
-void drawSavedPiece(const Vector2 origin, const Vector2 blockSize, const Piece piece)
+void perfCountDrawElements(unsigned int mode, int count, unsigned int type, const void *indices)
 {
-    GridPieceParts parts = constructGridPieceParts(&(GridPiece){
-        .data = piece,
-        .orientation = ORIENTATION_NORMAL,
-        .origin = Vector2Zero(),
-    });
+    // rlgl draws quads as two triangles over four vertices.
+    perfDrawCalls++;
+    perfVertices += count / 6 * 4;
+    perfDrawElements(mode, count, type, indices);
+}
 
-    for (size_t i = 0; i < PIECE_PARTS_COUNT_1D; i++)
+// Once the window, and with it GL, is up.
+void perfCountDrawCalls(void)
+{
+    if (glad_glDrawArrays != NULL && glad_glDrawElements != NULL)
     {
-        const Vector2 coordinates = Vector2Add(
-            Vector2Multiply(parts.coordinates[i], blockSize),
-            origin);
-        DrawRectangleV(coordinates, blockSize, piece.color);
-        DrawRectangleLines(coordinates.x, coordinates.y, blockSize.x, blockSize.y, BLACK);
+        perfDrawArrays = glad_glDrawArrays;
+        perfDrawElements = glad_glDrawElements;
+        glad_glDrawArrays = perfCountDrawArrays;
+        glad_glDrawElements = perfCountDrawElements;
     }
 }
 
-// 12<-> * ^10
-#define w 10
-#define h 20
-Block grid[w * h] = {0};
-
-bool isInsideGrid(const Vector2 coordinate)
+// A bar per frame, split by phase, under the frame-time percentiles and the latest counts. The
+// bars reach the top at two 60 Hz frames, the line marks one.
+void drawPerfHud(Vector2 origin, uint8_t fontSize, double now)
 {
-    return !(
-        coordinate.x < 0 ||
-        coordinate.x >= w ||
-        coordinate.y < 0 ||
-        coordinate.y >= h //
-    );
-}
+    if (now >= perfNextRefresh)
+    {
+        for (PerfTiming timing = 0; timing < PERF_TIMING_COUNT; timing++)
+        {
+            perfSummaries[timing] = perfSummarize(&perfRing, timing, now);
+        }
 
-int gridIndexFromCoordinate(const Vector2 coordinate)
-{
-    return coordinate.y * w + coordinate.x;
-}
+        perfNextRefresh = now + PERF_REFRESH_SECONDS;
+    }
 
-bool isBlockInGrid(const Block grid[w * h], Vector2 coordinate)
-{
-    int index = coordinate.y * w + coordinate.x;
-    return memcmp(&grid[index].color, &INVALID_BLOCK_COLOR, sizeof(grid[index].color));
-}
+    const float graphHeight = fontSize * 5;
+    const float pixelsPerSecond = graphHeight / (2.0f / 60.0f);
+    const size_t lineCount = PERF_TIMING_COUNT + 2;
 
-typedef enum HitResult
-{
-    NO_HIT,
-    HIT,
-    GAME_OVER
-} HitResult;
+    const int textWidth = MeasureText("Present  p50 000.00  p99 000.00  max 000.00 ms", fontSize);
 
-HitResult checkCollisions(const Block grid[w * h], const GridPiece *piece)
-{
-    GridPieceParts parts = constructGridPieceParts(piece);
+    DrawRectangle(origin.x, origin.y, (textWidth > PERF_GRAPH_FRAMES ? textWidth : PERF_GRAPH_FRAMES) + fontSize, graphHeight + fontSize * (lineCount + 1), Fade(BLACK, 0.7f));
+
+    const float bottom = origin.y + fontSize / 2 + graphHeight;
+    const PerfFrame *frame;
 
-    for (size_t i = 0; i < PIECE_PARTS_COUNT_1D; i++)
+    for (uint64_t age = 0; age < PERF_GRAPH_FRAMES && (frame = perfFrame(&perfRing, age)) != NULL; age++)
     {
-        Vector2 partCoordinates = parts.coordinates[i];
+        float x = origin.x + fontSize / 2 + PERF_GRAPH_FRAMES - 1 - age;
+        float y = bottom;
 
-        if (!isInsideGrid(partCoordinates) || isBlockInGrid(grid, partCoordinates))
+        for (PerfTiming timing = PERF_TIMING_SIM; timing < PERF_TIMING_COUNT; timing++)
         {
-            return (partCoordinates.y == 0 || piece->origin.y == 0) ? GAME_OVER : HIT;
+            float height = fminf(frame->seconds[timing] * pixelsPerSecond, y - (bottom - graphHeight));
+            y -= height;
+            DrawRectangleV((Vector2){x, y}, (Vector2){1, height}, perfTimingColors[timing]);
         }
     }
 
-    return NO_HIT;
-}
+    DrawLine(origin.x + fontSize / 2, bottom - graphHeight / 2, origin.x + fontSize / 2 + PERF_GRAPH_FRAMES, bottom - graphHeight / 2, RAYWHITE);
 
-typedef struct LinesResult
-{
-    bool destroyed[PIECE_PARTS_COUNT_1D];
-} LinesResult;
+    float y = bottom + fontSize / 2;
 
-bool inSet(int *items, int itemLength, int item)
-{
-    for (size_t i = 0; i < itemLength; i++)
+    for (PerfTiming timing = 0; timing < PERF_TIMING_COUNT; timing++, y += fontSize)
     {
-        if (items[i] == item)
-            return true;
+        const PerfSummary *summary = &perfSummaries[timing];
+        DrawText(TextFormat("%-8s p50 %6.2f  p99 %6.2f  max %6.2f ms", perfTimingNames[timing], summary->p50 * 1000.0, summary->p99 * 1000.0, summary->max * 1000.0),
+                 origin.x + fontSize / 2, y, fontSize, perfTimingColors[timing]);
     }
 
-    return false;
+    if ((frame = perfFrame(&perfRing, 0)) != NULL)
+    {
+        DrawText(TextFormat("Draw calls %u, vertices %u", frame->drawCalls, frame->vertices), origin.x + fontSize / 2, y, fontSize, RAYWHITE);
+        DrawText(TextFormat("checkCollisions %u, applyGravity %u", frame->collisionChecks, frame->gravitySteps), origin.x + fontSize / 2, y + fontSize, fontSize, RAYWHITE);
+    }
 }
 
-LinesResult checkLines(const Block grid[w * h], const GridPiece *piece)
+// A game being played runs on its own thread at GAME_TICKS_PER_SECOND, see simthread.h, so a slow
+// frame no longer holds up input and gravity. The render thread leaves game, botPlayer, flight's
+// ticks and the recorders below alone from simStart to simStop and draws the latest snapshot.
+#define SIM_BOT_RETRY_SECONDS 0.001
+
+typedef struct SimSnapshot
 {
-    LinesResult result = {
-        .destroyed = {false, false, false, false},
-    };
+    Game game;
+    TetrisCounters counters; // the simulation thread's own
+    bool rewinding;
+    float rewindSeconds;
+    float botP50;
+    float botP99;
+    uint32_t botTimeouts;
+    uint32_t botDecisions;
+    uint32_t gamesOver;  // games that ended since simStart
+    double gameOverTick; // simNow() when the tick that ended the last one was due
+} SimSnapshot;
+
+typedef struct Sim
+{
+    SimQueue queue;
+    TripleBuffer buffer;
+    SimSnapshot snapshots[3];
+    pthread_t thread;
+    atomic_bool running;
+    bool started;
+
+    Rewind *rewind;
+    ReplayRecorder *recorder;
+    SpectateServer *spectateServer;
+    ShmRingWriter *shmWriter;
+} Sim;
+
+Sim sim;
+
+void *simThread(void *argument)
+{
+    (void)argument;
+
+#ifdef TRACE_ENABLED
+    traceSetThreadName("sim");
+#endif
+    ALLOC_PHASE(ALLOC_PHASE_SIM);
+
+    SimSnapshot *snapshot = &sim.snapshots[sim.buffer.back];
+    GameInput heldInput = 0;
+    GameInput pressedInput = 0; // since the last tick, so a tap shorter than a tick still counts
+    bool rewindHeld = false;
+    SimMessage message;
+    bool waiting = false; // message is an event for a later tick
+    uint32_t gamesOver = 0;
+    double gameOverTick = 0;
+    uint32_t botDecisions = 0;
+    float botP50 = 0;
+    float botP99 = 0;
+    double nextTick = simNow();
+
+#ifdef ALLOC_TRACKING
+    uint32_t wakes = 0;
+#endif
+
+    while (atomic_load_explicit(&sim.running, memory_order_relaxed))
+    {
+        simSleepUntil(nextTick);
 
-    bool seen[PIECE_PARTS_COUNT_1D] = {false, false, false, false};
-    GridPieceParts parts = constructGridPieceParts(piece);
+        TRACE_SCOPE("simWake");
+#ifdef ALLOC_TRACKING
+        allocForbid(++wakes > ALLOC_WARMUP_FRAMES);
+#endif
+        double now = simNow();
+        bool rewinding = false;
 
-    for (size_t i = 0; i < PIECE_PARTS_COUNT_1D; ++i)
-    {
-        Vector2 partCoordinates = parts.coordinates[i];
-        int index = (int)partCoordinates.y - piece->origin.y;
+        for (int ticks = 0; nextTick <= now && ticks < MAX_TICKS_PER_FRAME; ticks++)
+        {
+            // Every event up to the time this tick was due, in order.
+            while (waiting || simQueuePop(&sim.queue, &message))
+            {
+                waiting = message.type == SIM_MESSAGE_INPUT && message.input.time > nextTick;
+
+                if (waiting)
+                {
+                    break;
+                }
+
+                if (message.type == SIM_MESSAGE_FRAME)
+                {
+                    flightRecorderFrame(&flight, &message.frame, &game);
+                }
+                else if (message.input.key == KEY_BACKSPACE)
+                {
+                    rewindHeld = message.input.pressed;
+                }
+                else
+                {
+                    GameInput bound = keyGameInput(message.input.key);
+
+                    if (botEnabled)
+                    {
+                        bound &= GAME_INPUT_PAUSE | GAME_INPUT_RESTART;
+                    }
+
+                    heldInput = message.input.pressed ? heldInput | (bound & GAME_INPUT_HELD_MASK) : heldInput & ~bound;
+                    pressedInput |= message.input.pressed ? bound : 0;
+                }
+            }
+
+            GameInput input = heldInput | pressedInput;
+            rewinding = rewindHeld && sim.rewind->ticks != NULL && !game.paused;
+
+            if (rewinding)
+            {
+                rewindStepBack(sim.rewind, &game);
+                flightRecorderReset(&flight, &game);
+            }
+            else
+            {
+                if (botEnabled && !botPlayerInput(&botPlayer, &game, &input))
+                {
+                    nextTick = now + SIM_BOT_RETRY_SECONDS;
+                    break;
+                }
+
+                gameStep(&game, input);
+                replayRecorderTick(sim.recorder, input, &game);
+                flightRecorderTick(&flight, input, &game);
+
+                if (!game.paused && !game.dead)
+                {
+                    rewindRecord(sim.rewind, &game);
+                }
+            }
+
+            if (metricsGameTick(&metrics, &game))
+            {
+                gamesOver++;
+                gameOverTick = nextTick;
+            }
+
+            spectateServerTick(sim.spectateServer, &game);
+            shmRingWriterTick(sim.shmWriter, &game);
+            pressedInput = 0;
+            nextTick += 1.0 / GAME_TICKS_PER_SECOND;
+        }
 
-        if (seen[index])
+        if (nextTick < now)
         {
-            continue;
+            nextTick = now;
         }
 
-        seen[index] = true;
-        partCoordinates.x = 0;
+        metricsBotDecisions(&metrics, METRICS_BOT_PLAYER, &botPlayer.host);
 
-        for (size_t j = 0; j < w; ++j)
+        // Sorting the latencies is only worth it when there is a new one.
+        if (botEnabled && botPlayer.host.decisions != botDecisions)
         {
-            partCoordinates.x = j;
-            if (!isBlockInGrid(grid, partCoordinates))
-            {
-                goto outer;
-            }
+            botDecisions = botPlayer.host.decisions;
+            botP50 = botHostLatencyPercentile(&botPlayer.host, 50);
+            botP99 = botHostLatencyPercentile(&botPlayer.host, 99);
         }
-        result.destroyed[index] = true;
-    outer:
+
+        *snapshot = (SimSnapshot){
+            .game = game,
+            .counters = tetrisCounters,
+            .rewinding = rewinding,
+            .rewindSeconds = rewindSecondsAvailable(sim.rewind),
+            .botP50 = botP50,
+            .botP99 = botP99,
+            .botTimeouts = botPlayer.host.timeouts,
+            .botDecisions = botDecisions,
+            .gamesOver = gamesOver,
+            .gameOverTick = gameOverTick,
+        };
+        snapshot = &sim.snapshots[tripleBufferPublish(&sim.buffer)];
     }
 
-    return result;
-}
+#ifdef ALLOC_TRACKING
+    allocForbid(false);
+#endif
 
-void memset32(void *buf, uint32_t c, uint32_t n)
-{
-    for (uint32_t i = 0; i < n; i++)
-    {
-        ((uint32_t *)buf)[i] = c;
-    }
+    return NULL;
 }
 
-void applyGravityToBlocks(Block grid[w * h], uint8_t firstLine, uint8_t numberOfLines)
+// Takes over game, botPlayer and the recorders until simStop.
+bool simStart(Rewind *rewind, ReplayRecorder *recorder, SpectateServer *spectateServer, ShmRingWriter *shmWriter)
 {
-    uint8_t line = firstLine - numberOfLines + 1;
-    size_t indexDest = gridIndexFromCoordinate((Vector2){
-        .x = 0,
-        .y = numberOfLines,
-    });
+    sim.rewind = rewind;
+    sim.recorder = recorder;
+    sim.spectateServer = spectateServer;
+    sim.shmWriter = shmWriter;
 
-    size_t indexSrc = 0;
+    tripleBufferInit(&sim.buffer);
 
-    memmove(&grid[indexDest], &grid[indexSrc], (line * w) * sizeof(Block));
+    for (int slot = 0; slot < 3; slot++)
+    {
+        sim.snapshots[slot] = (SimSnapshot){.game = game};
+    }
 
-    //
-    Block emptyBlock = {
-        .color = INVALID_BLOCK_COLOR,
-    };
-    uint32_t emptyBlockAsInt = ((uint32_t *)&emptyBlock)[0];
+    atomic_store(&sim.running, true);
+    sim.started = pthread_create(&sim.thread, NULL, simThread, NULL) == 0;
 
-    memset32(&grid[0], emptyBlockAsInt, (numberOfLines * w));
+    return sim.started;
 }
 
-HitResult applyGravity(const Block grid[w * h], GridPiece *piece)
+void simStop(void)
 {
-    piece->origin.y += 1;
+    if (sim.started)
+    {
+        atomic_store(&sim.running, false);
+        pthread_join(sim.thread, NULL);
+        sim.started = false;
+    }
+}
 
-    HitResult result = checkCollisions(grid, piece);
+// Key events go to the simulation thread as they are read, not once a frame.
+InputSampler inputSampler;
 
-    if (result != NO_HIT)
+bool simInputSink(void *context, const InputEvent *event)
+{
+    (void)context;
+
+    if (!sim.started)
     {
-        piece->origin.y -= 1;
+        return true;
     }
 
-    return result;
+    SimMessage message = {.type = SIM_MESSAGE_INPUT, .input = *event};
+    return simQueuePush(&sim.queue, &message);
 }
 
-void movePieceToSides(const Block grid[w * h], GridPiece *piece)
+// Replay viewer: plays a recorded session with seeking, variable speed and frame stepping.
+#define REPLAY_MIN_SPEED 0.25f
+#define REPLAY_MAX_SPEED 64.0f
+
+ReplayPlayer replayPlayer;
+bool replayPaused = false;
+float replaySpeed = 1;
+double replayTicks = 0;
+
+void updateReplayViewer(float frameTime)
 {
-    int movement = 0;
-    if (IsKeyDown(KEY_A))
+    uint32_t tick = replayPlayer.current.game.tick;
+
+    if (IsKeyPressed(KEY_SPACE))
     {
-        movement = -1;
+        replayPaused = !replayPaused;
+        replayTicks = 0;
     }
 
-    else if (IsKeyDown(KEY_D))
+    if (IsKeyPressed(KEY_UP))
     {
-        movement = 1;
+        replaySpeed = fminf(replaySpeed * 2, REPLAY_MAX_SPEED);
     }
 
-    else
+    if (IsKeyPressed(KEY_DOWN))
     {
+        replaySpeed = fmaxf(replaySpeed / 2, REPLAY_MIN_SPEED);
+    }
+
+    if (replayPaused)
+    {
+        if (IsKeyPressed(KEY_RIGHT) || IsKeyPressedRepeat(KEY_RIGHT))
+        {
+            replayPlayerStep(&replayPlayer);
+        }
+
+        if ((IsKeyPressed(KEY_LEFT) || IsKeyPressedRepeat(KEY_LEFT)) && tick > 0)
+        {
+            replayPlayerSeek(&replayPlayer, tick - 1);
+        }
+
         return;
     }
 
-    piece->origin.x += movement;
-    HitResult result = checkCollisions(grid, piece);
+    replayTicks += frameTime * GAME_TICKS_PER_SECOND * replaySpeed;
 
-    if (result != NO_HIT)
+    for (; replayTicks >= 1; replayTicks--)
     {
-        piece->origin.x -= movement;
+        if (!replayPlayerStep(&replayPlayer))
+        {
+            replayPaused = true;
+            replayTicks = 0;
+            break;
+        }
     }
 }
 
-// TODO: rotate sometimes blocks where it could rotate
-void rotatePiece(const Block grid[w * h], GridPiece *piece)
+void drawReplayControls(const Rectangle bounds, uint8_t fontSize)
 {
-    Orientation newOrientation = (piece->orientation + 1) % (ORIENTATION_COUNT + 1);
-    Orientation oldOrientation = piece->orientation;
-    piece->orientation = newOrientation;
+    const ReplayPlayer *player = &replayPlayer;
+    const uint32_t tick = player->current.game.tick;
+
+    DrawRectangleRec(bounds, Fade(BLACK, 0.6f));
 
-    HitResult result = checkCollisions(grid, piece);
+    const char *status = TextFormat("%s  %gx  %02u:%02u / %02u:%02u",
+                                    replayPaused ? "||" : ">", replaySpeed,
+                                    tick / GAME_TICKS_PER_SECOND / 60, tick / GAME_TICKS_PER_SECOND % 60,
+                                    player->length / GAME_TICKS_PER_SECOND / 60, player->length / GAME_TICKS_PER_SECOND % 60);
 
-    if (result != NO_HIT)
+    if (player->divergedAt != 0)
     {
-        piece->orientation = oldOrientation;
+        status = TextFormat("%s  desync at %02u:%02u", status, player->divergedAt / GAME_TICKS_PER_SECOND / 60, player->divergedAt / GAME_TICKS_PER_SECOND % 60);
     }
-}
 
-Piece makeRandomPiece(void)
-{
-    PieceType type = rand() % (PIECE_COUNT + 1);
-    Color color = colors[rand() % colorsLength];
+    DrawText(status, bounds.x + fontSize / 2, bounds.y + (bounds.height - fontSize) / 2, fontSize, RAYWHITE);
 
-    return (Piece){
-        color,
-        type,
+    const float statusWidth = MeasureText(status, fontSize) + fontSize;
+    const Rectangle slider = {
+        .x = bounds.x + statusWidth,
+        .y = bounds.y + bounds.height / 4,
+        .width = bounds.width - statusWidth - fontSize / 2,
+        .height = bounds.height / 2,
     };
-}
 
-void initGrid(void)
-{
-    for (size_t i = 0; i < w * h; ++i)
+    float position = tick;
+    GuiSliderBar(slider, NULL, NULL, &position, 0, player->length);
+
+    if ((uint32_t)position != tick)
     {
-        grid[i].color = INVALID_BLOCK_COLOR;
+        replayPlayerSeek(&replayPlayer, (uint32_t)position);
+        replayTicks = 0;
     }
 }
 
-int score = 0;
-int level = 1;
-bool dead = false;
-
-#define NEXT_PIECES_COUNT 3
-
-Piece nextPieces[NEXT_PIECES_COUNT];
-GridPiece piece;
-Piece *savedPiece = NULL;
-bool savedThisPiece = false;
+// Handling is counted in ticks, so milliseconds are rounded to the nearest one.
+static bool parseHandlingTicks(const char *milliseconds, uint8_t *ticks)
+{
+    double value = atof(milliseconds) / 1000.0 * GAME_TICKS_PER_SECOND;
 
-#define MAX(x, y) (((x) > (y)) ? (x) : (y))
+    if (!(value >= 0 && value < UINT8_MAX + 0.5))
+    {
+        return false;
+    }
 
-double nextTimeToLevelUp(int level)
-{
-    // return 0.1;
-    return powf(level, 0.5f) * 10.0;
+    *ticks = (uint8_t)(value + 0.5);
+    return true;
 }
 
-GridPiece dequeueNextPiece()
+int main(int argc, char **argv)
 {
-    Piece piece = nextPieces[0];
+    ALLOC_PHASE(ALLOC_PHASE_STARTUP);
+
+    const char *botPath = NULL;
+    const char *botLogPath = NULL;
+    const char *recordPath = NULL;
+    const char *playPath = NULL;
+    const char *versusHost = NULL;
+    const char *versusJoin = NULL;
+    double botBudget = 0;
+    double rewindSeconds = 0;
+    double versusLatency = -1;
+    int spectatePort = 0;
+    const char *shmName = NULL;
+    const char *tracePath = NULL;
+    const char *hitchDirectory = ".";
+    double hitchMilliseconds = HITCH_DEFAULT_MILLISECONDS;
+    int metricsPort = 0;
+    GameHandling handling = GAME_DEFAULT_HANDLING;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--bot") == 0 && i + 1 < argc)
+        {
+            botPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--bot-budget") == 0 && i + 1 < argc)
+        {
+            botBudget = atof(argv[++i]) / 1000.0;
+        }
+        else if (strcmp(argv[i], "--bot-log") == 0 && i + 1 < argc)
+        {
+            botLogPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+        {
+            recordPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--play") == 0 && i + 1 < argc)
+        {
+            playPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--rewind") == 0 && i + 1 < argc)
+        {
+            rewindSeconds = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--versus-host") == 0 && i + 1 < argc)
+        {
+            versusHost = argv[++i];
+        }
+        else if (strcmp(argv[i], "--versus-join") == 0 && i + 1 < argc && strchr(argv[i + 1], ':') != NULL)
+        {
+            versusJoin = argv[++i];
+        }
+        else if (strcmp(argv[i], "--versus-loopback") == 0 && i + 1 < argc)
+        {
+            versusLatency = atof(argv[++i]) / 1000.0;
+        }
+        else if (strcmp(argv[i], "--spectate-port") == 0 && i + 1 < argc)
+        {
+            spectatePort = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--shm") == 0 && i + 1 < argc && argv[i + 1][0] == '/')
+        {
+            shmName = argv[++i];
+        }
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+        {
+            tracePath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--hitch-ms") == 0 && i + 1 < argc)
+        {
+            hitchMilliseconds = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--hitch-dir") == 0 && i + 1 < argc)
+        {
+            hitchDirectory = argv[++i];
+        }
+        else if (strcmp(argv[i], "--metrics-port") == 0 && i + 1 < argc)
+        {
+            metricsPort = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--das") == 0 && i + 1 < argc && parseHandlingTicks(argv[i + 1], &handling.das))
+        {
+            i++;
+        }
+        else if (strcmp(argv[i], "--arr") == 0 && i + 1 < argc && parseHandlingTicks(argv[i + 1], &handling.arr))
+        {
+            i++;
+        }
+        else if (strcmp(argv[i], "--sdf") == 0 && i + 1 < argc && atoi(argv[i + 1]) >= 1 && atoi(argv[i + 1]) <= UINT8_MAX)
+        {
+            handling.softDropFactor = atoi(argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--bot <plugin.so>] [--bot-budget <milliseconds>] [--bot-log <file.csv>] [--record <replay.trp>] [--play <replay.trp>] [--rewind <seconds>] [--spectate-port <port>] [--shm </name>] [--trace <file.json>] [--hitch-ms <milliseconds>] [--hitch-dir <directory>] [--metrics-port <port>] [--das <milliseconds>] [--arr <milliseconds>] [--sdf <factor>]\n"
+                            "       %s --versus-host <port> | --versus-join <host:port> | --versus-loopback <milliseconds>\n",
+                    argv[0], argv[0]);
+            return 1;
+        }
+    }
 
-    for (size_t i = 0; i < NEXT_PIECES_COUNT - 1; i++)
+#ifdef TRACE_ENABLED
+    traceSetThreadName("main");
+#else
+    if (tracePath != NULL)
     {
-        nextPieces[i] = nextPieces[i + 1];
+        fprintf(stderr, "--trace needs a build with TRACE_ENABLED defined\n");
+        return 1;
     }
+#endif
 
-    nextPieces[NEXT_PIECES_COUNT - 1] = makeRandomPiece();
+    bool versusEnabled = versusHost != NULL || versusJoin != NULL || versusLatency >= 0;
 
-    return (GridPiece){
-        .data = piece,
-        .orientation = ORIENTATION_NORMAL,
-        .origin = (Vector2){
-            .x = w / 2 - 1,
-            .y = 0,
-        },
-    };
-}
+    // Both sides of a match play with GAME_DEFAULT_HANDLING, nothing else is agreed on.
+    if (versusEnabled && (botPath != NULL || recordPath != NULL || playPath != NULL || rewindSeconds > 0 ||
+                          memcmp(&handling, &GAME_DEFAULT_HANDLING, sizeof(handling)) != 0))
+    {
+        fprintf(stderr, "versus cannot be combined with other modes\n");
+        return 1;
+    }
 
-void drawGrid(const Vector2 origin, const Vector2 blockSize, const Block grid[w * h])
-{
-    for (size_t i = 0; i < w * h; i++)
+    if (versusHost != NULL)
     {
-        const Vector2 gridCoordinate = (Vector2){
-            .x = i % w,
-            .y = i / w,
-        };
+        if (!netListen(&versusTransport, atoi(versusHost)))
+        {
+            return 1;
+        }
+
+        netplayHost(&versus, &versusTransport, (uint64_t)time(NULL), NETPLAY_INPUT_DELAY);
+    }
+    else if (versusJoin != NULL)
+    {
+        const char *port = strrchr(versusJoin, ':');
+
+        if (!netConnect(&versusTransport, TextFormat("%.*s", (int)(port - versusJoin), versusJoin), atoi(port + 1)))
+        {
+            return 1;
+        }
+
+        netplayJoin(&versus, &versusTransport, NETPLAY_INPUT_DELAY);
+    }
+    else if (versusLatency >= 0)
+    {
+        netLoopbackInit(&versusLoopback, versusLatency, versusLatency * VERSUS_LOOPBACK_JITTER, VERSUS_LOOPBACK_LOSS, (uint64_t)time(NULL));
+        netLoopbackTransport(&versusTransport, &versusLoopback, 0);
+        netLoopbackTransport(&sparringTransport, &versusLoopback, 1);
+        netplayHost(&versus, &versusTransport, (uint64_t)time(NULL), NETPLAY_INPUT_DELAY);
+        netplayJoin(&sparring, &sparringTransport, 0);
+        sparringEnabled = true;
+    }
+
+    // A replay cannot express going back in time, and a bot reads the game while it changes.
+    if (rewindSeconds > 0 && (recordPath != NULL || botPath != NULL))
+    {
+        fprintf(stderr, "--rewind cannot be combined with --record or --bot\n");
+        return 1;
+    }
 
-        const Vector2 coordinates = Vector2Add(
-            Vector2Multiply(gridCoordinate, blockSize),
-            origin);
+    Rewind rewind = {0};
 
-        if (isBlockInGrid(grid, gridCoordinate))
+    if (rewindSeconds > 0)
+    {
+        if (!rewindInit(&rewind, rewindSeconds))
         {
-            DrawRectangleV(coordinates, blockSize, grid[i].color);
+            fprintf(stderr, "cannot allocate %.0f seconds of rewind\n", rewindSeconds);
+            return 1;
         }
 
-        DrawRectangleLines(coordinates.x, coordinates.y, blockSize.x, blockSize.y, BLACK);
+        printf("rewind: %.0f seconds in %zu KiB\n", rewindSeconds, rewindMemory(&rewind) / 1024);
     }
-}
 
-void initState()
-{
-    score = 0;
-    dead = false;
-    initGrid();
-    savedThisPiece = false;
+    SpectateServer spectateServer = {0};
 
-    free(savedPiece);
-    savedPiece = NULL;
+    if (spectatePort != 0 && !spectateServerOpen(&spectateServer, spectatePort))
+    {
+        return 1;
+    }
 
-    for (size_t i = 0; i < NEXT_PIECES_COUNT; ++i)
+    ShmRingWriter shmWriter = {0};
+
+    if (shmName != NULL && !shmRingWriterOpen(&shmWriter, shmName))
     {
-        nextPieces[i] = makeRandomPiece();
+        return 1;
     }
 
-    piece = dequeueNextPiece();
-}
+    if (!flightRecorderOpen(&flight, hitchDirectory, hitchMilliseconds / 1000.0))
+    {
+        return 1;
+    }
 
-int main(void)
-{
-    InitWindow(defaultScreenWidth, defaultScreenHeight, "raylib [core] example - basic window");
-    SetTargetFPS(60);
+    metricsInit(&metrics);
+    MetricsServer metricsServer = {0};
 
-    srand(time(NULL));
+    if (metricsPort != 0 && !metricsServerOpen(&metricsServer, &metrics, metricsPort))
+    {
+        return 1;
+    }
 
-    double lastPhysics = GetTime();
-    double lastMovement = GetTime();
+    if (botPath != NULL)
+    {
+        if (botLogPath != NULL && !botHostOpenLog(&botPlayer.host, botLogPath))
+        {
+            return 1;
+        }
 
-    double timeToLevelUp = nextTimeToLevelUp(level);
-    double lastLevelUp = GetTime();
+        botEnabled = botHostLoad(&botPlayer.host, botPath, botBudget);
 
-    GameState gameState = GAME_STATE_MAIN_MENU;
+        if (!botEnabled)
+        {
+            return 1;
+        }
+    }
+
+    unsigned char *replayData = NULL;
+
+    if (playPath != NULL)
+    {
+        int replaySize = 0;
+        replayData = LoadFileData(playPath, &replaySize);
+
+        if (replayData == NULL || !replayPlayerOpen(&replayPlayer, replayData, replaySize))
+        {
+            return 1;
+        }
+    }
+
+    InitWindow(defaultScreenWidth, defaultScreenHeight, "raylib [core] example - basic window");
+    SetTargetFPS(TARGET_FPS);
+    perfCountDrawCalls();
+    inputSamplerInstall(&inputSampler, simInputSink, NULL);
+
+    double nextTick = GetTime();
+    GameInput pendingInput = 0;
+    ReplayRecorder recorder = {0};
+    // What the last running frame took from the simulation thread's snapshots.
+    TetrisCounters simCounters = {0};
+    uint32_t simGamesOver = 0;
+    double nextFrame = 0;
+
+    GameState gameState = playPath != NULL ? GAME_STATE_REPLAY : versusEnabled ? GAME_STATE_VERSUS : GAME_STATE_MAIN_MENU;
 
     float lastHeight = 0;
     float lastWidth = 0;
 
-    RenderTexture2D target;
+    RenderTexture2D target = {0};
 
     SetExitKey(KEY_NULL);
 
     while (!WindowShouldClose())
     {
+        TRACE_SCOPE("frame");
+        ALLOC_PHASE(ALLOC_PHASE_FRAME_START);
+
+#ifdef TRACE_ENABLED
+        if (tracePath != NULL && inputKeyPressed(&inputSampler, KEY_F4))
+        {
+            traceWrite(tracePath);
+        }
+#endif
+
         float height = GetScreenHeight();
         float width = GetScreenWidth();
 
@@ -701,13 +1066,35 @@ int main(void)
         {
             lastHeight = height;
             lastWidth = width;
+
+            if (target.id != 0)
+            {
+                atomic_fetch_sub(&metrics.renderTargetBytes, (int64_t)target.texture.width * target.texture.height * 8);
+                UnloadRenderTexture(target);
+            }
+
             target = LoadRenderTexture(width, height);
+            // Eight bytes a pixel: RGBA color and a 24-bit depth buffer padded to 32.
+            atomic_fetch_add(&metrics.renderTargetBytes, (int64_t)target.texture.width * target.texture.height * 8);
         }
 
         if (gameState == GAME_STATE_MAIN_MENU)
         {
+            ALLOC_PHASE(ALLOC_PHASE_MENUS);
+            updateAttract(GetTime());
+
+            const Layout layout = computeLayout(width, height);
+
             BeginDrawing();
             {
+                ClearBackground(backgroundColor);
+
+                if (attractRunning)
+                {
+                    drawGame(&layout, &attractGame);
+                    DrawRectangle(0, 0, width, height, Fade(BLACK, 0.4f));
+                }
+
                 const uint16_t padding = 50;
                 const uint16_t buttonWidth = width - padding * 2;
                 const uint16_t buttonHeight = floorf(100.0 * height / defaultScreenHeight);
@@ -722,199 +1109,189 @@ int main(void)
                 GuiSetStyle(DEFAULT, TEXT_SIZE, fontSize);
                 if (GuiButton(startGameRectangle, "Play"))
                 {
-                    gameState = GAME_STATE_RUNNING;
-                    initState();
+                    attractRunning = false;
+
+                    uint64_t seed = (uint64_t)time(NULL);
+                    gameInit(&game, seed);
+                    game.handling = handling;
+                    rewindClear(&rewind);
+                    flightRecorderReset(&flight, &game);
+                    metricsGameStart(&metrics, &game);
+
+                    if (recordPath != NULL)
+                    {
+                        replayRecorderOpen(&recorder, recordPath, seed, handling);
+                    }
+
+                    if (simStart(&rewind, &recorder, &spectateServer, &shmWriter))
+                    {
+                        gameState = GAME_STATE_RUNNING;
+
+                        // Frames are paced by sampling input until the next one is due.
+                        SetTargetFPS(0);
+                        nextFrame = inputNow();
+                        inputClearPresses(&inputSampler);
+                    }
+                    else
+                    {
+                        fprintf(stderr, "cannot start the simulation thread\n");
+                    }
                 }
             }
-            EndDrawing();
+            endDrawing();
         }
-        else if (gameState == GAME_STATE_RUNNING || gameState == GAME_STATE_PAUSED)
+        else if (gameState == GAME_STATE_REPLAY)
         {
-            double now = GetTime();
+            ALLOC_PHASE(ALLOC_PHASE_MENUS);
+            updateReplayViewer(GetFrameTime());
+
+            const float controlsHeight = floorf(40.0 * height / defaultScreenHeight);
+            const Layout layout = computeLayout(width, height - controlsHeight);
 
-            if (!dead && IsKeyPressed(KEY_ESCAPE))
+            BeginDrawing();
             {
-                gameState = gameState == GAME_STATE_RUNNING ? GAME_STATE_PAUSED : GAME_STATE_RUNNING;
-                lastMovement = now;
-                lastPhysics = now;
-                lastLevelUp = now;
+                ClearBackground(backgroundColor);
+                drawGame(&layout, &replayPlayer.current.game);
+
+                GuiSetStyle(DEFAULT, TEXT_SIZE, layout.fontSize / 2);
+                drawReplayControls((Rectangle){0, height - controlsHeight, width, controlsHeight}, layout.fontSize / 2);
             }
+            endDrawing();
+        }
+        else if (gameState == GAME_STATE_VERSUS)
+        {
+            ALLOC_PHASE(ALLOC_PHASE_MENUS);
+            double now = GetTime();
 
-            bool paused = gameState == GAME_STATE_PAUSED;
+            // A match cannot be paused, each side only controls its own board.
+            GameInput keyboardInput = pollKeyboardInput() & ~GAME_INPUT_PAUSE;
+            pendingInput = (pendingInput & ~GAME_INPUT_HELD_MASK) | keyboardInput;
 
-            bool canLevelUp = !dead && !paused && level < 20;
-            bool levelUp = (now - lastLevelUp) > timeToLevelUp;
-            if (canLevelUp && levelUp)
+            if (sparringEnabled)
             {
-                level++;
-                timeToLevelUp = nextTimeToLevelUp(level);
-                lastLevelUp = now;
+                updateSparring(now);
             }
 
-            bool isMovementTime = (now - lastMovement) > (1000.0 / 20.0) / (1000.0);
-            bool isPhysicsTime = (now - lastPhysics) > (1 / (0.5f + (level * 0.5)));
-
-            bool canSavePiece = !paused && !dead && !savedThisPiece;
-            bool canManualMove = !paused && !dead && isMovementTime;
+            double netStart = GetTime();
+            double rollbackTime = versus.stats.rollbackTime;
 
-            bool doApplyGravity = !paused && !dead && isPhysicsTime;
-            bool doInstantDrop = !paused && !dead && IsKeyPressed(KEY_SPACE);
-            bool doFasterDrop = !paused && !dead && IsKeyDown(KEY_S);
-            bool doRotate = !paused && !dead && IsKeyPressed(KEY_W);
-            bool doSave = canSavePiece && IsKeyDown(KEY_Q);
+            netplayPoll(&versus, now);
 
-            if (!paused && IsKeyPressed(KEY_R))
+            for (int ticks = 0; nextTick <= now && ticks < MAX_TICKS_PER_FRAME; ticks++)
             {
-                initState();
-            }
-
-            if (doSave)
-            {
-                if (savedPiece != NULL)
+                if (!netplayReady(&versus))
                 {
-                    *savedPiece = piece.data;
-                    piece = (GridPiece){
-                        .data = *savedPiece,
-                        .orientation = ORIENTATION_NORMAL,
-                        .origin = (Vector2){
-                            .x = w / 2 - 1,
-                            .y = 0,
-                        },
-                    };
+                    nextTick = now;
+                    break;
                 }
-                else
-                {
-                    savedPiece = malloc(sizeof(*savedPiece));
-                    memcpy(savedPiece, &piece, sizeof(*savedPiece));
-                    piece = dequeueNextPiece();
-                }
-                savedThisPiece = true;
-            }
 
-            if (doRotate)
-            {
-                rotatePiece(grid, &piece);
-            }
-
-            if (canManualMove)
-            {
-                movePieceToSides(grid, &piece);
-                lastMovement = now;
+                netplayAdvance(&versus, pendingInput);
+                pendingInput &= GAME_INPUT_HELD_MASK;
+                nextTick += 1.0 / GAME_TICKS_PER_SECOND;
             }
 
-            HitResult result = NO_HIT;
-            if (doInstantDrop)
-            {
-                while (result == NO_HIT)
-                {
-                    result = applyGravity(grid, &piece);
-                    score += 20 * level;
-                }
-                lastPhysics = now;
-            }
-            else if (doFasterDrop && canManualMove)
-            {
-                result = applyGravity(grid, &piece);
-                score += 10 * level;
-                lastPhysics = now;
-            }
-            else if (doApplyGravity)
+            if (nextTick < now)
             {
-                result = applyGravity(grid, &piece);
-                lastPhysics = now;
+                nextTick = now;
             }
 
-            if (result == HIT)
-            {
-                GridPieceParts parts = constructGridPieceParts(&piece);
-                for (size_t i = 0; i < PIECE_PARTS_COUNT_1D; ++i)
-                {
-                    Vector2 partCoordinates = parts.coordinates[i];
+            netplaySend(&versus, now);
 
-                    int index = gridIndexFromCoordinate(partCoordinates);
-                    grid[index] = (Block){
-                        .color = piece.data.color,
-                    };
-                }
+            double netTime = GetTime() - netStart;
+            rollbackTime = versus.stats.rollbackTime - rollbackTime;
 
-                LinesResult linesResult = checkLines(grid, &piece);
+            // Two boards side by side, each scaled down to fit half the window.
+            const float boardHeight = height * 0.7f;
+            const Layout layout = computeLayout(width / 2, boardHeight);
+            const uint8_t statsFontSize = layout.fontSize * 2 / 3;
 
-                uint8_t numberOfLines = 0;
-                int start = -1;
+            BeginDrawing();
+            {
+                ClearBackground(backgroundColor);
 
-                for (size_t i = 0; i < PIECE_PARTS_COUNT_1D; ++i)
+                for (int side = 0; side < 2; side++)
                 {
-                    if (linesResult.destroyed[i])
+                    const Layout sideLayout = offsetLayout(layout, side * width / 2);
+                    drawGame(&sideLayout, netplayBoard(&versus, side));
+
+                    if (side == versus.local)
                     {
-                        numberOfLines++;
-                        start = MAX(start, piece.origin.y + i);
+                        DrawText("You", sideLayout.savedPieceStart.x, boardHeight, layout.fontSize, BLACK);
                     }
                 }
 
-                if (numberOfLines > 0)
+                const char *status = versus.status == NETPLAY_CONNECTING ? "Waiting for the other player"
+                                     : versus.status == NETPLAY_DESYNCED ? TextFormat("Desynced at tick %u", versus.desyncedAt)
+                                                                         : NULL;
+
+                if (status != NULL)
                 {
-                    applyGravityToBlocks(grid, start, numberOfLines);
-                    uint16_t scores[] = {100, 300, 500, 800};
-                    score += scores[numberOfLines - 1] * level;
+                    DrawText(status, layout.fontSize, height / 2, layout.fontSize, RED);
                 }
 
-                piece = dequeueNextPiece();
-                savedThisPiece = false;
-                result = checkCollisions(grid, &piece);
+                drawVersusStats((Vector2){layout.fontSize, boardHeight + layout.fontSize * 1.5f}, statsFontSize, rollbackTime, netTime);
             }
+            endDrawing();
+        }
+        else if (gameState == GAME_STATE_RUNNING || gameState == GAME_STATE_PAUSED)
+        {
+#ifdef ALLOC_TRACKING
+            allocForbid(++allocRunningFrames > ALLOC_WARMUP_FRAMES);
+#endif
+            ALLOC_PHASE(ALLOC_PHASE_SIM);
+            double now = GetTime();
+            const uint32_t drawCallsBefore = perfDrawCalls;
+            const uint32_t verticesBefore = perfVertices;
 
-            if (result == GAME_OVER)
-            {
-                dead = true;
-            }
+            // Key events that did not fit in the queue while sampling.
+            inputFlush(&inputSampler);
 
-            GridPiece ghostPiece;
+            const SimSnapshot *snapshot = &sim.snapshots[tripleBufferAcquire(&sim.buffer)];
+            const Game *shown = &snapshot->game;
 
-            if (result == NO_HIT)
+            metricsBotDecisions(&metrics, METRICS_BOT_HINTS, &hintHost);
+
+            gameState = shown->paused ? GAME_STATE_PAUSED : GAME_STATE_RUNNING;
+            bool paused = shown->paused;
+            bool dead = shown->dead;
+
+            if (inputKeyPressed(&inputSampler, KEY_H) && !paused)
             {
-                ghostPiece = piece;
+                hintsEnabled = !hintsEnabled;
+                hasHint = false;
+                hintRequested = false;
 
-                while (applyGravity(grid, &ghostPiece) == NO_HIT)
+                if (hintsEnabled && !hintHost.started)
                 {
-                    ;
+#ifdef ALLOC_TRACKING
+                    // Starting the hint bot's thread allocates, once.
+                    bool forbidden = allocForbid(false);
+#endif
+                    hintsEnabled = botHostStart(&hintHost, botBuiltinInterface(), 0.25);
+#ifdef ALLOC_TRACKING
+                    allocForbid(forbidden);
+#endif
                 }
-
-                ghostPiece.data.color.a = piece.data.color.a * 0.3;
             }
 
-            uint16_t paddingTop = (int)floorf(10.0 / defaultScreenHeight * height);
-            uint16_t paddingSides = (int)floorf(15.0 / defaultScreenHeight * height);
-            uint16_t paddingComponents = (int)floorf(20.0 / defaultScreenHeight * height);
-            uint8_t blockSize = (int)floorf(28.0 / defaultScreenHeight * height);
-            uint16_t gridWidth = blockSize * w;
-            uint16_t gridStartX = paddingSides + ((width - paddingSides * 2) / 2 - (gridWidth / 2));
-
-            const Vector2 savedPieceStart = {
-                .x = gridStartX - paddingComponents - blockSize * PIECE_PARTS_COUNT_1D,
-                .y = paddingTop,
-            };
-
-            const Vector2 gridStart = {
-                .x = gridStartX,
-                .y = paddingTop,
-            };
-
-            const Vector2 nextPiecesStart = {
-                .x = gridStartX + gridWidth + paddingComponents,
-                .y = paddingTop,
-            };
-
-            const Vector2 scoreLevelStart = {
-                .x = nextPiecesStart.x,
-                .y = nextPiecesStart.y + paddingComponents + blockSize * PIECE_PARTS_COUNT_1D * NEXT_PIECES_COUNT,
-            };
+            if (inputKeyPressed(&inputSampler, KEY_F3) && !paused)
+            {
+                perfHudEnabled = !perfHudEnabled;
+            }
 
-            const Vector2 blockSizes = {
-                .x = blockSize,
-                .y = blockSize,
-            };
+            if (hintsEnabled)
+            {
+                updateHint(shown);
+            }
 
-            uint8_t fontSize = (int)floorf(28.0 / defaultScreenHeight * height);
+            const double simEnd = GetTime();
+            ALLOC_PHASE(ALLOC_PHASE_LAYOUT);
+            const Layout layout = computeLayout(width, height);
+            const uint8_t fontSize = layout.fontSize;
+            const double layoutEnd = GetTime();
+            ALLOC_PHASE(ALLOC_PHASE_DRAW);
+            bool hudDrawn = false;
+            PerfFrame frameStats = {0};
 
             BeginDrawing();
             {
@@ -925,60 +1302,155 @@ int main(void)
 
                 ClearBackground(backgroundColor);
 
-                drawGridPiece(gridStart, blockSizes, &piece);
-                if (result == NO_HIT)
+                drawGame(&layout, shown);
+
+                if (hintsEnabled && hasHint && !dead)
                 {
-                    drawGridPiece(gridStart, blockSizes, &ghostPiece);
+                    drawGridPiece(layout.gridStart, layout.blockSizes, &hintPiece);
                 }
 
-                for (size_t i = 0; i < NEXT_PIECES_COUNT; i++)
+                const Vector2 levelCoordinates = (Vector2){
+                    .x = layout.scoreLevelStart.x,
+                    .y = layout.scoreLevelStart.y + fontSize,
+                };
+
+                if (botEnabled)
                 {
-                    drawNextPiece(nextPiecesStart, i, blockSizes, paddingTop, nextPieces[i]);
+                    const BotHost *host = &botPlayer.host;
+                    const uint8_t botFontSize = fontSize / 2;
+
+                    DrawText(TextFormat("Bot: %s", host->interface->name), levelCoordinates.x, levelCoordinates.y + fontSize * 2, botFontSize, BLACK);
+                    DrawText(TextFormat("p50 %.2f ms  p99 %.2f ms", snapshot->botP50 * 1000.0, snapshot->botP99 * 1000.0),
+                             levelCoordinates.x, levelCoordinates.y + fontSize * 2 + botFontSize, botFontSize, BLACK);
+                    DrawText(TextFormat("Timeouts: %u / %u", snapshot->botTimeouts, snapshot->botDecisions), levelCoordinates.x, levelCoordinates.y + fontSize * 2 + botFontSize * 2, botFontSize, BLACK);
                 }
 
-                if (savedPiece != NULL)
+                if (spectatePort != 0)
                 {
-                    drawSavedPiece(savedPieceStart, blockSizes, *savedPiece);
+                    DrawText(TextFormat("Spectators: %u", atomic_load(&spectateServer.viewers)), levelCoordinates.x, levelCoordinates.y + fontSize, fontSize / 2, BLACK);
                 }
 
-                drawGrid(gridStart, blockSizes, grid);
-
-                if (dead)
+                if (rewind.ticks != NULL)
                 {
-                    const char *restartText = "You die!";
-                    const Vector2 restartTextSize = MeasureTextEx(GetFontDefault(), restartText, fontSize, 10);
-
-                    DrawText(restartText, gridStart.x + 5, gridStart.y, fontSize, RED);
-                    DrawText("Press R to restart", gridStart.x + 5, gridStart.y + restartTextSize.y, fontSize, RED);
+                    DrawText(TextFormat("Rewind: %.1f s", snapshot->rewindSeconds), levelCoordinates.x, levelCoordinates.y + fontSize * 2, fontSize / 2, snapshot->rewinding ? RED : BLACK);
                 }
 
-                const Vector2 scoreCoordinates = (Vector2){
-                    .x = scoreLevelStart.x,
-                    .y = scoreLevelStart.y,
-                };
-
-                DrawText(TextFormat("Score: %08i", score), scoreCoordinates.x, scoreCoordinates.y, fontSize, BLACK);
-
-                const Vector2 levelCoordinates = (Vector2){
-                    .x = scoreLevelStart.x,
-                    .y = scoreLevelStart.y + fontSize,
-                };
-
-                DrawText(TextFormat("Level: %02i", level), levelCoordinates.x, levelCoordinates.y, fontSize, BLACK);
-
                 if (paused)
                 {
                     EndTextureMode();
                     DrawTextureRec(target.texture, (Rectangle){0, 0, (float)target.texture.width, (float)-target.texture.height}, Vector2Zero(), GRAY);
                     DrawText("Paused", width / 2, height / 2, fontSize, RED);
                 }
+                else if (perfHudEnabled)
+                {
+                    // Sends the game's batch now, so the overlay's own draw calls are left out.
+                    rlDrawRenderBatchActive();
+                    frameStats.drawCalls = perfDrawCalls - drawCallsBefore;
+                    frameStats.vertices = perfVertices - verticesBefore;
+                    frameStats.seconds[PERF_TIMING_DRAW] = GetTime() - layoutEnd;
+                    hudDrawn = true;
+
+                    drawPerfHud((Vector2){fontSize / 2, layout.savedPieceStart.y + layout.blockSizes.y * (PIECE_PARTS_COUNT_1D + 1)}, fontSize / 2, now);
+                }
+            }
+
+            const double drawEnd = GetTime();
+            ALLOC_PHASE(ALLOC_PHASE_PRESENT);
+            endDrawing();
+
+            // The wait for the next frame, which raylib would have slept through.
+            nextFrame = fmax(nextFrame + 1.0 / TARGET_FPS, inputNow());
+            inputSampleUntil(&inputSampler, nextFrame);
+            const double end = GetTime();
+
+            if (snapshot->gamesOver != simGamesOver)
+            {
+                simGamesOver = snapshot->gamesOver;
+                metricsObserve(&metrics.gameOverSeconds, simNow() - snapshot->gameOverTick);
+            }
+
+            if (paused)
+            {
+                perfLastEnd = 0;
+            }
+            else
+            {
+                if (!hudDrawn)
+                {
+                    frameStats.drawCalls = perfDrawCalls - drawCallsBefore;
+                    frameStats.vertices = perfVertices - verticesBefore;
+                    frameStats.seconds[PERF_TIMING_DRAW] = drawEnd - layoutEnd;
+                }
+
+                frameStats.end = end;
+                frameStats.seconds[PERF_TIMING_FRAME] = end - (perfLastEnd > 0 ? perfLastEnd : now);
+                frameStats.seconds[PERF_TIMING_SIM] = simEnd - now;
+                frameStats.seconds[PERF_TIMING_LAYOUT] = layoutEnd - simEnd;
+                frameStats.seconds[PERF_TIMING_PRESENT] = end - drawEnd;
+                frameStats.collisionChecks = snapshot->counters.collisionChecks - simCounters.collisionChecks;
+                frameStats.gravitySteps = snapshot->counters.gravitySteps - simCounters.gravitySteps;
+                perfRecord(&perfRing, &frameStats);
+                perfLastEnd = end;
+
+                // The flight recorder keeps frames next to the ticks they showed, on the
+                // simulation thread. A frame that does not fit in the queue goes unrecorded.
+                SimMessage frameMessage = {.type = SIM_MESSAGE_FRAME, .frame = frameStats};
+                simQueuePush(&sim.queue, &frameMessage);
             }
 
-            EndDrawing();
+            simCounters = snapshot->counters;
+
+#ifdef ALLOC_TRACKING
+            allocForbid(false);
+#endif
         }
     }
 
+    ALLOC_PHASE(ALLOC_PHASE_SHUTDOWN);
+
+    simStop();
+
+    if (botEnabled)
+    {
+        botHostStop(&botPlayer.host);
+    }
+
+    botHostStop(&hintHost);
+    botHostStop(&attractPlayer.host);
+    botHostStop(&sparringPlayer.host);
+    netClose(&versusTransport);
+
+    replayRecorderClose(&recorder, &game);
+    replayPlayerClose(&replayPlayer);
+    UnloadFileData(replayData);
+    rewindFree(&rewind);
+    spectateServerClose(&spectateServer);
+    shmRingWriterClose(&shmWriter);
+    flightRecorderClose(&flight);
+    metricsServerClose(&metricsServer);
+
+#ifdef TRACE_ENABLED
+    if (tracePath != NULL)
+    {
+        traceWrite(tracePath);
+    }
+#endif
+
+    if (target.id != 0)
+    {
+        UnloadRenderTexture(target);
+    }
+
     CloseWindow();
 
+#ifdef ALLOC_TRACKING
+    allocReport(stderr);
+
+    if (allocViolations() > 0)
+    {
+        return 1;
+    }
+#endif
+
     return 0;
-}
\ No newline at end of file
+}
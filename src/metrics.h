@@ -0,0 +1,420 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "bothost.h"
+#include "tetris.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Counters and histograms for central monitoring, served over HTTP on localhost in the Prometheus
+// text format.
+//
+// The game thread updates them with relaxed atomic adds and never waits. The server runs on its
+// own thread, reads them when scraped and answers one request at a time, which is all a scraper
+// on the same machine needs.
+
+#define METRICS_MAX_BUCKETS 12
+// Largest response, everything below fits several times over.
+#define METRICS_RESPONSE_SIZE (16 * 1024)
+// How long a client gets to send its request.
+#define METRICS_READ_TIMEOUT 1.0
+// How often the server thread checks it should stop.
+#define METRICS_POLL_INTERVAL 100
+
+typedef struct MetricsHistogram
+{
+    const double *bounds; // upper bounds in seconds, ascending
+    size_t boundCount;
+    _Atomic uint64_t buckets[METRICS_MAX_BUCKETS + 1]; // the last one is above every bound
+    _Atomic uint64_t nanoseconds;                      // sum of the observations
+} MetricsHistogram;
+
+typedef enum MetricsBot
+{
+    METRICS_BOT_PLAYER = 0, // --bot
+    METRICS_BOT_HINTS,
+    METRICS_BOT_COUNT,
+} MetricsBot;
+
+typedef struct Metrics
+{
+    _Atomic uint64_t framesRendered;
+    _Atomic uint64_t ticks;
+    _Atomic uint64_t piecesLocked;
+    _Atomic uint64_t linesCleared;
+    _Atomic uint64_t gamesPlayed;
+    _Atomic int64_t renderTargetBytes;
+
+    MetricsHistogram frameSeconds;
+    MetricsHistogram gameOverSeconds; // from the tick that ended a game to the frame showing it
+    MetricsHistogram botDecisionSeconds[METRICS_BOT_COUNT];
+
+    // What the game thread saw last, only it touches these.
+    uint32_t lastPiecesLocked;
+    uint32_t lastLines;
+    uint32_t lastGames;
+    bool lastDead;
+    uint32_t botDecisionsSeen[METRICS_BOT_COUNT];
+} Metrics;
+
+typedef struct MetricsServer
+{
+    const Metrics *metrics;
+    int listener;
+    atomic_bool running;
+    pthread_t thread;
+} MetricsServer;
+
+void metricsInit(Metrics *metrics);
+void metricsObserve(MetricsHistogram *histogram, double seconds);
+// A game started from the menu.
+void metricsGameStart(Metrics *metrics, const Game *game);
+// Counts the gameStep that just ran on game. Returns true when it ended the game.
+bool metricsGameTick(Metrics *metrics, const Game *game);
+// Observes the decisions host made since the last call.
+void metricsBotDecisions(Metrics *metrics, MetricsBot bot, const BotHost *host);
+// Writes the exposition text, returns its length.
+size_t metricsFormat(const Metrics *metrics, char *buffer, size_t size);
+
+// Listens on 127.0.0.1 only.
+bool metricsServerOpen(MetricsServer *server, const Metrics *metrics, uint16_t port);
+void metricsServerClose(MetricsServer *server);
+
+#endif // METRICS_H
+
+#if defined(METRICS_IMPLEMENTATION) && !defined(METRICS_IMPLEMENTED)
+#define METRICS_IMPLEMENTED
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static const double metricsFrameBounds[] = {0.004, 0.008, 0.0125, 0.0167, 0.02, 0.025, 0.0333, 0.05, 0.1, 0.25, 0.5, 1};
+static const double metricsGameOverBounds[] = {0.004, 0.008, 0.0167, 0.0333, 0.05, 0.1, 0.25, 0.5, 1};
+static const double metricsBotBounds[] = {0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5};
+static const char *metricsBotNames[METRICS_BOT_COUNT] = {"player", "hints"};
+
+#define METRICS_BOUNDS(bounds) (bounds), sizeof(bounds) / sizeof((bounds)[0])
+
+_Static_assert(sizeof(metricsFrameBounds) / sizeof(double) <= METRICS_MAX_BUCKETS, "too many frame buckets");
+_Static_assert(sizeof(metricsGameOverBounds) / sizeof(double) <= METRICS_MAX_BUCKETS, "too many game over buckets");
+_Static_assert(sizeof(metricsBotBounds) / sizeof(double) <= METRICS_MAX_BUCKETS, "too many bot buckets");
+
+static void metricsHistogramInit(MetricsHistogram *histogram, const double *bounds, size_t boundCount)
+{
+    histogram->bounds = bounds;
+    histogram->boundCount = boundCount;
+}
+
+void metricsInit(Metrics *metrics)
+{
+    memset(metrics, 0, sizeof(*metrics));
+
+    metricsHistogramInit(&metrics->frameSeconds, METRICS_BOUNDS(metricsFrameBounds));
+    metricsHistogramInit(&metrics->gameOverSeconds, METRICS_BOUNDS(metricsGameOverBounds));
+
+    for (MetricsBot bot = 0; bot < METRICS_BOT_COUNT; bot++)
+    {
+        metricsHistogramInit(&metrics->botDecisionSeconds[bot], METRICS_BOUNDS(metricsBotBounds));
+    }
+}
+
+void metricsObserve(MetricsHistogram *histogram, double seconds)
+{
+    size_t bucket = 0;
+
+    while (bucket < histogram->boundCount && seconds > histogram->bounds[bucket])
+    {
+        bucket++;
+    }
+
+    atomic_fetch_add_explicit(&histogram->buckets[bucket], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->nanoseconds, (uint64_t)(seconds > 0 ? seconds * 1e9 : 0), memory_order_relaxed);
+}
+
+void metricsGameStart(Metrics *metrics, const Game *game)
+{
+    atomic_fetch_add_explicit(&metrics->gamesPlayed, 1, memory_order_relaxed);
+
+    metrics->lastPiecesLocked = game->piecesLocked;
+    metrics->lastLines = game->lines;
+    metrics->lastGames = game->games;
+    metrics->lastDead = game->dead;
+}
+
+bool metricsGameTick(Metrics *metrics, const Game *game)
+{
+    atomic_fetch_add_explicit(&metrics->ticks, 1, memory_order_relaxed);
+
+    // Counts only go forward. A restart zeroes the lines and a rewind takes back pieces, neither
+    // is counted as anything.
+    int32_t pieces = (int32_t)(game->piecesLocked - metrics->lastPiecesLocked);
+    int32_t lines = (int32_t)(game->lines - metrics->lastLines);
+    int32_t games = (int32_t)(game->games - metrics->lastGames);
+
+    if (pieces > 0)
+    {
+        atomic_fetch_add_explicit(&metrics->piecesLocked, pieces, memory_order_relaxed);
+    }
+
+    if (lines > 0 && games == 0)
+    {
+        atomic_fetch_add_explicit(&metrics->linesCleared, lines, memory_order_relaxed);
+    }
+
+    if (games > 0)
+    {
+        atomic_fetch_add_explicit(&metrics->gamesPlayed, games, memory_order_relaxed);
+    }
+
+    bool ended = game->dead && !metrics->lastDead;
+
+    metrics->lastPiecesLocked = game->piecesLocked;
+    metrics->lastLines = game->lines;
+    metrics->lastGames = game->games;
+    metrics->lastDead = game->dead;
+
+    return ended;
+}
+
+void metricsBotDecisions(Metrics *metrics, MetricsBot bot, const BotHost *host)
+{
+    uint32_t seen = metrics->botDecisionsSeen[bot];
+
+    if (host->decisions - seen > BOT_HOST_LATENCY_SAMPLES)
+    {
+        seen = host->decisions - BOT_HOST_LATENCY_SAMPLES;
+    }
+
+    for (; seen != host->decisions; seen++)
+    {
+        metricsObserve(&metrics->botDecisionSeconds[bot], host->latencies[seen % BOT_HOST_LATENCY_SAMPLES]);
+    }
+
+    metrics->botDecisionsSeen[bot] = seen;
+}
+
+typedef struct MetricsWriter
+{
+    char *buffer;
+    size_t size;
+    size_t length;
+} MetricsWriter;
+
+__attribute__((format(printf, 2, 3))) static void metricsPrint(MetricsWriter *writer, const char *format, ...)
+{
+    if (writer->length >= writer->size)
+    {
+        return;
+    }
+
+    va_list arguments;
+    va_start(arguments, format);
+    int written = vsnprintf(writer->buffer + writer->length, writer->size - writer->length, format, arguments);
+    va_end(arguments);
+
+    writer->length += written > 0 ? (size_t)written : 0;
+}
+
+static void metricsPrintCounter(MetricsWriter *writer, const char *name, const char *help, const char *type, int64_t value)
+{
+    metricsPrint(writer, "# HELP %s %s\n# TYPE %s %s\n%s %lld\n", name, help, name, type, name, (long long)value);
+}
+
+// labels is empty or like "bot=\"hints\"".
+static void metricsPrintHistogram(MetricsWriter *writer, const char *name, const char *labels, const MetricsHistogram *histogram)
+{
+    const char *comma = labels[0] != '\0' ? "," : "";
+    uint64_t count = 0;
+
+    for (size_t i = 0; i <= histogram->boundCount; i++)
+    {
+        count += atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed);
+
+        if (i < histogram->boundCount)
+        {
+            metricsPrint(writer, "%s_bucket{%s%sle=\"%g\"} %llu\n", name, labels, comma, histogram->bounds[i], (unsigned long long)count);
+        }
+        else
+        {
+            metricsPrint(writer, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, labels, comma, (unsigned long long)count);
+        }
+    }
+
+    const char *left = labels[0] != '\0' ? "{" : "";
+    const char *right = labels[0] != '\0' ? "}" : "";
+    double sum = atomic_load_explicit(&histogram->nanoseconds, memory_order_relaxed) / 1e9;
+
+    metricsPrint(writer, "%s_sum%s%s%s %.9f\n", name, left, labels, right, sum);
+    metricsPrint(writer, "%s_count%s%s%s %llu\n", name, left, labels, right, (unsigned long long)count);
+}
+
+size_t metricsFormat(const Metrics *metrics, char *buffer, size_t size)
+{
+    MetricsWriter writer = {.buffer = buffer, .size = size};
+
+    metricsPrintCounter(&writer, "tetris_frames_rendered_total", "Frames drawn, in every screen.", "counter", atomic_load(&metrics->framesRendered));
+    metricsPrintCounter(&writer, "tetris_ticks_total", "Game ticks simulated.", "counter", atomic_load(&metrics->ticks));
+    metricsPrintCounter(&writer, "tetris_pieces_locked_total", "Pieces locked into the grid.", "counter", atomic_load(&metrics->piecesLocked));
+    metricsPrintCounter(&writer, "tetris_lines_cleared_total", "Lines cleared.", "counter", atomic_load(&metrics->linesCleared));
+    metricsPrintCounter(&writer, "tetris_games_played_total", "Games started, from the menu or with a restart.", "counter", atomic_load(&metrics->gamesPlayed));
+    metricsPrintCounter(&writer, "tetris_render_target_bytes", "Estimated GPU memory held by render textures, color and depth.", "gauge", atomic_load(&metrics->renderTargetBytes));
+
+    metricsPrint(&writer, "# HELP tetris_frame_seconds Time from one frame to the next.\n# TYPE tetris_frame_seconds histogram\n");
+    metricsPrintHistogram(&writer, "tetris_frame_seconds", "", &metrics->frameSeconds);
+
+    metricsPrint(&writer, "# HELP tetris_game_over_seconds Time from the tick that ended a game to the end of the frame showing it.\n# TYPE tetris_game_over_seconds histogram\n");
+    metricsPrintHistogram(&writer, "tetris_game_over_seconds", "", &metrics->gameOverSeconds);
+
+    metricsPrint(&writer, "# HELP tetris_bot_decision_seconds Time a bot took to decide on a piece.\n# TYPE tetris_bot_decision_seconds histogram\n");
+
+    for (MetricsBot bot = 0; bot < METRICS_BOT_COUNT; bot++)
+    {
+        char labels[32];
+        snprintf(labels, sizeof(labels), "bot=\"%s\"", metricsBotNames[bot]);
+        metricsPrintHistogram(&writer, "tetris_bot_decision_seconds", labels, &metrics->botDecisionSeconds[bot]);
+    }
+
+    return writer.length < size ? writer.length : size;
+}
+
+static void metricsAnswer(const MetricsServer *server, int client)
+{
+    struct timeval timeout = {
+        .tv_sec = (time_t)METRICS_READ_TIMEOUT,
+        .tv_usec = (suseconds_t)((METRICS_READ_TIMEOUT - (time_t)METRICS_READ_TIMEOUT) * 1e6),
+    };
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    // Only the request line matters, the rest of the headers are read and ignored.
+    char request[2048];
+    size_t length = 0;
+
+    while (length < sizeof(request) - 1)
+    {
+        ssize_t received = recv(client, request + length, sizeof(request) - 1 - length, 0);
+
+        if (received <= 0)
+        {
+            return;
+        }
+
+        length += received;
+        request[length] = '\0';
+
+        if (strstr(request, "\r\n\r\n") != NULL || strstr(request, "\n\n") != NULL)
+        {
+            break;
+        }
+    }
+
+    static char body[METRICS_RESPONSE_SIZE];
+    char header[256];
+    size_t bodyLength;
+    const char *status;
+
+    if (strncmp(request, "GET /metrics ", 13) == 0 || strncmp(request, "GET / ", 6) == 0)
+    {
+        status = "200 OK";
+        bodyLength = metricsFormat(server->metrics, body, sizeof(body));
+    }
+    else
+    {
+        status = "404 Not Found";
+        bodyLength = (size_t)snprintf(body, sizeof(body), "metrics are at /metrics\n");
+    }
+
+    int headerLength = snprintf(header, sizeof(header),
+                                "HTTP/1.1 %s\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+                                status, bodyLength);
+
+    if (send(client, header, headerLength, MSG_NOSIGNAL) == headerLength)
+    {
+        send(client, body, bodyLength, MSG_NOSIGNAL);
+    }
+}
+
+static void *metricsServerThread(void *argument)
+{
+    MetricsServer *server = argument;
+    struct pollfd listener = {.fd = server->listener, .events = POLLIN};
+
+    while (atomic_load(&server->running))
+    {
+        if (poll(&listener, 1, METRICS_POLL_INTERVAL) <= 0)
+        {
+            continue;
+        }
+
+        int client = accept(server->listener, NULL, NULL);
+
+        if (client >= 0)
+        {
+            metricsAnswer(server, client);
+            close(client);
+        }
+    }
+
+    return NULL;
+}
+
+bool metricsServerOpen(MetricsServer *server, const Metrics *metrics, uint16_t port)
+{
+    memset(server, 0, sizeof(*server));
+    server->metrics = metrics;
+    server->listener = socket(AF_INET, SOCK_STREAM, 0);
+
+    int reuse = 1;
+    setsockopt(server->listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+
+    if (server->listener < 0 || bind(server->listener, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(server->listener, 16) != 0)
+    {
+        perror("metrics server");
+        metricsServerClose(server);
+        return false;
+    }
+
+    atomic_store(&server->running, true);
+
+    if (pthread_create(&server->thread, NULL, metricsServerThread, server) != 0)
+    {
+        atomic_store(&server->running, false);
+        metricsServerClose(server);
+        return false;
+    }
+
+    return true;
+}
+
+void metricsServerClose(MetricsServer *server)
+{
+    if (atomic_load(&server->running))
+    {
+        atomic_store(&server->running, false);
+        pthread_join(server->thread, NULL);
+    }
+
+    if (server->listener > 0)
+    {
+        close(server->listener);
+    }
+
+    memset(server, 0, sizeof(*server));
+}
+
+#endif // METRICS_IMPLEMENTATION
@@ -0,0 +1,269 @@
+#ifndef NET_H
+#define NET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+
+// Datagram transports for versus mode: non-blocking UDP between two machines, and an in-process
+// loopback that delays, reorders and drops datagrams like a bad network, to try the netcode with
+// a single window.
+
+#define NET_MAX_DATAGRAM 512
+// Datagrams in flight in each direction of a loopback, further ones are dropped.
+#define NET_LOOPBACK_CAPACITY 256
+
+typedef struct NetLoopbackDatagram
+{
+    double deliverAt;
+    uint16_t size;
+    uint8_t data[NET_MAX_DATAGRAM];
+} NetLoopbackDatagram;
+
+// queues[side] holds the datagrams on their way to that side.
+typedef struct NetLoopback
+{
+    NetLoopbackDatagram queues[2][NET_LOOPBACK_CAPACITY];
+    size_t counts[2];
+    double latency;
+    double jitter;
+    double loss;
+    uint64_t random;
+} NetLoopback;
+
+typedef struct NetTransport
+{
+    int socket;
+    struct sockaddr_in peer;
+    bool hasPeer;
+
+    NetLoopback *loopback;
+    int side;
+} NetTransport;
+
+// Binds the port and takes the first address a datagram arrives from as the peer.
+bool netListen(NetTransport *transport, uint16_t port);
+bool netConnect(NetTransport *transport, const char *host, uint16_t port);
+// latency and jitter in seconds, loss as a fraction of datagrams.
+void netLoopbackInit(NetLoopback *loopback, double latency, double jitter, double loss, uint64_t seed);
+void netLoopbackTransport(NetTransport *transport, NetLoopback *loopback, int side);
+void netClose(NetTransport *transport);
+
+// now is only used by the loopback, for the time datagrams take.
+bool netSend(NetTransport *transport, const void *data, size_t size, double now);
+// Returns the size of the next datagram, 0 when there is none yet.
+size_t netReceive(NetTransport *transport, void *buffer, size_t capacity, double now);
+
+#endif // NET_H
+
+#if defined(NET_IMPLEMENTATION) && !defined(NET_IMPLEMENTED)
+#define NET_IMPLEMENTED
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static bool netOpenSocket(NetTransport *transport)
+{
+    memset(transport, 0, sizeof(*transport));
+    transport->socket = socket(AF_INET, SOCK_DGRAM, 0);
+
+    if (transport->socket < 0 || fcntl(transport->socket, F_SETFL, O_NONBLOCK) != 0)
+    {
+        perror("socket");
+        netClose(transport);
+        return false;
+    }
+
+    return true;
+}
+
+bool netListen(NetTransport *transport, uint16_t port)
+{
+    if (!netOpenSocket(transport))
+    {
+        return false;
+    }
+
+    struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+
+    if (bind(transport->socket, (struct sockaddr *)&address, sizeof(address)) != 0)
+    {
+        perror("bind");
+        netClose(transport);
+        return false;
+    }
+
+    return true;
+}
+
+bool netConnect(NetTransport *transport, const char *host, uint16_t port)
+{
+    if (!netOpenSocket(transport))
+    {
+        return false;
+    }
+
+    struct addrinfo hints = {
+        .ai_family = AF_INET,
+        .ai_socktype = SOCK_DGRAM,
+    };
+    struct addrinfo *result = NULL;
+    char service[8];
+    snprintf(service, sizeof(service), "%u", port);
+
+    int error = getaddrinfo(host, service, &hints, &result);
+
+    if (error != 0)
+    {
+        fprintf(stderr, "%s: %s\n", host, gai_strerror(error));
+        netClose(transport);
+        return false;
+    }
+
+    memcpy(&transport->peer, result->ai_addr, sizeof(transport->peer));
+    transport->hasPeer = true;
+    freeaddrinfo(result);
+
+    return true;
+}
+
+static double netLoopbackRandom(NetLoopback *loopback)
+{
+    loopback->random ^= loopback->random << 13;
+    loopback->random ^= loopback->random >> 7;
+    loopback->random ^= loopback->random << 17;
+    return (loopback->random >> 11) * (1.0 / 9007199254740992.0);
+}
+
+void netLoopbackInit(NetLoopback *loopback, double latency, double jitter, double loss, uint64_t seed)
+{
+    memset(loopback, 0, sizeof(*loopback));
+    loopback->latency = latency;
+    loopback->jitter = jitter;
+    loopback->loss = loss;
+    loopback->random = seed | 1;
+}
+
+void netLoopbackTransport(NetTransport *transport, NetLoopback *loopback, int side)
+{
+    memset(transport, 0, sizeof(*transport));
+    transport->socket = -1;
+    transport->loopback = loopback;
+    transport->side = side;
+}
+
+void netClose(NetTransport *transport)
+{
+    if (transport->socket >= 0 && transport->loopback == NULL)
+    {
+        close(transport->socket);
+    }
+
+    transport->socket = -1;
+}
+
+bool netSend(NetTransport *transport, const void *data, size_t size, double now)
+{
+    if (size > NET_MAX_DATAGRAM)
+    {
+        return false;
+    }
+
+    NetLoopback *loopback = transport->loopback;
+
+    if (loopback != NULL)
+    {
+        int to = 1 - transport->side;
+
+        // A lost datagram still counts as sent, as it would over UDP.
+        if (netLoopbackRandom(loopback) < loopback->loss || loopback->counts[to] == NET_LOOPBACK_CAPACITY)
+        {
+            return true;
+        }
+
+        NetLoopbackDatagram *datagram = &loopback->queues[to][loopback->counts[to]++];
+        datagram->deliverAt = now + loopback->latency + loopback->jitter * netLoopbackRandom(loopback);
+        datagram->size = size;
+        memcpy(datagram->data, data, size);
+
+        return true;
+    }
+
+    if (!transport->hasPeer)
+    {
+        return false;
+    }
+
+    ssize_t sent = sendto(transport->socket, data, size, 0, (struct sockaddr *)&transport->peer, sizeof(transport->peer));
+
+    return sent == (ssize_t)size || errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+size_t netReceive(NetTransport *transport, void *buffer, size_t capacity, double now)
+{
+    NetLoopback *loopback = transport->loopback;
+
+    if (loopback != NULL)
+    {
+        // Jitter reorders datagrams, so the earliest due one is delivered first.
+        NetLoopbackDatagram *queue = loopback->queues[transport->side];
+        size_t *count = &loopback->counts[transport->side];
+        size_t earliest = *count;
+
+        for (size_t i = 0; i < *count; i++)
+        {
+            if (queue[i].deliverAt <= now && (earliest == *count || queue[i].deliverAt < queue[earliest].deliverAt))
+            {
+                earliest = i;
+            }
+        }
+
+        if (earliest == *count)
+        {
+            return 0;
+        }
+
+        size_t size = queue[earliest].size < capacity ? queue[earliest].size : capacity;
+        memcpy(buffer, queue[earliest].data, size);
+        queue[earliest] = queue[--*count];
+
+        return size;
+    }
+
+    while (true)
+    {
+        struct sockaddr_in from;
+        socklen_t fromSize = sizeof(from);
+        ssize_t size = recvfrom(transport->socket, buffer, capacity, 0, (struct sockaddr *)&from, &fromSize);
+
+        if (size <= 0)
+        {
+            return 0;
+        }
+
+        if (!transport->hasPeer)
+        {
+            transport->peer = from;
+            transport->hasPeer = true;
+        }
+
+        // Anything from another address is not part of this match.
+        if (from.sin_addr.s_addr == transport->peer.sin_addr.s_addr && from.sin_port == transport->peer.sin_port)
+        {
+            return size;
+        }
+    }
+}
+
+#endif // NET_IMPLEMENTATION
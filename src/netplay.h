@@ -0,0 +1,489 @@
+#ifndef NETPLAY_H
+#define NETPLAY_H
+
+#include "tetris.h"
+#include "net.h"
+
+#include <stdint.h>
+
+// Versus mode with rollback: both sides simulate both boards and only exchange inputs.
+//
+// Every tick runs straight away with the remote input predicted to be the last one received, with
+// its presses dropped. When the real input turns out different, the match goes back to the state
+// saved after the tick before it and the ticks since are simulated again. A side that gets more
+// than NETPLAY_MAX_ROLLBACK ticks ahead of the inputs it has waits instead.
+//
+// Each side plays its own inputs a few ticks after they are made, NETPLAY_INPUT_DELAY for a
+// person, which hides that much latency without any rollback. Every packet carries all the local
+// inputs the peer has not acknowledged yet, so a lost packet is made up for by the next one.
+//
+// Packets, little endian, after the magic "TV" and a type byte:
+//   HELLO   from the joining side until the match starts, u8 input delay
+//   START   from the hosting side, u64 seed, u8 input delay
+//   INPUTS  u32 tick, u32 ack, u32 first, u8 count, i8 advantage, u32 checksum tick,
+//           u32 checksum, then count inputs for the ticks from first on
+//
+// ack is the last tick the sender has the peer's inputs up to. The checksum is the low 32 bits of
+// both boards' gameChecksum after the latest tick, a multiple of NETPLAY_CHECKSUM_INTERVAL, that
+// the sender has simulated with real inputs only; a mismatch means the sides desynced.
+
+#define NETPLAY_MAX_ROLLBACK 15
+#define NETPLAY_INPUT_DELAY 2
+#define NETPLAY_CHECKSUM_INTERVAL 60
+#define NETPLAY_CHECKSUMS 8
+// Ticks of inputs and snapshots kept, a power of two above what is ever unacknowledged.
+#define NETPLAY_HISTORY 64
+#define NETPLAY_INPUTS_HEADER_SIZE 25
+#define NETPLAY_PACKET_SIZE (NETPLAY_INPUTS_HEADER_SIZE + NETPLAY_HISTORY)
+
+typedef enum NetplayStatus
+{
+    NETPLAY_CONNECTING = 0,
+    NETPLAY_RUNNING,
+    NETPLAY_DESYNCED,
+} NetplayStatus;
+
+// The whole state of a match. The boards do not interact yet, but once they do through garbage
+// lines, only saving and restoring them together stays correct.
+typedef struct NetplayMatch
+{
+    Game boards[2];
+} NetplayMatch;
+
+typedef struct NetplayStats
+{
+    uint32_t rollbacks;
+    uint32_t resimulatedTicks;
+    uint32_t longestRollback;
+    uint32_t waits;
+    double rollbackTime;       // spent rolling back and simulating again, in seconds
+    double lastRollbackTime;
+    double longestRollbackTime;
+} NetplayStats;
+
+typedef struct Netplay
+{
+    NetTransport *transport;
+    NetplayStatus status;
+    int local; // 0 on the hosting side, 1 on the joining one
+    uint64_t seed;
+    uint8_t delays[2];
+
+    NetplayMatch match;
+    uint32_t tick; // ticks simulated, match is the state after them
+
+    uint8_t snapshots[NETPLAY_HISTORY][sizeof(NetplayMatch)];
+    GameInput inputs[2][NETPLAY_HISTORY]; // input of tick t at t % NETPLAY_HISTORY, predicted past received
+    uint32_t received[2];                 // ticks each side's inputs are known up to
+    uint32_t peerAck;
+    uint32_t rollbackFrom;                // first tick played with a wrong prediction, 0 for none
+    uint32_t peerTick;
+    int8_t peerAdvantage;
+    bool peerStarted;
+
+    uint32_t checksumTicks[NETPLAY_CHECKSUMS];
+    uint32_t checksums[NETPLAY_CHECKSUMS];
+    uint32_t desyncedAt;
+
+    NetplayStats stats;
+} Netplay;
+
+// The hosting side picks the seed, the joining one gets it with START. delay is the local input
+// delay in ticks, below NETPLAY_MAX_ROLLBACK.
+void netplayHost(Netplay *netplay, NetTransport *transport, uint64_t seed, uint8_t delay);
+void netplayJoin(Netplay *netplay, NetTransport *transport, uint8_t delay);
+
+// Reads every packet that arrived and rolls back if a prediction was wrong. Call once per frame.
+void netplayPoll(Netplay *netplay, double now);
+// Whether netplayAdvance can run a tick now, or has to wait for the peer's inputs.
+bool netplayReady(Netplay *netplay);
+void netplayAdvance(Netplay *netplay, GameInput input);
+// Sends the unacknowledged local inputs. Call once per frame, after the ticks.
+void netplaySend(Netplay *netplay, double now);
+
+const Game *netplayBoard(const Netplay *netplay, int side);
+
+#endif // NETPLAY_H
+
+#if defined(NETPLAY_IMPLEMENTATION) && !defined(NETPLAY_IMPLEMENTED)
+#define NETPLAY_IMPLEMENTED
+
+#include <string.h>
+#include <time.h>
+
+enum
+{
+    NETPLAY_PACKET_HELLO = 1,
+    NETPLAY_PACKET_START,
+    NETPLAY_PACKET_INPUTS,
+};
+
+static double netplayClock(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void netplayPut32(uint8_t *data, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        data[i] = value >> (8 * i);
+    }
+}
+
+static uint32_t netplayGet32(const uint8_t *data)
+{
+    return data[0] | data[1] << 8 | data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+static void netplaySave(Netplay *netplay)
+{
+    uint8_t *snapshot = netplay->snapshots[netplay->tick % NETPLAY_HISTORY];
+
+    for (int side = 0; side < 2; side++)
+    {
+        gameSave(&netplay->match.boards[side], snapshot + side * GAME_SNAPSHOT_SIZE);
+    }
+}
+
+static void netplayRestore(Netplay *netplay, uint32_t tick)
+{
+    const uint8_t *snapshot = netplay->snapshots[tick % NETPLAY_HISTORY];
+
+    for (int side = 0; side < 2; side++)
+    {
+        gameRestore(&netplay->match.boards[side], snapshot + side * GAME_SNAPSHOT_SIZE);
+    }
+
+    netplay->tick = tick;
+}
+
+// The first ticks of each side, up to its delay, are known to have no input.
+static void netplayStart(Netplay *netplay, uint64_t seed, uint8_t remoteDelay)
+{
+    netplay->seed = seed;
+    netplay->status = NETPLAY_RUNNING;
+    netplay->delays[1 - netplay->local] = remoteDelay;
+
+    for (int side = 0; side < 2; side++)
+    {
+        gameInit(&netplay->match.boards[side], seed);
+        netplay->received[side] = netplay->delays[side];
+    }
+
+    netplay->peerAck = netplay->delays[netplay->local];
+    netplaySave(netplay);
+}
+
+static void netplayInit(Netplay *netplay, NetTransport *transport, int local, uint8_t delay)
+{
+    memset(netplay, 0, sizeof(*netplay));
+    netplay->transport = transport;
+    netplay->local = local;
+    netplay->delays[local] = delay < NETPLAY_MAX_ROLLBACK ? delay : NETPLAY_MAX_ROLLBACK - 1;
+}
+
+void netplayHost(Netplay *netplay, NetTransport *transport, uint64_t seed, uint8_t delay)
+{
+    netplayInit(netplay, transport, 0, delay);
+    netplay->seed = seed;
+}
+
+void netplayJoin(Netplay *netplay, NetTransport *transport, uint8_t delay)
+{
+    netplayInit(netplay, transport, 1, delay);
+}
+
+static GameInput netplayInput(Netplay *netplay, int side, uint32_t tick)
+{
+    GameInput *inputs = netplay->inputs[side];
+
+    if (tick > netplay->received[side])
+    {
+        inputs[tick % NETPLAY_HISTORY] = inputs[netplay->received[side] % NETPLAY_HISTORY] & GAME_INPUT_HELD_MASK;
+    }
+
+    return inputs[tick % NETPLAY_HISTORY];
+}
+
+static uint32_t netplayConfirmed(const Netplay *netplay)
+{
+    uint32_t confirmed = netplay->received[0] < netplay->received[1] ? netplay->received[0] : netplay->received[1];
+    return confirmed < netplay->tick ? confirmed : netplay->tick;
+}
+
+static uint32_t netplayChecksum(const Game *first, const Game *second)
+{
+    return (uint32_t)(gameChecksum(first) ^ gameChecksum(second) >> 1);
+}
+
+static void netplayStep(Netplay *netplay)
+{
+    uint32_t tick = ++netplay->tick;
+
+    for (int side = 0; side < 2; side++)
+    {
+        gameStep(&netplay->match.boards[side], netplayInput(netplay, side, tick));
+    }
+
+    netplaySave(netplay);
+
+    // Checksums are only taken of ticks nothing will roll back any more.
+    if (tick % NETPLAY_CHECKSUM_INTERVAL == 0 && tick <= netplayConfirmed(netplay))
+    {
+        size_t slot = tick / NETPLAY_CHECKSUM_INTERVAL % NETPLAY_CHECKSUMS;
+        netplay->checksumTicks[slot] = tick;
+        netplay->checksums[slot] = netplayChecksum(&netplay->match.boards[0], &netplay->match.boards[1]);
+    }
+}
+
+// A checksum tick that was simulated on a prediction is taken once its inputs are in.
+static void netplayCatchUpChecksums(Netplay *netplay)
+{
+    uint32_t confirmed = netplayConfirmed(netplay);
+    uint32_t tick = confirmed - confirmed % NETPLAY_CHECKSUM_INTERVAL;
+    size_t slot = tick / NETPLAY_CHECKSUM_INTERVAL % NETPLAY_CHECKSUMS;
+
+    if (tick == 0 || netplay->checksumTicks[slot] == tick || netplay->tick - tick >= NETPLAY_HISTORY)
+    {
+        return;
+    }
+
+    NetplayMatch match;
+    gameRestore(&match.boards[0], netplay->snapshots[tick % NETPLAY_HISTORY]);
+    gameRestore(&match.boards[1], netplay->snapshots[tick % NETPLAY_HISTORY] + GAME_SNAPSHOT_SIZE);
+    netplay->checksumTicks[slot] = tick;
+    netplay->checksums[slot] = netplayChecksum(&match.boards[0], &match.boards[1]);
+}
+
+static void netplayRollback(Netplay *netplay)
+{
+    uint32_t from = netplay->rollbackFrom;
+    uint32_t to = netplay->tick;
+    netplay->rollbackFrom = 0;
+
+    if (from == 0 || from > to)
+    {
+        return;
+    }
+
+    double start = netplayClock();
+
+    netplayRestore(netplay, from - 1);
+
+    while (netplay->tick < to)
+    {
+        netplayStep(netplay);
+    }
+
+    double elapsed = netplayClock() - start;
+    NetplayStats *stats = &netplay->stats;
+    uint32_t ticks = to - from + 1;
+
+    stats->rollbacks++;
+    stats->resimulatedTicks += ticks;
+    stats->longestRollback = ticks > stats->longestRollback ? ticks : stats->longestRollback;
+    stats->rollbackTime += elapsed;
+    stats->lastRollbackTime = elapsed;
+    stats->longestRollbackTime = elapsed > stats->longestRollbackTime ? elapsed : stats->longestRollbackTime;
+}
+
+static void netplayReceiveInputs(Netplay *netplay, const uint8_t *packet, size_t size)
+{
+    if (size < NETPLAY_INPUTS_HEADER_SIZE)
+    {
+        return;
+    }
+
+    int remote = 1 - netplay->local;
+    uint32_t ack = netplayGet32(packet + 7);
+    uint32_t first = netplayGet32(packet + 11);
+    uint8_t count = packet[15];
+
+    if (size < NETPLAY_INPUTS_HEADER_SIZE + (size_t)count)
+    {
+        return;
+    }
+
+    netplay->peerStarted = true;
+    netplay->peerTick = netplayGet32(packet + 3);
+    netplay->peerAdvantage = (int8_t)packet[16];
+    netplay->peerAck = ack > netplay->peerAck && ack <= netplay->received[netplay->local] ? ack : netplay->peerAck;
+
+    // Packets overlap, only the inputs right after the ones already known are new.
+    for (uint32_t tick = netplay->received[remote] + 1; tick >= first && tick < first + count; tick++)
+    {
+        GameInput input = packet[NETPLAY_INPUTS_HEADER_SIZE + (tick - first)];
+        GameInput *slot = &netplay->inputs[remote][tick % NETPLAY_HISTORY];
+
+        if (tick <= netplay->tick && *slot != input && (netplay->rollbackFrom == 0 || tick < netplay->rollbackFrom))
+        {
+            netplay->rollbackFrom = tick;
+        }
+
+        *slot = input;
+        netplay->received[remote] = tick;
+    }
+
+    uint32_t checksumTick = netplayGet32(packet + 17);
+    size_t slot = checksumTick / NETPLAY_CHECKSUM_INTERVAL % NETPLAY_CHECKSUMS;
+
+    if (checksumTick != 0 && netplay->checksumTicks[slot] == checksumTick &&
+        netplay->checksums[slot] != netplayGet32(packet + 21) && netplay->status == NETPLAY_RUNNING)
+    {
+        netplay->status = NETPLAY_DESYNCED;
+        netplay->desyncedAt = checksumTick;
+    }
+}
+
+void netplayPoll(Netplay *netplay, double now)
+{
+    uint8_t packet[NET_MAX_DATAGRAM];
+    size_t size;
+
+    while ((size = netReceive(netplay->transport, packet, sizeof(packet), now)) > 0)
+    {
+        if (size < 3 || packet[0] != 'T' || packet[1] != 'V')
+        {
+            continue;
+        }
+
+        if (packet[2] == NETPLAY_PACKET_HELLO && size >= 4 && netplay->local == 0 && netplay->status == NETPLAY_CONNECTING)
+        {
+            netplayStart(netplay, netplay->seed, packet[3] < NETPLAY_MAX_ROLLBACK ? packet[3] : NETPLAY_MAX_ROLLBACK - 1);
+        }
+        else if (packet[2] == NETPLAY_PACKET_START && size >= 12 && netplay->local == 1 && netplay->status == NETPLAY_CONNECTING)
+        {
+            uint64_t seed = 0;
+
+            for (int i = 0; i < 8; i++)
+            {
+                seed |= (uint64_t)packet[3 + i] << (8 * i);
+            }
+
+            netplayStart(netplay, seed, packet[11] < NETPLAY_MAX_ROLLBACK ? packet[11] : NETPLAY_MAX_ROLLBACK - 1);
+        }
+        else if (packet[2] == NETPLAY_PACKET_INPUTS && netplay->status != NETPLAY_CONNECTING)
+        {
+            netplayReceiveInputs(netplay, packet, size);
+        }
+    }
+
+    netplayRollback(netplay);
+    netplayCatchUpChecksums(netplay);
+}
+
+static int netplayAdvantage(const Netplay *netplay)
+{
+    return (int)netplay->tick - (int)netplay->peerTick;
+}
+
+bool netplayReady(Netplay *netplay)
+{
+    if (netplay->status != NETPLAY_RUNNING)
+    {
+        return false;
+    }
+
+    int remote = 1 - netplay->local;
+    uint32_t next = netplay->tick + 1;
+
+    // Too far ahead of the peer's inputs, or of what it has acknowledged of ours.
+    bool ahead = next > netplay->received[remote] + NETPLAY_MAX_ROLLBACK ||
+                 netplay->received[netplay->local] + 1 - netplay->peerAck >= NETPLAY_HISTORY - 1;
+
+    // Both sides see the other behind by the latency, half the difference is how far ahead this
+    // side really runs. Dropping a tick now and then brings the clocks back together.
+    bool early = (netplayAdvantage(netplay) - netplay->peerAdvantage) / 2 >= 2 && next % 30 == 0;
+
+    if (ahead || early)
+    {
+        netplay->stats.waits++;
+        return false;
+    }
+
+    return true;
+}
+
+void netplayAdvance(Netplay *netplay, GameInput input)
+{
+    int local = netplay->local;
+    uint32_t scheduled = ++netplay->received[local];
+    netplay->inputs[local][scheduled % NETPLAY_HISTORY] = input;
+
+    netplayStep(netplay);
+}
+
+void netplaySend(Netplay *netplay, double now)
+{
+    uint8_t packet[NETPLAY_PACKET_SIZE] = {'T', 'V'};
+
+    if (netplay->status == NETPLAY_CONNECTING)
+    {
+        if (netplay->local == 1)
+        {
+            packet[2] = NETPLAY_PACKET_HELLO;
+            packet[3] = netplay->delays[1];
+            netSend(netplay->transport, packet, 4, now);
+        }
+
+        return;
+    }
+
+    if (netplay->local == 0 && !netplay->peerStarted)
+    {
+        packet[2] = NETPLAY_PACKET_START;
+
+        for (int i = 0; i < 8; i++)
+        {
+            packet[3 + i] = netplay->seed >> (8 * i);
+        }
+
+        packet[11] = netplay->delays[0];
+        netSend(netplay->transport, packet, 12, now);
+    }
+
+    int local = netplay->local;
+    uint32_t first = netplay->peerAck + 1;
+    uint32_t count = netplay->received[local] - netplay->peerAck;
+
+    // The latest checksum taken, for the peer to compare with its own.
+    uint32_t checksumTick = 0;
+    uint32_t checksum = 0;
+
+    for (size_t i = 0; i < NETPLAY_CHECKSUMS; i++)
+    {
+        if (netplay->checksumTicks[i] > checksumTick)
+        {
+            checksumTick = netplay->checksumTicks[i];
+            checksum = netplay->checksums[i];
+        }
+    }
+
+    int advantage = netplayAdvantage(netplay);
+
+    packet[2] = NETPLAY_PACKET_INPUTS;
+    netplayPut32(packet + 3, netplay->tick);
+    netplayPut32(packet + 7, netplay->received[1 - local]);
+    netplayPut32(packet + 11, first);
+    packet[15] = count;
+    packet[16] = (uint8_t)(int8_t)(advantage < -128 ? -128 : advantage > 127 ? 127 : advantage);
+    netplayPut32(packet + 17, checksumTick);
+    netplayPut32(packet + 21, checksum);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        packet[NETPLAY_INPUTS_HEADER_SIZE + i] = netplay->inputs[local][(first + i) % NETPLAY_HISTORY];
+    }
+
+    netSend(netplay->transport, packet, NETPLAY_INPUTS_HEADER_SIZE + count, now);
+}
+
+const Game *netplayBoard(const Netplay *netplay, int side)
+{
+    return &netplay->match.boards[side];
+}
+
+#endif // NETPLAY_IMPLEMENTATION
@@ -0,0 +1,105 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Where frame time goes, for the performance overlay.
+//
+// Every frame of a running game is written to a fixed ring: how long it took and how that splits
+// into simulation, layout, drawing and presenting, along with the draw calls and vertices sent to
+// the GPU and how often the engine checked collisions and applied gravity. Percentiles are taken
+// over the frames that ended in the last PERF_WINDOW_SECONDS.
+
+// Frames kept, enough for the window at up to 200 frames per second.
+#define PERF_FRAMES 1024
+#define PERF_WINDOW_SECONDS 5.0
+
+typedef enum PerfTiming
+{
+    PERF_TIMING_FRAME = 0,
+    PERF_TIMING_SIM,     // input, hints and taking the latest snapshot, the ticks run on their own thread
+    PERF_TIMING_LAYOUT,
+    PERF_TIMING_DRAW,    // building the frame up to EndDrawing
+    PERF_TIMING_PRESENT, // EndDrawing: the last draw calls, the swap and waiting for the next frame
+    PERF_TIMING_COUNT,
+} PerfTiming;
+
+typedef struct PerfFrame
+{
+    double end; // GetTime() when the frame was done
+    float seconds[PERF_TIMING_COUNT];
+    uint32_t drawCalls;
+    uint32_t vertices;
+    uint32_t collisionChecks;
+    uint32_t gravitySteps;
+} PerfFrame;
+
+typedef struct PerfRing
+{
+    PerfFrame frames[PERF_FRAMES];
+    uint64_t count; // frames recorded since the start
+} PerfRing;
+
+typedef struct PerfSummary
+{
+    float p50;
+    float p99;
+    float max;
+} PerfSummary;
+
+void perfRecord(PerfRing *ring, const PerfFrame *frame);
+// age 0 is the latest frame. NULL once age reaches the frames kept.
+const PerfFrame *perfFrame(const PerfRing *ring, uint64_t age);
+// Over the frames that ended in the PERF_WINDOW_SECONDS before now.
+PerfSummary perfSummarize(const PerfRing *ring, PerfTiming timing, double now);
+
+#endif // PERF_H
+
+#if defined(PERF_IMPLEMENTATION) && !defined(PERF_IMPLEMENTED)
+#define PERF_IMPLEMENTED
+
+#include "sort.h"
+
+void perfRecord(PerfRing *ring, const PerfFrame *frame)
+{
+    ring->frames[ring->count++ % PERF_FRAMES] = *frame;
+}
+
+const PerfFrame *perfFrame(const PerfRing *ring, uint64_t age)
+{
+    if (age >= ring->count || age >= PERF_FRAMES)
+    {
+        return NULL;
+    }
+
+    return &ring->frames[(ring->count - 1 - age) % PERF_FRAMES];
+}
+
+PerfSummary perfSummarize(const PerfRing *ring, PerfTiming timing, double now)
+{
+    float sorted[PERF_FRAMES];
+    size_t count = 0;
+    const PerfFrame *frame;
+
+    while ((frame = perfFrame(ring, count)) != NULL && now - frame->end <= PERF_WINDOW_SECONDS)
+    {
+        sorted[count++] = frame->seconds[timing];
+    }
+
+    if (count == 0)
+    {
+        return (PerfSummary){0};
+    }
+
+    sortFloats(sorted, count);
+
+    return (PerfSummary){
+        .p50 = sorted[(size_t)(0.50 * (count - 1) + 0.5)],
+        .p99 = sorted[(size_t)(0.99 * (count - 1) + 0.5)],
+        .max = sorted[count - 1],
+    };
+}
+
+#endif // PERF_IMPLEMENTATION
@@ -0,0 +1,242 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "raylib.h"
+#include "tetris.h"
+
+// Draws a game board with raylib: the grid, the active piece and its ghost, the next and saved
+// pieces, the score and the level. Shared by the game and the render benchmark, which times
+// drawGame's parts one by one.
+
+// The window height the layout was designed at, everything scales from it.
+#define RENDER_DESIGN_HEIGHT 600
+
+typedef struct Layout
+{
+    Vector2 savedPieceStart;
+    Vector2 gridStart;
+    Vector2 nextPiecesStart;
+    Vector2 scoreLevelStart;
+    Vector2 blockSizes;
+    uint16_t paddingTop;
+    uint8_t fontSize;
+} Layout;
+
+Layout computeLayout(float width, float height);
+// The same layout moved right by x, for boards side by side.
+Layout offsetLayout(Layout layout, float x);
+
+void drawGridPiece(const Vector2 gridOrigin, const Vector2 blockSize, const GridPiece *piece);
+void drawNextPiece(const Vector2 origin, size_t slot, const Vector2 blockSize, const uint16_t padding, const Piece piece);
+void drawSavedPiece(const Vector2 origin, const Vector2 blockSize, const Piece piece);
+void drawGrid(const Vector2 origin, const Vector2 blockSize, const Block grid[GRID_WIDTH * GRID_HEIGHT]);
+
+// The active piece and its ghost.
+void drawGamePieces(const Layout *layout, const Game *game);
+// The next pieces and the saved one.
+void drawGameQueue(const Layout *layout, const Game *game);
+// Score, level and the game over message.
+void drawGameText(const Layout *layout, const Game *game);
+// All of the above and the grid.
+void drawGame(const Layout *layout, const Game *game);
+
+#endif // RENDER_H
+
+#if defined(RENDER_IMPLEMENTATION) && !defined(RENDER_IMPLEMENTED)
+#define RENDER_IMPLEMENTED
+
+#include "raymath.h"
+
+#include <math.h>
+
+void drawGridPiece(const Vector2 gridOrigin, const Vector2 blockSize, const GridPiece *piece)
+{
+    GridPieceParts parts = constructGridPieceParts(piece);
+
+    for (size_t i = 0; i < PIECE_PARTS_COUNT_1D; i++)
+    {
+        Vector2 pieceCoordinates = parts.coordinates[i];
+        Vector2 coordinates = Vector2Add(Vector2Multiply(pieceCoordinates, blockSize), gridOrigin);
+
+        DrawRectangleV(coordinates, blockSize, piece->data.color);
+    }
+}
+
+void drawNextPiece(const Vector2 origin, size_t slot, const Vector2 blockSize, const uint16_t padding, const Piece piece)
+{
+    TRACE_SCOPE("drawNextPiece");
+
+    GridPieceParts parts = constructGridPieceParts(&(GridPiece){
+        .data = piece,
+        .orientation = ORIENTATION_NORMAL,
+        .origin = (Vector2){
+            .x = 0,
+            .y = PIECE_PARTS_COUNT_1D * slot,
+        },
+    });
+
+    for (size_t i = 0; i < PIECE_PARTS_COUNT_1D; i++)
+    {
+        const Vector2 coordinates = Vector2Add(
+            Vector2Add(
+                Vector2Multiply(parts.coordinates[i], blockSize),
+                origin),
+            (Vector2){
+                .x = 0,
+                .y = padding * slot,
+            });
+        DrawRectangleV(coordinates, blockSize, piece.color);
+        DrawRectangleLines(coordinates.x, coordinates.y, blockSize.x, blockSize.y, BLACK);
+    }
+}
+
+void drawSavedPiece(const Vector2 origin, const Vector2 blockSize, const Piece piece)
+{
+    TRACE_SCOPE("drawSavedPiece");
+
+    GridPieceParts parts = constructGridPieceParts(&(GridPiece){
+        .data = piece,
+        .orientation = ORIENTATION_NORMAL,
+        .origin = Vector2Zero(),
+    });
+
+    for (size_t i = 0; i < PIECE_PARTS_COUNT_1D; i++)
+    {
+        const Vector2 coordinates = Vector2Add(
+            Vector2Multiply(parts.coordinates[i], blockSize),
+            origin);
+        DrawRectangleV(coordinates, blockSize, piece.color);
+        DrawRectangleLines(coordinates.x, coordinates.y, blockSize.x, blockSize.y, BLACK);
+    }
+}
+
+void drawGrid(const Vector2 origin, const Vector2 blockSize, const Block grid[GRID_WIDTH * GRID_HEIGHT])
+{
+    TRACE_SCOPE("drawGrid");
+
+    for (size_t i = 0; i < GRID_WIDTH * GRID_HEIGHT; i++)
+    {
+        const Vector2 gridCoordinate = (Vector2){
+            .x = i % GRID_WIDTH,
+            .y = i / GRID_WIDTH,
+        };
+
+        const Vector2 coordinates = Vector2Add(
+            Vector2Multiply(gridCoordinate, blockSize),
+            origin);
+
+        if (isBlockInGrid(grid, gridCoordinate))
+        {
+            DrawRectangleV(coordinates, blockSize, grid[i].color);
+        }
+
+        DrawRectangleLines(coordinates.x, coordinates.y, blockSize.x, blockSize.y, BLACK);
+    }
+}
+
+Layout computeLayout(float width, float height)
+{
+    uint16_t paddingTop = (int)floorf(10.0 / RENDER_DESIGN_HEIGHT * height);
+    uint16_t paddingSides = (int)floorf(15.0 / RENDER_DESIGN_HEIGHT * height);
+    uint16_t paddingComponents = (int)floorf(20.0 / RENDER_DESIGN_HEIGHT * height);
+    uint8_t blockSize = (int)floorf(28.0 / RENDER_DESIGN_HEIGHT * height);
+    uint16_t gridWidth = blockSize * GRID_WIDTH;
+    uint16_t gridStartX = paddingSides + ((width - paddingSides * 2) / 2 - (gridWidth / 2));
+
+    return (Layout){
+        .savedPieceStart = {
+            .x = gridStartX - paddingComponents - blockSize * PIECE_PARTS_COUNT_1D,
+            .y = paddingTop,
+        },
+        .gridStart = {
+            .x = gridStartX,
+            .y = paddingTop,
+        },
+        .nextPiecesStart = {
+            .x = gridStartX + gridWidth + paddingComponents,
+            .y = paddingTop,
+        },
+        .scoreLevelStart = {
+            .x = gridStartX + gridWidth + paddingComponents,
+            .y = paddingTop + paddingComponents + blockSize * PIECE_PARTS_COUNT_1D * NEXT_PIECES_COUNT,
+        },
+        .blockSizes = {
+            .x = blockSize,
+            .y = blockSize,
+        },
+        .paddingTop = paddingTop,
+        .fontSize = (int)floorf(28.0 / RENDER_DESIGN_HEIGHT * height),
+    };
+}
+
+Layout offsetLayout(Layout layout, float x)
+{
+    layout.savedPieceStart.x += x;
+    layout.gridStart.x += x;
+    layout.nextPiecesStart.x += x;
+    layout.scoreLevelStart.x += x;
+
+    return layout;
+}
+
+void drawGamePieces(const Layout *layout, const Game *game)
+{
+    drawGridPiece(layout->gridStart, layout->blockSizes, &game->piece);
+    if (!game->dead)
+    {
+        GridPiece ghostPiece = gameGhostPiece(game);
+        drawGridPiece(layout->gridStart, layout->blockSizes, &ghostPiece);
+    }
+}
+
+void drawGameQueue(const Layout *layout, const Game *game)
+{
+    for (size_t i = 0; i < NEXT_PIECES_COUNT; i++)
+    {
+        drawNextPiece(layout->nextPiecesStart, i, layout->blockSizes, layout->paddingTop, game->nextPieces[i]);
+    }
+
+    if (game->hasSavedPiece)
+    {
+        drawSavedPiece(layout->savedPieceStart, layout->blockSizes, game->savedPiece);
+    }
+}
+
+void drawGameText(const Layout *layout, const Game *game)
+{
+    const Vector2 gridStart = layout->gridStart;
+    const uint8_t fontSize = layout->fontSize;
+
+    if (game->dead)
+    {
+        const char *restartText = "You die!";
+        const Vector2 restartTextSize = MeasureTextEx(GetFontDefault(), restartText, fontSize, 10);
+
+        DrawText(restartText, gridStart.x + 5, gridStart.y, fontSize, RED);
+        DrawText("Press R to restart", gridStart.x + 5, gridStart.y + restartTextSize.y, fontSize, RED);
+    }
+
+    const Vector2 scoreCoordinates = (Vector2){
+        .x = layout->scoreLevelStart.x,
+        .y = layout->scoreLevelStart.y,
+    };
+
+    DrawText(TextFormat("Score: %08i", game->score), scoreCoordinates.x, scoreCoordinates.y, fontSize, BLACK);
+
+    const Vector2 levelCoordinates = (Vector2){
+        .x = layout->scoreLevelStart.x,
+        .y = layout->scoreLevelStart.y + fontSize,
+    };
+
+    DrawText(TextFormat("Level: %02i", game->level), levelCoordinates.x, levelCoordinates.y, fontSize, BLACK);
+}
+
+void drawGame(const Layout *layout, const Game *game)
+{
+    drawGamePieces(layout, game);
+    drawGameQueue(layout, game);
+    drawGrid(layout->gridStart, layout->blockSizes, game->grid);
+    drawGameText(layout, game);
+}
+
+#endif // RENDER_IMPLEMENTATION
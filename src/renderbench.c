@@ -0,0 +1,243 @@
+#include "raylib.h"
+#include "rlgl.h"
+
+#define TETRIS_IMPLEMENTATION
+#include "tetris.h"
+
+#define RENDER_IMPLEMENTATION
+#include "render.h"
+
+#define REPLAY_IMPLEMENTATION
+#include "replay.h"
+
+#include "sort.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Plays a replay through the game's draw path into an offscreen render texture as fast as it
+// goes, with no VSync and no frame limit, a tick per frame, and reports frames per second and
+// where each frame's time went.
+//
+// The window stays hidden, so it runs under Xvfb. With LIBGL_ALWAYS_SOFTWARE=1 Mesa rasterises on
+// the CPU, which makes the numbers comparable between machines without a GPU. Every frame ends with
+// glFinish, so the rasterisation is counted in the frame it belongs to instead of piling up.
+
+#define RENDER_BENCH_WARMUP_FRAMES 120
+
+typedef enum RenderBenchPhase
+{
+    RENDER_BENCH_SIM = 0,   // replayPlayerStep
+    RENDER_BENCH_PIECES,    // clearing, drawGamePieces
+    RENDER_BENCH_QUEUE,     // drawGameQueue
+    RENDER_BENCH_GRID,      // drawGrid
+    RENDER_BENCH_TEXT,      // drawGameText
+    RENDER_BENCH_SUBMIT,    // EndTextureMode: the last batch goes to GL
+    RENDER_BENCH_FINISH,    // glFinish: waiting for the rasteriser
+    RENDER_BENCH_PHASES,
+} RenderBenchPhase;
+
+static const char *renderBenchPhaseNames[RENDER_BENCH_PHASES] = {"sim", "pieces", "queue", "grid", "text", "submit", "finish"};
+
+// rlgl has no glFinish or glGetString of its own. glad loaded them with the others.
+#define RENDER_BENCH_GL_RENDERER 0x1F01
+
+typedef void (*RenderBenchFinish)(void);
+typedef const unsigned char *(*RenderBenchGetString)(unsigned int name);
+extern RenderBenchFinish glad_glFinish;
+extern RenderBenchGetString glad_glGetString;
+
+typedef struct RenderBenchClock
+{
+    double wall;
+    double cpu; // this thread's, the rasteriser's threads are in the process total
+} RenderBenchClock;
+
+static double renderBenchSeconds(clockid_t clock)
+{
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static RenderBenchClock renderBenchNow(void)
+{
+    return (RenderBenchClock){
+        .wall = renderBenchSeconds(CLOCK_MONOTONIC),
+        .cpu = renderBenchSeconds(CLOCK_THREAD_CPUTIME_ID),
+    };
+}
+
+int main(int argc, char **argv)
+{
+    const char *replayPath = NULL;
+    int width = 800;
+    int height = RENDER_DESIGN_HEIGHT;
+    long frames = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--size") == 0 && i + 1 < argc && sscanf(argv[i + 1], "%dx%d", &width, &height) == 2)
+        {
+            i++;
+        }
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            frames = atol(argv[++i]);
+        }
+        else if (argv[i][0] != '-' && replayPath == NULL)
+        {
+            replayPath = argv[i];
+        }
+        else
+        {
+            replayPath = NULL;
+            break;
+        }
+    }
+
+    if (replayPath == NULL || width <= 0 || height <= 0)
+    {
+        fprintf(stderr, "usage: %s <replay.trp> [--size <width>x<height>] [--frames <count>]\n", argv[0]);
+        return 1;
+    }
+
+    int replaySize = 0;
+    unsigned char *replayData = LoadFileData(replayPath, &replaySize);
+    static ReplayPlayer player;
+
+    if (replayData == NULL || !replayPlayerOpen(&player, replayData, replaySize) || player.length == 0)
+    {
+        fprintf(stderr, "%s: not a replay this build can play\n", replayPath);
+        return 1;
+    }
+
+    // One pass through the replay unless asked otherwise, it starts over when it runs out.
+    frames = frames > 0 ? frames : (long)player.length;
+
+    // The last row is the whole frame. calloc also fails a count too large for size_t.
+    float *wall[RENDER_BENCH_PHASES + 1] = {0};
+
+    for (int phase = 0; phase <= RENDER_BENCH_PHASES; phase++)
+    {
+        wall[phase] = calloc(frames, sizeof(float));
+
+        if (wall[phase] == NULL)
+        {
+            fprintf(stderr, "not enough memory for the times of %ld frames\n", frames);
+
+            for (int allocated = 0; allocated < phase; allocated++)
+            {
+                free(wall[allocated]);
+            }
+
+            replayPlayerClose(&player);
+            UnloadFileData(replayData);
+            return 1;
+        }
+    }
+
+    SetTraceLogLevel(LOG_WARNING);
+    SetConfigFlags(FLAG_WINDOW_HIDDEN);
+    InitWindow(width, height, "render bench");
+
+    RenderTexture2D target = LoadRenderTexture(width, height);
+    const Layout layout = computeLayout(width, height);
+
+    double cpu[RENDER_BENCH_PHASES + 1] = {0};
+
+    double start = 0;
+    double processStart = 0;
+
+    for (long frame = -RENDER_BENCH_WARMUP_FRAMES; frame < frames; frame++)
+    {
+        if (frame == 0)
+        {
+            start = renderBenchSeconds(CLOCK_MONOTONIC);
+            processStart = renderBenchSeconds(CLOCK_PROCESS_CPUTIME_ID);
+        }
+
+        RenderBenchClock marks[RENDER_BENCH_PHASES + 1];
+        marks[0] = renderBenchNow();
+
+        if (!replayPlayerStep(&player))
+        {
+            replayPlayerSeek(&player, 0);
+        }
+
+        const Game *game = &player.current.game;
+        marks[RENDER_BENCH_PIECES] = renderBenchNow();
+
+        BeginTextureMode(target);
+        ClearBackground(DARKGRAY);
+        drawGamePieces(&layout, game);
+        marks[RENDER_BENCH_QUEUE] = renderBenchNow();
+
+        drawGameQueue(&layout, game);
+        marks[RENDER_BENCH_GRID] = renderBenchNow();
+
+        drawGrid(layout.gridStart, layout.blockSizes, game->grid);
+        marks[RENDER_BENCH_TEXT] = renderBenchNow();
+
+        drawGameText(&layout, game);
+        marks[RENDER_BENCH_SUBMIT] = renderBenchNow();
+
+        EndTextureMode();
+        marks[RENDER_BENCH_FINISH] = renderBenchNow();
+
+        glad_glFinish();
+        marks[RENDER_BENCH_PHASES] = renderBenchNow();
+
+        if (frame < 0)
+        {
+            continue;
+        }
+
+        for (int phase = 0; phase < RENDER_BENCH_PHASES; phase++)
+        {
+            wall[phase][frame] = marks[phase + 1].wall - marks[phase].wall;
+            cpu[phase] += marks[phase + 1].cpu - marks[phase].cpu;
+        }
+
+        wall[RENDER_BENCH_PHASES][frame] = marks[RENDER_BENCH_PHASES].wall - marks[0].wall;
+        cpu[RENDER_BENCH_PHASES] += marks[RENDER_BENCH_PHASES].cpu - marks[0].cpu;
+    }
+
+    double elapsed = renderBenchSeconds(CLOCK_MONOTONIC) - start;
+    double processCpu = renderBenchSeconds(CLOCK_PROCESS_CPUTIME_ID) - processStart;
+
+    printf("%s: %ld frames at %dx%d on %s\n", replayPath, frames, width, height, (const char *)glad_glGetString(RENDER_BENCH_GL_RENDERER));
+    printf("%.1f frames/s, %.3f ms a frame, %.3f ms of process CPU a frame\n\n", frames / elapsed, elapsed / frames * 1000.0,
+           processCpu / frames * 1000.0);
+    printf("%-8s %10s %10s %10s %10s\n", "phase", "mean ms", "p50 ms", "p99 ms", "cpu ms");
+
+    for (int phase = 0; phase <= RENDER_BENCH_PHASES; phase++)
+    {
+        float *times = wall[phase];
+        double total = 0;
+
+        for (long frame = 0; frame < frames; frame++)
+        {
+            total += times[frame];
+        }
+
+        sortFloats(times, frames);
+
+        printf("%-8s %10.4f %10.4f %10.4f %10.4f\n", phase < RENDER_BENCH_PHASES ? renderBenchPhaseNames[phase] : "frame", total / frames * 1000.0,
+               times[(size_t)(0.50 * (frames - 1) + 0.5)] * 1000.0, times[(size_t)(0.99 * (frames - 1) + 0.5)] * 1000.0, cpu[phase] / frames * 1000.0);
+    }
+
+    for (int phase = 0; phase <= RENDER_BENCH_PHASES; phase++)
+    {
+        free(wall[phase]);
+    }
+
+    UnloadRenderTexture(target);
+    CloseWindow();
+    replayPlayerClose(&player);
+    UnloadFileData(replayData);
+
+    return 0;
+}
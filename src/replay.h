@@ -0,0 +1,760 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "tetris.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Replays store the seed and the input of every gameStep, which is enough to play a session back.
+//
+// Layout, little endian:
+//   header  "TRPL", u16 format version, u16 GAME_RULES_VERSION, u64 seed, u8 width, u8 height,
+//           u8 DAS, u8 ARR, u8 soft drop factor (GameHandling, since version 4)
+//   events  one varint each, (ticks since the previous event << 4) | code
+//   trailer after the END event, varints with the final score and lines cleared
+//
+// Codes 0 to 7 are the GameInput bit with that index. A held input (GAME_INPUT_HELD_MASK) is
+// toggled by its event and stays that way until the next one, a press only lasts its own tick.
+// Ticks are numbered like Game.tick, the first gameStep of the session is tick 1.
+//
+// Since version 2, a CHECKPOINT event every REPLAY_CHECKPOINT_INTERVAL ticks is followed by
+// varints with the score and lines cleared after that tick, so a replay that no longer plays out
+// the same is caught close to where it diverged. Since version 3 it also carries the low 32 bits
+// of gameChecksum, which catches divergences that have not reached the score yet.
+//
+// Versions before 4 were all recorded under rules version 1, before GameHandling, and nothing
+// plays them back any more. The reader still opens them for their header and trailer, which is
+// all a corpus index needs.
+
+#define REPLAY_MAGIC "TRPL"
+#define REPLAY_FORMAT_VERSION 4
+#define REPLAY_HEADER_SIZE 21
+#define REPLAY_HEADER_SIZE_V3 18
+// The first version recorded under the current rules.
+#define REPLAY_OLDEST_PLAYABLE_VERSION 4
+
+#define REPLAY_CODE_BITS 4
+#define REPLAY_CODE_END 8
+#define REPLAY_CODE_CHECKPOINT 9
+
+#define REPLAY_CHECKPOINT_INTERVAL 600
+
+// Bytes buffered between the game and the writer thread, a power of two.
+#define REPLAY_BUFFER_SIZE (64 * 1024)
+// How often the writer thread wakes up to drain the buffer.
+#define REPLAY_WRITER_INTERVAL 0.1
+
+typedef struct ReplayHeader
+{
+    uint16_t formatVersion;
+    uint16_t rulesVersion;
+    uint64_t seed;
+    uint8_t width;
+    uint8_t height;
+    GameHandling handling;
+} ReplayHeader;
+
+// The game thread appends encoded ticks to buffer, the writer thread moves them to the file.
+typedef struct ReplayRecorder
+{
+    FILE *file;
+    uint8_t *buffer;
+    _Atomic size_t head;
+    _Atomic size_t tail;
+    atomic_bool running;
+    pthread_t thread;
+
+    GameInput held;
+    uint32_t tick;
+    uint32_t lastEventTick;
+    bool recording;
+    bool overflowed;
+} ReplayRecorder;
+
+// Writes the header and starts the writer thread. The buffer is allocated here, once.
+bool replayRecorderOpen(ReplayRecorder *recorder, const char *path, uint64_t seed, GameHandling handling);
+// Records the input of the gameStep that just ran on game. Never allocates, locks or touches the file.
+void replayRecorderTick(ReplayRecorder *recorder, GameInput input, const Game *game);
+// Appends the END event and the final results of game, then waits for everything to be written.
+bool replayRecorderClose(ReplayRecorder *recorder, const Game *game);
+
+typedef struct ReplayCheckpoint
+{
+    uint32_t tick;
+    uint32_t score;
+    uint32_t lines;
+    uint32_t checksum; // 0 before version 3
+} ReplayCheckpoint;
+
+typedef struct ReplayReader
+{
+    const uint8_t *data;
+    size_t size;
+    size_t position;
+    ReplayHeader header;
+
+    GameInput held;
+    uint32_t tick;
+    uint32_t eventTick;
+    int eventCode; // -1 once the data runs out
+
+    // Set by replayReaderNext when the tick it returned has a checkpoint.
+    bool hasCheckpoint;
+    ReplayCheckpoint checkpoint;
+    ReplayCheckpoint nextCheckpoint;
+
+    bool complete; // the END event and trailer were read
+    uint32_t endTick;
+    uint32_t score;
+    uint32_t lines;
+} ReplayReader;
+
+// data must stay valid while the reader is used. Fails on a bad header.
+bool replayReaderOpen(ReplayReader *reader, const uint8_t *data, size_t size);
+// The input for the next tick. Returns false once the replay is over.
+bool replayReaderNext(ReplayReader *reader, GameInput *input);
+// Skips the remaining events to read the trailer, without decoding inputs.
+void replayReaderSkipToEnd(ReplayReader *reader);
+
+typedef struct ReplayVerification
+{
+    uint32_t ticks;
+    bool complete; // the recording reached its END event, so the final results were checked
+    // 0 when the replay played out as recorded, otherwise the first checkpoint (or the end) that
+    // did not match, with what was recorded and what the engine does now.
+    uint32_t divergedAt;
+    ReplayCheckpoint expected;
+    ReplayCheckpoint actual;
+} ReplayVerification;
+
+// Whether this engine plays the replay back as it was recorded: format
+// REPLAY_OLDEST_PLAYABLE_VERSION or later, the current GAME_RULES_VERSION and the same board size.
+bool replayIsPlayable(const ReplayHeader *header);
+// Plays a replay headlessly against its checkpoints and trailer. Fails when it cannot be read or
+// is not playable.
+bool replayVerify(const uint8_t *data, size_t size, ReplayVerification *verification);
+
+// Ticks between the keyframes a ReplayPlayer keeps, so a seek never simulates more than this.
+#define REPLAY_KEYFRAME_INTERVAL 120
+
+// Engine state and reader position at a tick, enough to resume playback from there.
+typedef struct ReplayKeyframe
+{
+    Game game;
+    ReplayReader reader;
+} ReplayKeyframe;
+
+typedef struct ReplayPlayer
+{
+    ReplayKeyframe *keyframes; // keyframes[i] is at tick i * REPLAY_KEYFRAME_INTERVAL
+    size_t keyframeCount;
+    uint32_t length; // ticks in the replay
+    uint32_t divergedAt; // first checkpoint this engine does not reproduce, 0 when there is none
+    ReplayKeyframe current;
+} ReplayPlayer;
+
+// Plays the whole replay through once to lay down the keyframes. Fails when the replay was
+// recorded with other rules or another board size.
+bool replayPlayerOpen(ReplayPlayer *player, const uint8_t *data, size_t size);
+void replayPlayerClose(ReplayPlayer *player);
+// Moves one tick forward. Returns false at the end of the replay.
+bool replayPlayerStep(ReplayPlayer *player);
+// Restores the keyframe at or before tick and simulates the rest of the way.
+void replayPlayerSeek(ReplayPlayer *player, uint32_t tick);
+
+size_t replayWriteVarint(uint8_t *destination, uint64_t value);
+bool replayReadVarint(const uint8_t *data, size_t size, size_t *position, uint64_t *value);
+
+#endif // REPLAY_H
+
+#if defined(REPLAY_IMPLEMENTATION) && !defined(REPLAY_IMPLEMENTED)
+#define REPLAY_IMPLEMENTED
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define REPLAY_BUFFER_MASK (REPLAY_BUFFER_SIZE - 1)
+// Enough for an event per input bit and a checkpoint on one tick.
+#define REPLAY_MAX_TICK_BYTES (12 * 10)
+
+_Static_assert((REPLAY_BUFFER_SIZE & REPLAY_BUFFER_MASK) == 0, "the replay buffer size must be a power of two");
+
+size_t replayWriteVarint(uint8_t *destination, uint64_t value)
+{
+    size_t length = 0;
+
+    do
+    {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        destination[length++] = byte | (value ? 0x80 : 0);
+    } while (value);
+
+    return length;
+}
+
+bool replayReadVarint(const uint8_t *data, size_t size, size_t *position, uint64_t *value)
+{
+    *value = 0;
+
+    for (int shift = 0; shift < 64 && *position < size; shift += 7)
+    {
+        uint8_t byte = data[(*position)++];
+        *value |= (uint64_t)(byte & 0x7F) << shift;
+
+        if (!(byte & 0x80))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void replayWriteLittleEndian(uint8_t *destination, uint64_t value, size_t bytes)
+{
+    for (size_t i = 0; i < bytes; i++)
+    {
+        destination[i] = value >> (i * 8);
+    }
+}
+
+static uint64_t replayReadLittleEndian(const uint8_t *source, size_t bytes)
+{
+    uint64_t value = 0;
+
+    for (size_t i = 0; i < bytes; i++)
+    {
+        value |= (uint64_t)source[i] << (i * 8);
+    }
+
+    return value;
+}
+
+// Drains everything the game thread has published so far.
+static bool replayRecorderDrain(ReplayRecorder *recorder)
+{
+    size_t head = atomic_load_explicit(&recorder->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&recorder->tail, memory_order_relaxed);
+    bool ok = true;
+
+    while (tail != head)
+    {
+        size_t start = tail & REPLAY_BUFFER_MASK;
+        size_t length = head - tail;
+
+        if (length > REPLAY_BUFFER_SIZE - start)
+        {
+            length = REPLAY_BUFFER_SIZE - start;
+        }
+
+        ok &= fwrite(recorder->buffer + start, 1, length, recorder->file) == length;
+        tail += length;
+    }
+
+    atomic_store_explicit(&recorder->tail, tail, memory_order_release);
+
+    return ok;
+}
+
+static void *replayRecorderThread(void *argument)
+{
+    ReplayRecorder *recorder = argument;
+    const struct timespec interval = {
+        .tv_sec = 0,
+        .tv_nsec = (long)(REPLAY_WRITER_INTERVAL * 1e9),
+    };
+
+    while (atomic_load(&recorder->running))
+    {
+        nanosleep(&interval, NULL);
+        replayRecorderDrain(recorder);
+    }
+
+    return NULL;
+}
+
+static bool replayRecorderPush(ReplayRecorder *recorder, const uint8_t *bytes, size_t length)
+{
+    size_t head = atomic_load_explicit(&recorder->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&recorder->tail, memory_order_acquire);
+
+    if (REPLAY_BUFFER_SIZE - (head - tail) < length)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < length; i++)
+    {
+        recorder->buffer[(head + i) & REPLAY_BUFFER_MASK] = bytes[i];
+    }
+
+    atomic_store_explicit(&recorder->head, head + length, memory_order_release);
+
+    return true;
+}
+
+bool replayRecorderOpen(ReplayRecorder *recorder, const char *path, uint64_t seed, GameHandling handling)
+{
+    memset(recorder, 0, sizeof(*recorder));
+
+    recorder->file = fopen(path, "wb");
+    recorder->buffer = malloc(REPLAY_BUFFER_SIZE);
+
+    if (recorder->file == NULL || recorder->buffer == NULL)
+    {
+        perror(path);
+
+        if (recorder->file != NULL)
+        {
+            fclose(recorder->file);
+        }
+
+        free(recorder->buffer);
+        recorder->file = NULL;
+        recorder->buffer = NULL;
+
+        return false;
+    }
+
+    uint8_t header[REPLAY_HEADER_SIZE];
+    memcpy(header, REPLAY_MAGIC, 4);
+    replayWriteLittleEndian(header + 4, REPLAY_FORMAT_VERSION, 2);
+    replayWriteLittleEndian(header + 6, GAME_RULES_VERSION, 2);
+    replayWriteLittleEndian(header + 8, seed, 8);
+    header[16] = GRID_WIDTH;
+    header[17] = GRID_HEIGHT;
+    header[18] = handling.das;
+    header[19] = handling.arr;
+    header[20] = handling.softDropFactor;
+    replayRecorderPush(recorder, header, sizeof(header));
+
+    atomic_store(&recorder->running, true);
+
+    if (pthread_create(&recorder->thread, NULL, replayRecorderThread, recorder) != 0)
+    {
+        fclose(recorder->file);
+        free(recorder->buffer);
+        recorder->file = NULL;
+        recorder->buffer = NULL;
+
+        return false;
+    }
+
+    recorder->recording = true;
+
+    return true;
+}
+
+static size_t replayEncodeEvent(ReplayRecorder *recorder, uint8_t *destination, int code)
+{
+    uint64_t delta = recorder->tick - recorder->lastEventTick;
+    recorder->lastEventTick = recorder->tick;
+
+    return replayWriteVarint(destination, delta << REPLAY_CODE_BITS | code);
+}
+
+void replayRecorderTick(ReplayRecorder *recorder, GameInput input, const Game *game)
+{
+    if (!recorder->recording)
+    {
+        return;
+    }
+
+    recorder->tick++;
+
+    GameInput changes = (input & ~GAME_INPUT_HELD_MASK) | ((input ^ recorder->held) & GAME_INPUT_HELD_MASK);
+    recorder->held = input & GAME_INPUT_HELD_MASK;
+
+    bool checkpoint = recorder->tick % REPLAY_CHECKPOINT_INTERVAL == 0;
+
+    if (!changes && !checkpoint)
+    {
+        return;
+    }
+
+    uint8_t bytes[REPLAY_MAX_TICK_BYTES];
+    size_t length = 0;
+
+    for (int code = 0; code < 8; code++)
+    {
+        if (changes & (1 << code))
+        {
+            length += replayEncodeEvent(recorder, bytes + length, code);
+        }
+    }
+
+    if (checkpoint)
+    {
+        length += replayEncodeEvent(recorder, bytes + length, REPLAY_CODE_CHECKPOINT);
+        length += replayWriteVarint(bytes + length, (uint32_t)game->score);
+        length += replayWriteVarint(bytes + length, game->lines);
+        length += replayWriteVarint(bytes + length, (uint32_t)gameChecksum(game));
+    }
+
+    if (!replayRecorderPush(recorder, bytes, length))
+    {
+        // The writer fell a whole buffer behind. Stop rather than write a replay that desyncs.
+        recorder->overflowed = true;
+        recorder->recording = false;
+    }
+}
+
+bool replayRecorderClose(ReplayRecorder *recorder, const Game *game)
+{
+    if (recorder->file == NULL)
+    {
+        return false;
+    }
+
+    if (recorder->recording)
+    {
+        uint8_t bytes[3 * 10];
+        size_t length = replayEncodeEvent(recorder, bytes, REPLAY_CODE_END);
+        length += replayWriteVarint(bytes + length, (uint32_t)game->score);
+        length += replayWriteVarint(bytes + length, game->lines);
+        replayRecorderPush(recorder, bytes, length);
+    }
+
+    atomic_store(&recorder->running, false);
+    pthread_join(recorder->thread, NULL);
+
+    bool ok = replayRecorderDrain(recorder);
+    ok &= fclose(recorder->file) == 0;
+    free(recorder->buffer);
+
+    recorder->file = NULL;
+    recorder->buffer = NULL;
+    recorder->recording = false;
+
+    if (recorder->overflowed)
+    {
+        fprintf(stderr, "replay: the writer fell behind, the recording stops at tick %u\n", recorder->tick);
+    }
+
+    return ok && !recorder->overflowed;
+}
+
+static void replayReaderAdvance(ReplayReader *reader)
+{
+    uint64_t event;
+
+    if (!replayReadVarint(reader->data, reader->size, &reader->position, &event))
+    {
+        reader->eventCode = -1;
+        return;
+    }
+
+    reader->eventTick += (uint32_t)(event >> REPLAY_CODE_BITS);
+    reader->eventCode = event & ((1 << REPLAY_CODE_BITS) - 1);
+
+    if (reader->eventCode == REPLAY_CODE_END)
+    {
+        uint64_t score = 0;
+        uint64_t lines = 0;
+
+        reader->endTick = reader->eventTick;
+        reader->complete = replayReadVarint(reader->data, reader->size, &reader->position, &score) &&
+                           replayReadVarint(reader->data, reader->size, &reader->position, &lines);
+        reader->score = score;
+        reader->lines = lines;
+    }
+    else if (reader->eventCode == REPLAY_CODE_CHECKPOINT)
+    {
+        uint64_t score = 0;
+        uint64_t lines = 0;
+        uint64_t checksum = 0;
+
+        if (!replayReadVarint(reader->data, reader->size, &reader->position, &score) ||
+            !replayReadVarint(reader->data, reader->size, &reader->position, &lines) ||
+            (reader->header.formatVersion >= 3 && !replayReadVarint(reader->data, reader->size, &reader->position, &checksum)))
+        {
+            reader->eventCode = -1;
+            return;
+        }
+
+        reader->nextCheckpoint = (ReplayCheckpoint){
+            .tick = reader->eventTick,
+            .score = score,
+            .lines = lines,
+            .checksum = checksum,
+        };
+    }
+}
+
+void replayReaderSkipToEnd(ReplayReader *reader)
+{
+    while (reader->eventCode >= 0 && reader->eventCode != REPLAY_CODE_END)
+    {
+        replayReaderAdvance(reader);
+    }
+}
+
+bool replayReaderOpen(ReplayReader *reader, const uint8_t *data, size_t size)
+{
+    memset(reader, 0, sizeof(*reader));
+
+    if (size < REPLAY_HEADER_SIZE_V3 || memcmp(data, REPLAY_MAGIC, 4) != 0)
+    {
+        return false;
+    }
+
+    reader->data = data;
+    reader->size = size;
+    reader->position = REPLAY_HEADER_SIZE_V3;
+    reader->header = (ReplayHeader){
+        .formatVersion = replayReadLittleEndian(data + 4, 2),
+        .rulesVersion = replayReadLittleEndian(data + 6, 2),
+        .seed = replayReadLittleEndian(data + 8, 8),
+        .width = data[16],
+        .height = data[17],
+    };
+
+    // Older versions are the current one with less in the header and the checkpoints.
+    if (reader->header.formatVersion < 1 || reader->header.formatVersion > REPLAY_FORMAT_VERSION)
+    {
+        return false;
+    }
+
+    if (reader->header.formatVersion >= 4)
+    {
+        if (size < REPLAY_HEADER_SIZE)
+        {
+            return false;
+        }
+
+        reader->position = REPLAY_HEADER_SIZE;
+        reader->header.handling = (GameHandling){
+            .das = data[18],
+            .arr = data[19],
+            .softDropFactor = data[20],
+        };
+    }
+
+    replayReaderAdvance(reader);
+
+    return true;
+}
+
+bool replayReaderNext(ReplayReader *reader, GameInput *input)
+{
+    GameInput presses = 0;
+
+    reader->tick++;
+    reader->hasCheckpoint = false;
+
+    while (reader->eventCode >= 0 && reader->eventCode != REPLAY_CODE_END && reader->eventTick == reader->tick)
+    {
+        if (reader->eventCode == REPLAY_CODE_CHECKPOINT)
+        {
+            reader->hasCheckpoint = true;
+            reader->checkpoint = reader->nextCheckpoint;
+        }
+        else if (reader->eventCode < REPLAY_CODE_END)
+        {
+            GameInput bit = 1 << reader->eventCode;
+
+            if (bit & GAME_INPUT_HELD_MASK)
+            {
+                reader->held ^= bit;
+            }
+            else
+            {
+                presses |= bit;
+            }
+        }
+
+        replayReaderAdvance(reader);
+    }
+
+    if (reader->eventCode < 0 || (reader->eventCode == REPLAY_CODE_END && reader->tick > reader->endTick))
+    {
+        return false;
+    }
+
+    *input = reader->held | presses;
+
+    return true;
+}
+
+// Whether game is where the checkpoint the reader just returned, if any, says it should be.
+static bool replayCheckpointMatches(const ReplayReader *reader, const Game *game)
+{
+    if (!reader->hasCheckpoint)
+    {
+        return true;
+    }
+
+    const ReplayCheckpoint *checkpoint = &reader->checkpoint;
+
+    return checkpoint->score == (uint32_t)game->score && checkpoint->lines == game->lines &&
+           (reader->header.formatVersion < 3 || checkpoint->checksum == (uint32_t)gameChecksum(game));
+}
+
+bool replayIsPlayable(const ReplayHeader *header)
+{
+    return header->formatVersion >= REPLAY_OLDEST_PLAYABLE_VERSION && header->rulesVersion == GAME_RULES_VERSION &&
+           header->width == GRID_WIDTH && header->height == GRID_HEIGHT;
+}
+
+bool replayVerify(const uint8_t *data, size_t size, ReplayVerification *verification)
+{
+    ReplayReader reader;
+    Game game;
+    GameInput input;
+
+    memset(verification, 0, sizeof(*verification));
+
+    if (!replayReaderOpen(&reader, data, size) || !replayIsPlayable(&reader.header))
+    {
+        return false;
+    }
+
+    gameInit(&game, reader.header.seed);
+    game.handling = reader.header.handling;
+
+    while (replayReaderNext(&reader, &input))
+    {
+        gameStep(&game, input);
+
+        if (!replayCheckpointMatches(&reader, &game))
+        {
+            verification->divergedAt = game.tick;
+            verification->expected = reader.checkpoint;
+            break;
+        }
+    }
+
+    verification->ticks = game.tick;
+    verification->complete = reader.complete;
+    verification->actual = (ReplayCheckpoint){
+        .tick = game.tick,
+        .score = game.score,
+        .lines = game.lines,
+        .checksum = gameChecksum(&game),
+    };
+
+    if (verification->divergedAt == 0 && reader.complete && (reader.score != (uint32_t)game.score || reader.lines != game.lines))
+    {
+        verification->divergedAt = game.tick;
+        verification->expected = (ReplayCheckpoint){
+            .tick = reader.endTick,
+            .score = reader.score,
+            .lines = reader.lines,
+        };
+    }
+
+    return true;
+}
+
+static bool replayKeyframeStep(ReplayKeyframe *keyframe)
+{
+    GameInput input;
+
+    if (!replayReaderNext(&keyframe->reader, &input))
+    {
+        return false;
+    }
+
+    gameStep(&keyframe->game, input);
+
+    return true;
+}
+
+bool replayPlayerOpen(ReplayPlayer *player, const uint8_t *data, size_t size)
+{
+    memset(player, 0, sizeof(*player));
+
+    ReplayKeyframe keyframe;
+
+    if (!replayReaderOpen(&keyframe.reader, data, size))
+    {
+        fprintf(stderr, "replay: not a replay, or newer than version %d\n", REPLAY_FORMAT_VERSION);
+        return false;
+    }
+
+    const ReplayHeader *header = &keyframe.reader.header;
+
+    if (!replayIsPlayable(header))
+    {
+        fprintf(stderr, "replay: recorded in format version %d with rules version %d on a %dx%d board, "
+                        "this build plays format %d or later with rules version %d on %dx%d\n",
+                header->formatVersion, header->rulesVersion, header->width, header->height, REPLAY_OLDEST_PLAYABLE_VERSION, GAME_RULES_VERSION, GRID_WIDTH, GRID_HEIGHT);
+        return false;
+    }
+
+    gameInit(&keyframe.game, header->seed);
+    keyframe.game.handling = header->handling;
+
+    size_t capacity = 0;
+
+    do
+    {
+        if (keyframe.game.tick % REPLAY_KEYFRAME_INTERVAL == 0)
+        {
+            if (player->keyframeCount == capacity)
+            {
+                capacity = capacity ? capacity * 2 : 64;
+                ReplayKeyframe *keyframes = realloc(player->keyframes, capacity * sizeof(ReplayKeyframe));
+
+                if (keyframes == NULL)
+                {
+                    replayPlayerClose(player);
+                    return false;
+                }
+
+                player->keyframes = keyframes;
+            }
+
+            player->keyframes[player->keyframeCount++] = keyframe;
+        }
+
+        if (player->divergedAt == 0 && !replayCheckpointMatches(&keyframe.reader, &keyframe.game))
+        {
+            player->divergedAt = keyframe.game.tick;
+        }
+    } while (replayKeyframeStep(&keyframe));
+
+    player->length = keyframe.game.tick;
+    player->current = player->keyframes[0];
+
+    return true;
+}
+
+void replayPlayerClose(ReplayPlayer *player)
+{
+    free(player->keyframes);
+    player->keyframes = NULL;
+    player->keyframeCount = 0;
+}
+
+bool replayPlayerStep(ReplayPlayer *player)
+{
+    return player->current.game.tick < player->length && replayKeyframeStep(&player->current);
+}
+
+void replayPlayerSeek(ReplayPlayer *player, uint32_t tick)
+{
+    tick = tick < player->length ? tick : player->length;
+
+    size_t index = tick / REPLAY_KEYFRAME_INTERVAL;
+    index = index < player->keyframeCount ? index : player->keyframeCount - 1;
+
+    // Going forward within the same interval, carrying on from here is cheaper.
+    if (player->current.game.tick > tick || player->current.game.tick < index * REPLAY_KEYFRAME_INTERVAL)
+    {
+        player->current = player->keyframes[index];
+    }
+
+    while (player->current.game.tick < tick && replayKeyframeStep(&player->current))
+    {
+        ;
+    }
+}
+
+#endif // REPLAY_IMPLEMENTATION
@@ -0,0 +1,182 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include "tetris.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The last few seconds of a game, to step back through in practice mode.
+//
+// Every tick stores the Game minus its grid, about a hundred bytes. The grid only changes when a
+// piece locks or the game restarts, so it goes to a second ring only then, and each tick refers
+// to the grid it had. Both rings are allocated once by rewindInit. When pieces lock faster than
+// the grid ring was sized for, the oldest ticks lose their grid and drop out of reach early.
+
+// Grids stored for every this many ticks of history, one lock every quarter second.
+#define REWIND_TICKS_PER_GRID 15
+
+#define REWIND_STATE_OFFSET offsetof(Game, piece)
+#define REWIND_STATE_SIZE (GAME_SNAPSHOT_SIZE - REWIND_STATE_OFFSET)
+
+typedef struct RewindTick
+{
+    uint64_t grid; // sequence number of the grid in the grid ring
+    uint8_t state[REWIND_STATE_SIZE];
+} RewindTick;
+
+typedef struct Rewind
+{
+    RewindTick *ticks;
+    Block (*grids)[GRID_WIDTH * GRID_HEIGHT];
+    size_t tickCapacity;
+    size_t gridCapacity;
+
+    // Everything is counted from the start, slots are counts modulo the capacity.
+    uint64_t tickHead;
+    uint64_t tickTail;
+    uint64_t gridHead;
+
+    uint32_t lastGame;
+    uint32_t lastPiecesLocked;
+} Rewind;
+
+bool rewindInit(Rewind *rewind, double seconds);
+void rewindFree(Rewind *rewind);
+size_t rewindMemory(const Rewind *rewind);
+// Forgets the history, for a game that does not follow on from the recorded one.
+void rewindClear(Rewind *rewind);
+
+void rewindRecord(Rewind *rewind, const Game *game);
+// Restores the latest recorded tick before the game's current one and forgets the ticks after it.
+// Returns false when there is no such tick left.
+bool rewindStepBack(Rewind *rewind, Game *game);
+double rewindSecondsAvailable(const Rewind *rewind);
+
+#endif // REWIND_H
+
+#if defined(REWIND_IMPLEMENTATION) && !defined(REWIND_IMPLEMENTED)
+#define REWIND_IMPLEMENTED
+
+#include <stdlib.h>
+#include <string.h>
+
+_Static_assert(offsetof(Game, grid) == 0, "the grid is stored apart from the rest of the state");
+
+bool rewindInit(Rewind *rewind, double seconds)
+{
+    memset(rewind, 0, sizeof(*rewind));
+
+    rewind->tickCapacity = seconds * GAME_TICKS_PER_SECOND;
+    rewind->tickCapacity = rewind->tickCapacity < 2 ? 2 : rewind->tickCapacity;
+    rewind->gridCapacity = rewind->tickCapacity / REWIND_TICKS_PER_GRID + 2;
+    rewind->ticks = malloc(rewind->tickCapacity * sizeof(RewindTick));
+    rewind->grids = malloc(rewind->gridCapacity * sizeof(rewind->grids[0]));
+
+    if (rewind->ticks == NULL || rewind->grids == NULL)
+    {
+        rewindFree(rewind);
+        return false;
+    }
+
+    return true;
+}
+
+void rewindFree(Rewind *rewind)
+{
+    free(rewind->ticks);
+    free(rewind->grids);
+    memset(rewind, 0, sizeof(*rewind));
+}
+
+size_t rewindMemory(const Rewind *rewind)
+{
+    return rewind->tickCapacity * sizeof(RewindTick) + rewind->gridCapacity * sizeof(rewind->grids[0]);
+}
+
+void rewindClear(Rewind *rewind)
+{
+    rewind->tickHead = 0;
+    rewind->tickTail = 0;
+    rewind->gridHead = 0;
+}
+
+static uint32_t rewindTickOf(const RewindTick *tick)
+{
+    uint32_t value;
+    memcpy(&value, tick->state + offsetof(Game, tick) - REWIND_STATE_OFFSET, sizeof(value));
+    return value;
+}
+
+void rewindRecord(Rewind *rewind, const Game *game)
+{
+    if (rewind->ticks == NULL)
+    {
+        return;
+    }
+
+    bool gridChanged = rewind->gridHead == 0 || game->games != rewind->lastGame || game->piecesLocked != rewind->lastPiecesLocked;
+
+    if (gridChanged)
+    {
+        memcpy(rewind->grids[rewind->gridHead % rewind->gridCapacity], game->grid, sizeof(game->grid));
+        rewind->gridHead++;
+        rewind->lastGame = game->games;
+        rewind->lastPiecesLocked = game->piecesLocked;
+    }
+
+    RewindTick *tick = &rewind->ticks[rewind->tickHead % rewind->tickCapacity];
+    tick->grid = rewind->gridHead - 1;
+    memcpy(tick->state, (const uint8_t *)game + REWIND_STATE_OFFSET, REWIND_STATE_SIZE);
+    rewind->tickHead++;
+
+    if (rewind->tickHead - rewind->tickTail > rewind->tickCapacity)
+    {
+        rewind->tickTail = rewind->tickHead - rewind->tickCapacity;
+    }
+
+    // Ticks whose grid has just been overwritten cannot be restored any more.
+    while (rewind->tickTail < rewind->tickHead &&
+           rewind->gridHead - rewind->ticks[rewind->tickTail % rewind->tickCapacity].grid > rewind->gridCapacity)
+    {
+        rewind->tickTail++;
+    }
+}
+
+bool rewindStepBack(Rewind *rewind, Game *game)
+{
+    if (rewind->tickHead == rewind->tickTail)
+    {
+        return false;
+    }
+
+    // The latest tick is usually the current state, unless the game went on without being
+    // recorded, as it does while dead.
+    if (rewindTickOf(&rewind->ticks[(rewind->tickHead - 1) % rewind->tickCapacity]) >= game->tick)
+    {
+        if (rewind->tickHead - rewind->tickTail < 2)
+        {
+            return false;
+        }
+
+        rewind->tickHead--;
+    }
+
+    const RewindTick *tick = &rewind->ticks[(rewind->tickHead - 1) % rewind->tickCapacity];
+    memcpy(game->grid, rewind->grids[tick->grid % rewind->gridCapacity], sizeof(game->grid));
+    memcpy((uint8_t *)game + REWIND_STATE_OFFSET, tick->state, REWIND_STATE_SIZE);
+
+    // Grids newer than this tick's are free again, and the next record compares against it.
+    rewind->gridHead = tick->grid + 1;
+    rewind->lastGame = game->games;
+    rewind->lastPiecesLocked = game->piecesLocked;
+
+    return true;
+}
+
+double rewindSecondsAvailable(const Rewind *rewind)
+{
+    return (double)(rewind->tickHead - rewind->tickTail) / GAME_TICKS_PER_SECOND;
+}
+
+#endif // REWIND_IMPLEMENTATION
@@ -0,0 +1,273 @@
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include "tetris.h"
+#include "spectate.h"
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The game's ticks in POSIX shared memory, for overlays, recorders and bots on the same machine.
+//
+// The game writes every tick as a spectator frame (see spectate.h) into the next slot of a ring,
+// and any number of processes read the ring without a system call or a lock. Each slot has a
+// sequence number: odd while the game writes frame n into it, 2n + 2 once it is complete. A
+// reader checks it before and after copying a frame, so it notices when the game lapped it and
+// overwrote the slot, and then starts again from the latest keyframe. The game never waits for
+// readers.
+
+#define SHMRING_MAGIC "TRSH"
+#define SHMRING_VERSION 1
+// Slots in the ring, about four seconds of ticks, a power of two.
+#define SHMRING_SLOTS 256
+
+typedef struct ShmRingSlot
+{
+    _Alignas(64) _Atomic uint64_t sequence;
+    uint32_t size;
+    uint8_t frame[SPECTATE_MAX_FRAME];
+} ShmRingSlot;
+
+typedef struct ShmRing
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t slotSize;
+    _Alignas(64) _Atomic uint64_t head; // frames published
+    _Atomic uint64_t keyframe;          // number of the latest keyframe
+    ShmRingSlot slots[SHMRING_SLOTS];
+} ShmRing;
+
+typedef struct ShmRingWriter
+{
+    ShmRing *ring;
+    char name[64];
+    SpectateEncoder encoder;
+    uint32_t ticks;
+} ShmRingWriter;
+
+typedef struct ShmRingReader
+{
+    const ShmRing *ring;
+    uint64_t next;
+    bool synced; // false until a keyframe has been read, and again after an overrun
+    uint64_t overruns;
+} ShmRingReader;
+
+// name is a shared memory object name like "/tetris". Creates or replaces it.
+bool shmRingWriterOpen(ShmRingWriter *writer, const char *name);
+// Publishes the tick that just ran on game.
+void shmRingWriterTick(ShmRingWriter *writer, const Game *game);
+// Removes the shared memory object; readers that have it mapped keep their view.
+void shmRingWriterClose(ShmRingWriter *writer);
+
+// Starts reading at the latest keyframe.
+bool shmRingReaderOpen(ShmRingReader *reader, const char *name);
+// Copies the next frame into frame, SPECTATE_MAX_FRAME bytes. Returns its size, 0 when there is
+// nothing new yet.
+size_t shmRingRead(ShmRingReader *reader, uint8_t *frame);
+void shmRingReaderClose(ShmRingReader *reader);
+
+#endif // SHMRING_H
+
+#if defined(SHMRING_IMPLEMENTATION) && !defined(SHMRING_IMPLEMENTED)
+#define SHMRING_IMPLEMENTED
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+_Static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "sequence numbers are shared between processes");
+_Static_assert((SHMRING_SLOTS & (SHMRING_SLOTS - 1)) == 0, "the slot count must be a power of two");
+
+bool shmRingWriterOpen(ShmRingWriter *writer, const char *name)
+{
+    memset(writer, 0, sizeof(*writer));
+    snprintf(writer->name, sizeof(writer->name), "%s", name);
+
+    int descriptor = shm_open(name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+
+    if (descriptor < 0 || ftruncate(descriptor, sizeof(ShmRing)) != 0)
+    {
+        perror(name);
+
+        if (descriptor >= 0)
+        {
+            close(descriptor);
+            shm_unlink(name);
+        }
+
+        return false;
+    }
+
+    void *memory = mmap(NULL, sizeof(ShmRing), PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    close(descriptor);
+
+    if (memory == MAP_FAILED)
+    {
+        perror(name);
+        shm_unlink(name);
+        return false;
+    }
+
+    // Zero already, but writing it now takes the page faults here rather than during the game.
+    // Every slot starts at sequence 0, before frame 0.
+    memset(memory, 0, sizeof(ShmRing));
+    writer->ring = memory;
+    writer->ring->version = SHMRING_VERSION;
+    writer->ring->slotCount = SHMRING_SLOTS;
+    writer->ring->slotSize = sizeof(ShmRingSlot);
+    atomic_thread_fence(memory_order_release);
+    memcpy(writer->ring->magic, SHMRING_MAGIC, 4);
+
+    return true;
+}
+
+void shmRingWriterTick(ShmRingWriter *writer, const Game *game)
+{
+    if (writer->ring == NULL)
+    {
+        return;
+    }
+
+    uint8_t frame[SPECTATE_MAX_FRAME];
+    bool keyframe = writer->ticks++ % SPECTATE_KEYFRAME_INTERVAL == 0;
+    size_t size = spectateEncode(&writer->encoder, game, keyframe, frame);
+
+    if (size == 0)
+    {
+        return;
+    }
+
+    ShmRing *ring = writer->ring;
+    uint64_t n = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    ShmRingSlot *slot = &ring->slots[n % SHMRING_SLOTS];
+
+    atomic_store_explicit(&slot->sequence, 2 * n + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    slot->size = size;
+    memcpy(slot->frame, frame, size);
+
+    atomic_store_explicit(&slot->sequence, 2 * n + 2, memory_order_release);
+    atomic_store_explicit(&ring->head, n + 1, memory_order_release);
+
+    if (keyframe)
+    {
+        atomic_store_explicit(&ring->keyframe, n, memory_order_release);
+    }
+}
+
+void shmRingWriterClose(ShmRingWriter *writer)
+{
+    if (writer->ring != NULL)
+    {
+        munmap(writer->ring, sizeof(ShmRing));
+        shm_unlink(writer->name);
+    }
+
+    memset(writer, 0, sizeof(*writer));
+}
+
+bool shmRingReaderOpen(ShmRingReader *reader, const char *name)
+{
+    memset(reader, 0, sizeof(*reader));
+
+    int descriptor = shm_open(name, O_RDONLY, 0);
+    void *memory = descriptor >= 0 ? mmap(NULL, sizeof(ShmRing), PROT_READ, MAP_SHARED, descriptor, 0) : MAP_FAILED;
+
+    if (descriptor >= 0)
+    {
+        close(descriptor);
+    }
+
+    if (memory == MAP_FAILED)
+    {
+        perror(name);
+        return false;
+    }
+
+    const ShmRing *ring = memory;
+
+    if (memcmp(ring->magic, SHMRING_MAGIC, 4) != 0 || ring->version != SHMRING_VERSION ||
+        ring->slotCount != SHMRING_SLOTS || ring->slotSize != sizeof(ShmRingSlot))
+    {
+        fprintf(stderr, "%s: not a ring this build can read\n", name);
+        munmap(memory, sizeof(ShmRing));
+        return false;
+    }
+
+    reader->ring = ring;
+    reader->next = atomic_load_explicit((_Atomic uint64_t *)&ring->keyframe, memory_order_acquire);
+
+    return true;
+}
+
+size_t shmRingRead(ShmRingReader *reader, uint8_t *frame)
+{
+    const ShmRing *ring = reader->ring;
+
+    while (true)
+    {
+        uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+        if (reader->next >= head)
+        {
+            return 0;
+        }
+
+        const ShmRingSlot *slot = &ring->slots[reader->next % SHMRING_SLOTS];
+        uint64_t expected = 2 * reader->next + 2;
+        uint64_t before = atomic_load_explicit((_Atomic uint64_t *)&slot->sequence, memory_order_acquire);
+        uint32_t size = slot->size;
+
+        if (before == expected && size <= SPECTATE_MAX_FRAME)
+        {
+            memcpy(frame, slot->frame, size);
+        }
+
+        atomic_thread_fence(memory_order_acquire);
+        uint64_t after = atomic_load_explicit((_Atomic uint64_t *)&slot->sequence, memory_order_relaxed);
+
+        if (before != expected || after != expected || size > SPECTATE_MAX_FRAME)
+        {
+            // Lapped, or the latest keyframe is not written yet.
+            reader->overruns += before > expected || after != before;
+            reader->synced = false;
+            reader->next = atomic_load_explicit((_Atomic uint64_t *)&ring->keyframe, memory_order_acquire);
+
+            if (reader->next >= head)
+            {
+                return 0;
+            }
+
+            continue;
+        }
+
+        reader->next++;
+
+        if (!reader->synced && frame[2] != SPECTATE_FRAME_KEYFRAME)
+        {
+            continue;
+        }
+
+        reader->synced = true;
+        return size;
+    }
+}
+
+void shmRingReaderClose(ShmRingReader *reader)
+{
+    if (reader->ring != NULL)
+    {
+        munmap((void *)reader->ring, sizeof(ShmRing));
+    }
+
+    memset(reader, 0, sizeof(*reader));
+}
+
+#endif // SHMRING_IMPLEMENTATION
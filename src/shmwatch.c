@@ -0,0 +1,115 @@
+#define TETRIS_IMPLEMENTATION
+#include "tetris.h"
+
+#define SPECTATE_IMPLEMENTATION
+#include "spectate.h"
+
+#define SHMRING_IMPLEMENTATION
+#include "shmring.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Follows a game published with --shm and prints once a second how many frames it read, how
+// often it was lapped and where the game is. --delay makes it a slow reader on purpose, to see it
+// resynchronise; --spin polls without sleeping, for the lowest latency.
+
+static double shmwatchNow(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void shmwatchSleep(double seconds)
+{
+    struct timespec duration = {
+        .tv_sec = (time_t)seconds,
+        .tv_nsec = (long)((seconds - (time_t)seconds) * 1e9),
+    };
+    nanosleep(&duration, NULL);
+}
+
+int main(int argc, char **argv)
+{
+    const char *name = "/tetris";
+    bool spin = false;
+    double delay = 0;
+    double seconds = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--spin") == 0)
+        {
+            spin = true;
+        }
+        else if (strcmp(argv[i], "--delay") == 0 && i + 1 < argc)
+        {
+            delay = atof(argv[++i]) / 1000.0;
+        }
+        else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc)
+        {
+            seconds = atof(argv[++i]);
+        }
+        else if (argv[i][0] == '/')
+        {
+            name = argv[i];
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [/name] [--spin] [--delay milliseconds] [--seconds s]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    ShmRingReader reader;
+
+    if (!shmRingReaderOpen(&reader, name))
+    {
+        return 1;
+    }
+
+    Game board = {0};
+    uint8_t frame[SPECTATE_MAX_FRAME];
+    uint64_t frames = 0;
+    uint64_t bad = 0;
+    double start = shmwatchNow();
+    double nextReport = start + 1;
+
+    while (seconds <= 0 || shmwatchNow() - start < seconds)
+    {
+        size_t size = shmRingRead(&reader, frame);
+
+        if (size > 0)
+        {
+            bad += !spectateDecode(&board, frame, size);
+            frames++;
+
+            if (delay > 0)
+            {
+                shmwatchSleep(delay);
+            }
+        }
+        else if (!spin)
+        {
+            shmwatchSleep(0.001);
+        }
+
+        double now = shmwatchNow();
+
+        if (now >= nextReport)
+        {
+            printf("%llu frames, %llu overruns, %llu bad, tick %u score %d lines %u level %d%s\n",
+                   (unsigned long long)frames, (unsigned long long)reader.overruns, (unsigned long long)bad,
+                   board.tick, board.score, board.lines, board.level, board.dead ? " (dead)" : "");
+            fflush(stdout);
+            nextReport = now + 1;
+        }
+    }
+
+    shmRingReaderClose(&reader);
+
+    return bad > 0 ? 1 : 0;
+}
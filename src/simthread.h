@@ -0,0 +1,159 @@
+#ifndef SIMTHREAD_H
+#define SIMTHREAD_H
+
+#include "input.h"
+#include "perf.h"
+#include "tetris.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// What the render thread and the simulation thread hand each other, so that neither ever waits
+// for the other.
+//
+// The render thread sends key events and its finished frames over a single-producer
+// single-consumer queue. The simulation thread publishes what a frame draws through a triple
+// buffer: it always has a slot of its own to write the next snapshot into, and the render thread
+// always has the latest complete one to read. Both are wait-free: a push to a full queue fails and
+// the sender keeps the message for later, and a render thread that finds nothing new draws the
+// snapshot it already has.
+
+// Messages, a power of two. The simulation thread drains the queue every tick.
+#define SIM_QUEUE_SIZE 64
+
+typedef enum SimMessageType
+{
+    SIM_MESSAGE_INPUT = 0, // applied on the first tick due at or after its time
+    SIM_MESSAGE_FRAME,     // for the flight recorder, which keeps frames and ticks together
+} SimMessageType;
+
+typedef struct SimMessage
+{
+    SimMessageType type;
+    union
+    {
+        InputEvent input;
+        PerfFrame frame;
+    };
+} SimMessage;
+
+typedef struct SimQueue
+{
+    SimMessage messages[SIM_QUEUE_SIZE];
+    _Atomic uint32_t head; // only the consumer writes it
+    _Atomic uint32_t tail; // only the producer writes it
+} SimQueue;
+
+// Returns false when the queue is full.
+bool simQueuePush(SimQueue *queue, const SimMessage *message);
+// Returns false when the queue is empty.
+bool simQueuePop(SimQueue *queue, SimMessage *message);
+
+// Indices into three slots the caller keeps. The writer owns back and the reader owns front; the
+// third is in the middle, waiting to be swapped into either.
+typedef struct TripleBuffer
+{
+    _Atomic uint32_t middle; // with TRIPLE_BUFFER_FRESH when the reader has not taken it yet
+    uint32_t back;
+    uint32_t front;
+} TripleBuffer;
+
+#define TRIPLE_BUFFER_FRESH 4
+
+void tripleBufferInit(TripleBuffer *buffer);
+// Hands the slot at back to the reader. Returns the slot to write next.
+uint32_t tripleBufferPublish(TripleBuffer *buffer);
+// Returns the slot with the latest published data, which stays put until the next call.
+uint32_t tripleBufferAcquire(TripleBuffer *buffer);
+
+// CLOCK_MONOTONIC in seconds, the simulation thread's clock.
+double simNow(void);
+void simSleepUntil(double time);
+
+#endif // SIMTHREAD_H
+
+#if defined(SIMTHREAD_IMPLEMENTATION) && !defined(SIMTHREAD_IMPLEMENTED)
+#define SIMTHREAD_IMPLEMENTED
+
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+
+bool simQueuePush(SimQueue *queue, const SimMessage *message)
+{
+    uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+
+    if (tail - head == SIM_QUEUE_SIZE)
+    {
+        return false;
+    }
+
+    queue->messages[tail % SIM_QUEUE_SIZE] = *message;
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+bool simQueuePop(SimQueue *queue, SimMessage *message)
+{
+    uint32_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+    if (head == tail)
+    {
+        return false;
+    }
+
+    *message = queue->messages[head % SIM_QUEUE_SIZE];
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return true;
+}
+
+void tripleBufferInit(TripleBuffer *buffer)
+{
+    buffer->back = 0;
+    atomic_store(&buffer->middle, 1);
+    buffer->front = 2;
+}
+
+uint32_t tripleBufferPublish(TripleBuffer *buffer)
+{
+    uint32_t previous = atomic_exchange_explicit(&buffer->middle, buffer->back | TRIPLE_BUFFER_FRESH, memory_order_acq_rel);
+    buffer->back = previous & ~TRIPLE_BUFFER_FRESH;
+    return buffer->back;
+}
+
+uint32_t tripleBufferAcquire(TripleBuffer *buffer)
+{
+    if (atomic_load_explicit(&buffer->middle, memory_order_relaxed) & TRIPLE_BUFFER_FRESH)
+    {
+        // Only the writer sets the flag again, so the middle slot is still fresh when swapped.
+        uint32_t previous = atomic_exchange_explicit(&buffer->middle, buffer->front, memory_order_acq_rel);
+        buffer->front = previous & ~TRIPLE_BUFFER_FRESH;
+    }
+
+    return buffer->front;
+}
+
+double simNow(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+void simSleepUntil(double time)
+{
+    struct timespec until = {
+        .tv_sec = (time_t)floor(time),
+        .tv_nsec = (long)((time - floor(time)) * 1e9),
+    };
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR)
+    {
+        ;
+    }
+}
+
+#endif // SIMTHREAD_IMPLEMENTATION
@@ -0,0 +1,49 @@
+#ifndef SORT_H
+#define SORT_H
+
+#include <stddef.h>
+
+// Sorts in place without allocating. glibc's qsort mallocs a scratch buffer for anything over
+// 1 KiB, which the frame loop must not do.
+
+static inline void sortSiftDown(float *values, size_t root, size_t count)
+{
+    while (2 * root + 1 < count)
+    {
+        size_t child = 2 * root + 1;
+
+        if (child + 1 < count && values[child + 1] > values[child])
+        {
+            child++;
+        }
+
+        if (values[root] >= values[child])
+        {
+            return;
+        }
+
+        float swap = values[root];
+        values[root] = values[child];
+        values[child] = swap;
+        root = child;
+    }
+}
+
+// Ascending, heapsort.
+static inline void sortFloats(float *values, size_t count)
+{
+    for (size_t root = count / 2; root > 0; root--)
+    {
+        sortSiftDown(values, root - 1, count);
+    }
+
+    for (size_t end = count; end > 1; end--)
+    {
+        float swap = values[0];
+        values[0] = values[end - 1];
+        values[end - 1] = swap;
+        sortSiftDown(values, 0, end - 1);
+    }
+}
+
+#endif // SORT_H
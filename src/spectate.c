@@ -0,0 +1,267 @@
+#define TETRIS_IMPLEMENTATION
+#include "tetris.h"
+
+#define SPECTATE_IMPLEMENTATION
+#include "spectate.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+// Watches a game served with --spectate-port. Every connection decodes its stream into a board,
+// and once a second the tool prints what they received and where the first one is in the game.
+// With --clients n it opens n connections at once, to see how many spectators the server keeps up
+// with.
+
+#define VIEWER_BUFFER_SIZE 8192
+
+typedef struct Viewer
+{
+    int socket;
+    uint8_t buffer[VIEWER_BUFFER_SIZE];
+    size_t used;
+    bool greeted;
+    bool failed;
+    Game board;
+    uint64_t frames;
+    uint64_t keyframes;
+    uint64_t bytes;
+} Viewer;
+
+static double viewerNow(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static int viewerConnect(const struct addrinfo *address)
+{
+    int descriptor = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+
+    if (descriptor < 0 || connect(descriptor, address->ai_addr, address->ai_addrlen) != 0)
+    {
+        if (descriptor >= 0)
+        {
+            close(descriptor);
+        }
+
+        return -1;
+    }
+
+    fcntl(descriptor, F_SETFL, O_NONBLOCK);
+    return descriptor;
+}
+
+// Reads what arrived and decodes every complete frame. Returns false once the connection is over.
+static bool viewerRead(Viewer *viewer)
+{
+    while (true)
+    {
+        ssize_t received = recv(viewer->socket, viewer->buffer + viewer->used, VIEWER_BUFFER_SIZE - viewer->used, 0);
+
+        if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+        {
+            return false;
+        }
+
+        if (received < 0)
+        {
+            return true;
+        }
+
+        viewer->used += received;
+        viewer->bytes += received;
+
+        size_t position = 0;
+
+        if (!viewer->greeted && viewer->used >= SPECTATE_GREETING_SIZE)
+        {
+            const uint8_t *greeting = viewer->buffer;
+
+            if (memcmp(greeting, SPECTATE_MAGIC, 4) != 0 || (greeting[4] | greeting[5] << 8) != SPECTATE_VERSION ||
+                greeting[6] != GRID_WIDTH || greeting[7] != GRID_HEIGHT)
+            {
+                viewer->failed = true;
+                return false;
+            }
+
+            viewer->greeted = true;
+            position = SPECTATE_GREETING_SIZE;
+        }
+
+        size_t size;
+
+        while (viewer->greeted && (size = spectateFrameSize(viewer->buffer + position, viewer->used - position)) > 0)
+        {
+            const uint8_t *frame = viewer->buffer + position;
+
+            if (!spectateDecode(&viewer->board, frame, size))
+            {
+                viewer->failed = true;
+                return false;
+            }
+
+            viewer->frames++;
+            viewer->keyframes += frame[2] == SPECTATE_FRAME_KEYFRAME;
+            position += size;
+        }
+
+        memmove(viewer->buffer, viewer->buffer + position, viewer->used - position);
+        viewer->used -= position;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *target = NULL;
+    long clients = 1;
+    double seconds = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--clients") == 0 && i + 1 < argc)
+        {
+            clients = atol(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc)
+        {
+            seconds = atof(argv[++i]);
+        }
+        else if (target == NULL && strchr(argv[i], ':') != NULL)
+        {
+            target = argv[i];
+        }
+        else
+        {
+            target = NULL;
+            break;
+        }
+    }
+
+    if (target == NULL || clients < 1)
+    {
+        fprintf(stderr, "usage: %s <host:port> [--clients n] [--seconds s]\n", argv[0]);
+        return 1;
+    }
+
+    // Every connection is a file descriptor.
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    const char *port = strrchr(target, ':');
+    char host[256];
+    snprintf(host, sizeof(host), "%.*s", (int)(port - target), target);
+
+    struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *address = NULL;
+    int error = getaddrinfo(host, port + 1, &hints, &address);
+
+    if (error != 0)
+    {
+        fprintf(stderr, "%s: %s\n", host, gai_strerror(error));
+        return 1;
+    }
+
+    Viewer *viewers = calloc(clients, sizeof(Viewer));
+    int epoll = epoll_create1(0);
+    long connected = 0;
+
+    for (long i = 0; i < clients; i++)
+    {
+        viewers[i].socket = viewerConnect(address);
+
+        if (viewers[i].socket < 0)
+        {
+            perror("connect");
+            break;
+        }
+
+        struct epoll_event event = {.events = EPOLLIN | EPOLLRDHUP, .data.ptr = &viewers[i]};
+        epoll_ctl(epoll, EPOLL_CTL_ADD, viewers[i].socket, &event);
+        connected++;
+    }
+
+    freeaddrinfo(address);
+
+    if (connected == 0)
+    {
+        return 1;
+    }
+
+    double start = viewerNow();
+    double nextReport = start + 1;
+    uint64_t lastFrames = 0;
+    uint64_t lastBytes = 0;
+    long open = connected;
+    struct epoll_event events[256];
+
+    while (open > 0 && (seconds <= 0 || viewerNow() - start < seconds))
+    {
+        int count = epoll_wait(epoll, events, 256, 100);
+
+        for (int i = 0; i < count; i++)
+        {
+            Viewer *viewer = events[i].data.ptr;
+
+            if (!viewerRead(viewer))
+            {
+                close(viewer->socket);
+                viewer->socket = -1;
+                open--;
+            }
+        }
+
+        double now = viewerNow();
+
+        if (now >= nextReport)
+        {
+            uint64_t frames = 0;
+            uint64_t bytes = 0;
+
+            for (long i = 0; i < connected; i++)
+            {
+                frames += viewers[i].frames;
+                bytes += viewers[i].bytes;
+            }
+
+            const Game *board = &viewers[0].board;
+            printf("%ld viewers, %.0f frames/s, %.2f KiB/s each, tick %u score %d lines %u level %d%s\n",
+                   open, (frames - lastFrames) / (now - nextReport + 1), (bytes - lastBytes) / 1024.0 / (now - nextReport + 1) / connected,
+                   board->tick, board->score, board->lines, board->level, board->dead ? " (dead)" : "");
+
+            lastFrames = frames;
+            lastBytes = bytes;
+            nextReport = now + 1;
+        }
+    }
+
+    long failed = 0;
+
+    for (long i = 0; i < connected; i++)
+    {
+        failed += viewers[i].failed;
+
+        if (viewers[i].socket >= 0)
+        {
+            close(viewers[i].socket);
+        }
+    }
+
+    printf("%ld of %ld viewers connected, %ld disconnected, %ld received a bad stream\n", connected, clients, connected - open, failed);
+
+    free(viewers);
+    close(epoll);
+
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,670 @@
+#ifndef SPECTATE_H
+#define SPECTATE_H
+
+#include "tetris.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Live game broadcast: the game thread encodes every tick once into a ring buffer, and a server
+// thread sends that same buffer to every spectator over TCP from an epoll loop. The game thread
+// never makes a system call for it; the server thread wakes up on its own every
+// SPECTATE_FLUSH_INTERVAL milliseconds and sends whatever is new.
+//
+// A connection starts with "TRSP", u16 SPECTATE_VERSION, u8 width, u8 height, then frames:
+//   u16 size of the rest, u8 type (KEYFRAME or DELTA), u32 tick, u8 changes, then one section per
+//   change bit, in bit order:
+//   ROWS   u32 mask of the grid rows that follow, each GRID_WIDTH RGBA cells
+//   PIECE  active piece: u8 type, RGBA, u8 orientation, i8 x, i8 y
+//   QUEUE  NEXT_PIECES_COUNT pieces as u8 type and RGBA, u8 has saved piece, saved piece
+//   SCORE  u32 score, u32 lines, u8 level
+//   FLAGS  u8 dead | paused << 1
+//
+// A DELTA only has what changed since the previous frame, and ticks where nothing did send
+// nothing. A KEYFRAME has everything and is sent every SPECTATE_KEYFRAME_INTERVAL ticks; new
+// spectators start from the latest one. A spectator a whole buffer behind is disconnected.
+
+#define SPECTATE_MAGIC "TRSP"
+#define SPECTATE_VERSION 1
+#define SPECTATE_GREETING_SIZE 8
+#define SPECTATE_KEYFRAME_INTERVAL 120
+#define SPECTATE_MAX_FRAME 1024
+// Bytes of frames kept for spectators, a power of two.
+#define SPECTATE_BUFFER_SIZE (1 << 20)
+// Milliseconds between sends, half a tick.
+#define SPECTATE_FLUSH_INTERVAL 8
+
+#define SPECTATE_FRAME_KEYFRAME 1
+#define SPECTATE_FRAME_DELTA 2
+
+#define SPECTATE_CHANGED_ROWS (1 << 0)
+#define SPECTATE_CHANGED_PIECE (1 << 1)
+#define SPECTATE_CHANGED_QUEUE (1 << 2)
+#define SPECTATE_CHANGED_SCORE (1 << 3)
+#define SPECTATE_CHANGED_FLAGS (1 << 4)
+#define SPECTATE_CHANGED_ALL 0x1F
+
+typedef struct SpectateEncoder
+{
+    Game last;
+    bool hasLast;
+} SpectateEncoder;
+
+// Encodes game as a frame into frame, SPECTATE_MAX_FRAME bytes. Returns its size, 0 for a delta
+// with nothing in it.
+size_t spectateEncode(SpectateEncoder *encoder, const Game *game, bool keyframe, uint8_t *frame);
+// The size of the complete frame at the start of data, 0 while more bytes are needed.
+size_t spectateFrameSize(const uint8_t *data, size_t available);
+// Applies a frame to board, which only gets the fields the stream carries. Fails on a bad frame.
+bool spectateDecode(Game *board, const uint8_t *frame, size_t size);
+
+typedef struct SpectateClient
+{
+    int socket;
+    uint64_t position; // in the stream of every byte ever put in the buffer
+    bool blocked;      // the socket was full, sending resumes on EPOLLOUT
+    bool closed;       // the spectator left or its socket failed
+} SpectateClient;
+
+typedef struct SpectateServer
+{
+    int listener;
+    int epoll;
+    pthread_t thread;
+    atomic_bool running;
+
+    uint8_t *buffer;
+    _Atomic uint64_t head;     // bytes published
+    _Atomic uint64_t reserved; // bytes published or being written
+    _Atomic uint64_t keyframe; // stream position of the latest keyframe, UINT64_MAX before the first
+
+    // Game thread only.
+    SpectateEncoder encoder;
+    uint32_t ticks;
+
+    // Server thread only.
+    SpectateClient **clients;
+    size_t clientCount;
+    size_t clientCapacity;
+
+    _Atomic uint32_t viewers;
+    _Atomic uint64_t bytesSent;
+    _Atomic uint32_t dropped; // disconnected for falling behind
+} SpectateServer;
+
+// Listens on port and starts the server thread. The buffer is allocated here, once.
+bool spectateServerOpen(SpectateServer *server, uint16_t port);
+// Publishes the tick that just ran on game. Never blocks, allocates or makes a system call.
+void spectateServerTick(SpectateServer *server, const Game *game);
+void spectateServerClose(SpectateServer *server);
+
+#endif // SPECTATE_H
+
+#if defined(SPECTATE_IMPLEMENTATION) && !defined(SPECTATE_IMPLEMENTED)
+#define SPECTATE_IMPLEMENTED
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define SPECTATE_BUFFER_MASK (SPECTATE_BUFFER_SIZE - 1)
+#define SPECTATE_ROW_SIZE (GRID_WIDTH * 4)
+#define SPECTATE_EPOLL_EVENTS 256
+
+_Static_assert((SPECTATE_BUFFER_SIZE & SPECTATE_BUFFER_MASK) == 0, "the spectator buffer size must be a power of two");
+_Static_assert(GRID_HEIGHT <= 32, "row masks are 32 bits");
+_Static_assert(8 + GRID_HEIGHT * SPECTATE_ROW_SIZE + 9 + (NEXT_PIECES_COUNT + 1) * 5 + 1 + 9 + 1 <= SPECTATE_MAX_FRAME, "a keyframe must fit in a frame");
+
+static uint8_t *spectatePut32(uint8_t *out, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        *out++ = value >> (8 * i);
+    }
+
+    return out;
+}
+
+static uint32_t spectateGet32(const uint8_t *data)
+{
+    return data[0] | data[1] << 8 | data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+static uint8_t *spectatePutColor(uint8_t *out, Color color)
+{
+    *out++ = color.r;
+    *out++ = color.g;
+    *out++ = color.b;
+    *out++ = color.a;
+    return out;
+}
+
+static Color spectateGetColor(const uint8_t *data)
+{
+    return (Color){data[0], data[1], data[2], data[3]};
+}
+
+static uint8_t *spectatePutPiece(uint8_t *out, Piece piece)
+{
+    *out++ = piece.type;
+    return spectatePutColor(out, piece.color);
+}
+
+static Piece spectateGetPiece(const uint8_t *data)
+{
+    return (Piece){
+        .color = spectateGetColor(data + 1),
+        .type = data[0] <= PIECE_COUNT ? data[0] : PIECE_O,
+    };
+}
+
+static bool spectateRowChanged(const Game *a, const Game *b, int row)
+{
+    return memcmp(&a->grid[row * GRID_WIDTH], &b->grid[row * GRID_WIDTH], sizeof(Block) * GRID_WIDTH) != 0;
+}
+
+size_t spectateEncode(SpectateEncoder *encoder, const Game *game, bool keyframe, uint8_t *frame)
+{
+    const Game *last = &encoder->last;
+    keyframe = keyframe || !encoder->hasLast;
+
+    uint32_t rows = 0;
+    uint8_t changes = keyframe ? SPECTATE_CHANGED_ALL : 0;
+
+    for (int row = 0; row < GRID_HEIGHT; row++)
+    {
+        if (keyframe || spectateRowChanged(game, last, row))
+        {
+            rows |= 1u << row;
+        }
+    }
+
+    if (!keyframe)
+    {
+        changes |= rows != 0 ? SPECTATE_CHANGED_ROWS : 0;
+        changes |= memcmp(&game->piece, &last->piece, sizeof(game->piece)) != 0 ? SPECTATE_CHANGED_PIECE : 0;
+        changes |= memcmp(game->nextPieces, last->nextPieces, sizeof(game->nextPieces)) != 0 ||
+                           game->hasSavedPiece != last->hasSavedPiece ||
+                           memcmp(&game->savedPiece, &last->savedPiece, sizeof(game->savedPiece)) != 0
+                       ? SPECTATE_CHANGED_QUEUE
+                       : 0;
+        changes |= game->score != last->score || game->lines != last->lines || game->level != last->level ? SPECTATE_CHANGED_SCORE : 0;
+        changes |= game->dead != last->dead || game->paused != last->paused ? SPECTATE_CHANGED_FLAGS : 0;
+    }
+
+    encoder->last = *game;
+    encoder->hasLast = true;
+
+    if (changes == 0)
+    {
+        return 0;
+    }
+
+    uint8_t *out = frame + 2;
+    *out++ = keyframe ? SPECTATE_FRAME_KEYFRAME : SPECTATE_FRAME_DELTA;
+    out = spectatePut32(out, game->tick);
+    *out++ = changes;
+
+    if (changes & SPECTATE_CHANGED_ROWS)
+    {
+        out = spectatePut32(out, rows);
+
+        for (int row = 0; row < GRID_HEIGHT; row++)
+        {
+            for (int column = 0; rows & (1u << row) && column < GRID_WIDTH; column++)
+            {
+                out = spectatePutColor(out, game->grid[row * GRID_WIDTH + column].color);
+            }
+        }
+    }
+
+    if (changes & SPECTATE_CHANGED_PIECE)
+    {
+        out = spectatePutPiece(out, game->piece.data);
+        *out++ = game->piece.orientation;
+        *out++ = (uint8_t)(int8_t)game->piece.origin.x;
+        *out++ = (uint8_t)(int8_t)game->piece.origin.y;
+    }
+
+    if (changes & SPECTATE_CHANGED_QUEUE)
+    {
+        for (size_t i = 0; i < NEXT_PIECES_COUNT; i++)
+        {
+            out = spectatePutPiece(out, game->nextPieces[i]);
+        }
+
+        *out++ = game->hasSavedPiece;
+        out = spectatePutPiece(out, game->savedPiece);
+    }
+
+    if (changes & SPECTATE_CHANGED_SCORE)
+    {
+        out = spectatePut32(out, game->score);
+        out = spectatePut32(out, game->lines);
+        *out++ = game->level;
+    }
+
+    if (changes & SPECTATE_CHANGED_FLAGS)
+    {
+        *out++ = game->dead | game->paused << 1;
+    }
+
+    size_t size = out - frame;
+    frame[0] = (size - 2) & 0xFF;
+    frame[1] = (size - 2) >> 8;
+
+    return size;
+}
+
+size_t spectateFrameSize(const uint8_t *data, size_t available)
+{
+    if (available < 2)
+    {
+        return 0;
+    }
+
+    size_t size = 2 + (data[0] | data[1] << 8);
+    return size <= available ? size : 0;
+}
+
+bool spectateDecode(Game *board, const uint8_t *frame, size_t size)
+{
+    const uint8_t *end = frame + size;
+    const uint8_t *in = frame + 2;
+
+    if (size < 8 || (in[0] != SPECTATE_FRAME_KEYFRAME && in[0] != SPECTATE_FRAME_DELTA))
+    {
+        return false;
+    }
+
+    if (in[0] == SPECTATE_FRAME_KEYFRAME)
+    {
+        memset(board, 0, sizeof(*board));
+    }
+
+    board->tick = spectateGet32(in + 1);
+    uint8_t changes = in[5];
+    in += 6;
+
+    if (changes & SPECTATE_CHANGED_ROWS)
+    {
+        if (end - in < 4)
+        {
+            return false;
+        }
+
+        uint32_t rows = spectateGet32(in);
+        in += 4;
+
+        for (int row = 0; row < GRID_HEIGHT; row++)
+        {
+            if (!(rows & (1u << row)))
+            {
+                continue;
+            }
+
+            if (end - in < SPECTATE_ROW_SIZE)
+            {
+                return false;
+            }
+
+            for (int column = 0; column < GRID_WIDTH; column++, in += 4)
+            {
+                board->grid[row * GRID_WIDTH + column].color = spectateGetColor(in);
+            }
+        }
+    }
+
+    if (changes & SPECTATE_CHANGED_PIECE)
+    {
+        if (end - in < 8)
+        {
+            return false;
+        }
+
+        board->piece.data = spectateGetPiece(in);
+        board->piece.orientation = in[5] <= ORIENTATION_COUNT ? in[5] : ORIENTATION_NORMAL;
+        board->piece.origin = (Vector2){(int8_t)in[6], (int8_t)in[7]};
+        in += 8;
+    }
+
+    if (changes & SPECTATE_CHANGED_QUEUE)
+    {
+        if (end - in < (NEXT_PIECES_COUNT + 1) * 5 + 1)
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < NEXT_PIECES_COUNT; i++, in += 5)
+        {
+            board->nextPieces[i] = spectateGetPiece(in);
+        }
+
+        board->hasSavedPiece = *in++ != 0;
+        board->savedPiece = spectateGetPiece(in);
+        in += 5;
+    }
+
+    if (changes & SPECTATE_CHANGED_SCORE)
+    {
+        if (end - in < 9)
+        {
+            return false;
+        }
+
+        board->score = spectateGet32(in);
+        board->lines = spectateGet32(in + 4);
+        board->level = in[8];
+        in += 9;
+    }
+
+    if (changes & SPECTATE_CHANGED_FLAGS)
+    {
+        if (end - in < 1)
+        {
+            return false;
+        }
+
+        board->dead = *in & 1;
+        board->paused = (*in >> 1) & 1;
+        in++;
+    }
+
+    return in == end;
+}
+
+static void spectateDrop(SpectateServer *server, size_t index)
+{
+    SpectateClient *client = server->clients[index];
+
+    close(client->socket);
+    free(client);
+    server->clients[index] = server->clients[--server->clientCount];
+    atomic_fetch_sub(&server->viewers, 1);
+}
+
+// Sends the client everything published since its position, straight out of the shared buffer.
+// Returns false when the client fell a whole buffer behind.
+static bool spectateFlush(SpectateServer *server, SpectateClient *client, uint64_t head)
+{
+    if (client->position == UINT64_MAX)
+    {
+        client->position = atomic_load(&server->keyframe);
+    }
+
+    while (client->position < head && !client->blocked)
+    {
+        if (head - client->position > SPECTATE_BUFFER_SIZE)
+        {
+            return false;
+        }
+
+        size_t offset = client->position & SPECTATE_BUFFER_MASK;
+        size_t length = head - client->position;
+        length = length < SPECTATE_BUFFER_SIZE - offset ? length : SPECTATE_BUFFER_SIZE - offset;
+
+        ssize_t sent = send(client->socket, server->buffer + offset, length, MSG_NOSIGNAL);
+
+        if (sent < 0)
+        {
+            client->blocked = errno == EAGAIN || errno == EWOULDBLOCK;
+            client->closed = !client->blocked;
+            return true;
+        }
+
+        // The game thread may have been writing over those bytes while they were sent.
+        atomic_thread_fence(memory_order_acquire);
+
+        if (atomic_load_explicit(&server->reserved, memory_order_relaxed) - client->position > SPECTATE_BUFFER_SIZE)
+        {
+            return false;
+        }
+
+        client->position += sent;
+        atomic_fetch_add_explicit(&server->bytesSent, sent, memory_order_relaxed);
+    }
+
+    return true;
+}
+
+static void spectateAccept(SpectateServer *server)
+{
+    while (true)
+    {
+        int descriptor = accept(server->listener, NULL, NULL);
+
+        if (descriptor < 0)
+        {
+            return;
+        }
+
+        fcntl(descriptor, F_SETFL, O_NONBLOCK);
+
+        uint8_t greeting[SPECTATE_GREETING_SIZE] = {'T', 'R', 'S', 'P', SPECTATE_VERSION & 0xFF, SPECTATE_VERSION >> 8, GRID_WIDTH, GRID_HEIGHT};
+        int noDelay = 1;
+        setsockopt(descriptor, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+        if (server->clientCount == server->clientCapacity)
+        {
+            size_t capacity = server->clientCapacity ? server->clientCapacity * 2 : 64;
+            SpectateClient **clients = realloc(server->clients, capacity * sizeof(SpectateClient *));
+
+            if (clients == NULL)
+            {
+                close(descriptor);
+                continue;
+            }
+
+            server->clients = clients;
+            server->clientCapacity = capacity;
+        }
+
+        SpectateClient *client = calloc(1, sizeof(SpectateClient));
+        struct epoll_event event = {
+            .events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET,
+            .data.ptr = client,
+        };
+
+        if (client == NULL || send(descriptor, greeting, sizeof(greeting), MSG_NOSIGNAL) != sizeof(greeting) ||
+            epoll_ctl(server->epoll, EPOLL_CTL_ADD, descriptor, &event) != 0)
+        {
+            free(client);
+            close(descriptor);
+            continue;
+        }
+
+        client->socket = descriptor;
+        client->position = UINT64_MAX;
+        server->clients[server->clientCount++] = client;
+        atomic_fetch_add(&server->viewers, 1);
+    }
+}
+
+static void *spectateServerThread(void *argument)
+{
+    SpectateServer *server = argument;
+    struct epoll_event events[SPECTATE_EPOLL_EVENTS];
+
+    while (atomic_load(&server->running))
+    {
+        int count = epoll_wait(server->epoll, events, SPECTATE_EPOLL_EVENTS, SPECTATE_FLUSH_INTERVAL);
+        uint64_t head = atomic_load_explicit(&server->head, memory_order_acquire);
+
+        for (int i = 0; i < count; i++)
+        {
+            void *source = events[i].data.ptr;
+
+            if (source == &server->listener)
+            {
+                spectateAccept(server);
+            }
+            else
+            {
+                SpectateClient *client = source;
+                uint8_t discard[256];
+
+                // Spectators have nothing to say, reading only notices them leaving.
+                while (recv(client->socket, discard, sizeof(discard), 0) > 0)
+                {
+                }
+
+                if (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+                {
+                    client->closed = true;
+                }
+                else if (events[i].events & EPOLLOUT)
+                {
+                    client->blocked = false;
+                }
+            }
+        }
+
+        // One pass over every spectator per wake up, so several ticks go out in one send.
+        for (size_t i = 0; i < server->clientCount;)
+        {
+            SpectateClient *client = server->clients[i];
+
+            if (!client->closed && !spectateFlush(server, client, head))
+            {
+                client->closed = true;
+                atomic_fetch_add(&server->dropped, 1);
+            }
+
+            if (client->closed)
+            {
+                spectateDrop(server, i);
+            }
+            else
+            {
+                i++;
+            }
+        }
+    }
+
+    while (server->clientCount > 0)
+    {
+        spectateDrop(server, server->clientCount - 1);
+    }
+
+    return NULL;
+}
+
+bool spectateServerOpen(SpectateServer *server, uint16_t port)
+{
+    memset(server, 0, sizeof(*server));
+
+    // Every spectator is a file descriptor, usually more than the default limit allows.
+    struct rlimit limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    server->listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    server->epoll = epoll_create1(0);
+    server->buffer = malloc(SPECTATE_BUFFER_SIZE);
+    atomic_store(&server->keyframe, UINT64_MAX);
+
+    int reuse = 1;
+    setsockopt(server->listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    struct epoll_event listenEvent = {.events = EPOLLIN, .data.ptr = &server->listener};
+
+    if (server->listener < 0 || server->epoll < 0 || server->buffer == NULL ||
+        bind(server->listener, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(server->listener, SOMAXCONN) != 0 ||
+        epoll_ctl(server->epoll, EPOLL_CTL_ADD, server->listener, &listenEvent) != 0)
+    {
+        perror("spectator server");
+        spectateServerClose(server);
+        return false;
+    }
+
+    atomic_store(&server->running, true);
+
+    if (pthread_create(&server->thread, NULL, spectateServerThread, server) != 0)
+    {
+        atomic_store(&server->running, false);
+        spectateServerClose(server);
+        return false;
+    }
+
+    return true;
+}
+
+void spectateServerTick(SpectateServer *server, const Game *game)
+{
+    if (server->buffer == NULL)
+    {
+        return;
+    }
+
+    uint8_t frame[SPECTATE_MAX_FRAME];
+    bool keyframe = server->ticks++ % SPECTATE_KEYFRAME_INTERVAL == 0;
+    size_t size = spectateEncode(&server->encoder, game, keyframe, frame);
+
+    if (size == 0)
+    {
+        return;
+    }
+
+    uint64_t head = atomic_load_explicit(&server->head, memory_order_relaxed);
+    size_t offset = head & SPECTATE_BUFFER_MASK;
+    size_t first = size < SPECTATE_BUFFER_SIZE - offset ? size : SPECTATE_BUFFER_SIZE - offset;
+
+    // Claim the bytes before overwriting them, so a send reading them at the same time is caught.
+    atomic_store_explicit(&server->reserved, head + size, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    memcpy(server->buffer + offset, frame, first);
+    memcpy(server->buffer, frame + first, size - first);
+
+    atomic_store_explicit(&server->head, head + size, memory_order_release);
+
+    if (keyframe)
+    {
+        atomic_store(&server->keyframe, head);
+    }
+}
+
+void spectateServerClose(SpectateServer *server)
+{
+    if (atomic_load(&server->running))
+    {
+        atomic_store(&server->running, false);
+        pthread_join(server->thread, NULL);
+    }
+
+    if (server->listener > 0)
+    {
+        close(server->listener);
+    }
+
+    if (server->epoll > 0)
+    {
+        close(server->epoll);
+    }
+
+    free(server->buffer);
+    free(server->clients);
+    memset(server, 0, sizeof(*server));
+}
+
+#endif // SPECTATE_IMPLEMENTATION
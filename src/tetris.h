@@ -0,0 +1,1118 @@
+#ifndef TETRIS_H
+#define TETRIS_H
+
+#include "raylib.h"
+#include "trace.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define GRID_WIDTH 10
+#define GRID_HEIGHT 20
+
+#define NEXT_PIECES_COUNT 3
+
+#define PIECE_PARTS_COUNT_1D 4
+#define PIECE_PARTS_COUNT (PIECE_PARTS_COUNT_1D * PIECE_PARTS_COUNT_1D)
+
+#define GAME_TICKS_PER_SECOND 60
+#define GAME_MAX_LEVEL 20
+// Bumped whenever gameStep changes in a way that makes recorded inputs play out differently.
+#define GAME_RULES_VERSION 2
+
+#define GAME_DEFAULT_DAS 10
+#define GAME_DEFAULT_ARR 2
+#define GAME_DEFAULT_SOFT_DROP_FACTOR 20
+
+typedef enum PieceType
+{
+    PIECE_O,
+    PIECE_I,
+    PIECE_S,
+    PIECE_Z,
+    PIECE_L,
+    PIECE_J,
+    PIECE_T,
+    PIECE_COUNT = PIECE_T
+} PieceType;
+
+typedef enum Orientation
+{
+    ORIENTATION_NORMAL = 0,
+    ORIENTATION_90,
+    ORIENTATION_180,
+    ORIENTATION_270,
+    ORIENTATION_COUNT = ORIENTATION_270,
+} Orientation;
+
+typedef struct Block
+{
+    Color color;
+} Block;
+
+extern const Color INVALID_BLOCK_COLOR;
+
+typedef struct Piece
+{
+    Color color;
+    PieceType type;
+} Piece;
+
+typedef struct GridPiece
+{
+    Piece data;
+    Orientation orientation;
+    Vector2 origin;
+} GridPiece;
+
+typedef struct GridPieceParts
+{
+    Vector2 coordinates[PIECE_PARTS_COUNT_1D];
+} GridPieceParts;
+
+typedef enum HitResult
+{
+    NO_HIT,
+    HIT,
+    GAME_OVER
+} HitResult;
+
+typedef struct LinesResult
+{
+    bool destroyed[PIECE_PARTS_COUNT_1D];
+} LinesResult;
+
+// ROTATE, HARD_DROP, PAUSE and RESTART are presses and only act on the tick they are set,
+// the others are held keys.
+typedef enum GameInputFlag
+{
+    GAME_INPUT_ROTATE = 1 << 0,
+    GAME_INPUT_LEFT = 1 << 1,
+    GAME_INPUT_RIGHT = 1 << 2,
+    GAME_INPUT_SOFT_DROP = 1 << 3,
+    GAME_INPUT_HARD_DROP = 1 << 4,
+    GAME_INPUT_HOLD = 1 << 5,
+    GAME_INPUT_PAUSE = 1 << 6,
+    GAME_INPUT_RESTART = 1 << 7,
+} GameInputFlag;
+
+typedef uint8_t GameInput;
+
+#define GAME_INPUT_HELD_MASK (GAME_INPUT_LEFT | GAME_INPUT_RIGHT | GAME_INPUT_SOFT_DROP | GAME_INPUT_HOLD)
+
+// How the piece answers held keys, in ticks, so it plays out the same at any frame rate. LEFT or
+// RIGHT moves the piece once when pressed, again once it has been held for das ticks, then every
+// arr ticks, or straight to the wall every tick with an arr of 0. SOFT_DROP makes gravity
+// softDropFactor times faster. It is part of the game, so snapshots and replays carry it.
+typedef struct GameHandling
+{
+    uint8_t das;
+    uint8_t arr;
+    uint8_t softDropFactor; // 0 counts as 1
+    uint8_t reserved;       // always 0
+} GameHandling;
+
+// The whole state of a game. It holds no pointers and, with the fields in this order, no padding,
+// so it can be saved and restored as GAME_SNAPSHOT_SIZE raw bytes, and two snapshots of the same
+// state are byte for byte equal.
+typedef struct Game
+{
+    Block grid[GRID_WIDTH * GRID_HEIGHT];
+    GridPiece piece;
+    Piece nextPieces[NEXT_PIECES_COUNT];
+    Piece savedPiece;
+    bool hasSavedPiece;
+    bool savedThisPiece;
+    bool dead;
+    bool paused;
+    uint64_t random;
+    int score;
+    int level;
+    uint32_t lines;
+    uint32_t tick;
+    uint32_t lastPhysicsTick;
+    uint16_t shiftTicks;   // how long shiftDirection has been held, within its repeat cycle
+    int8_t shiftDirection; // -1 left, 1 right, 0 neither
+    uint8_t reserved;      // always 0
+    uint32_t lastLevelUpTick;
+    uint32_t piecesLocked;
+    uint32_t games;
+    GameHandling handling; // rounds the size up to the alignment of random
+} Game;
+
+#define GAME_SNAPSHOT_SIZE sizeof(Game)
+
+// How often the engine did its most frequent work on the calling thread, for the performance
+// overlay. Callers read it before and after the work they want to measure.
+typedef struct TetrisCounters
+{
+    uint32_t collisionChecks;
+    uint32_t gravitySteps;
+} TetrisCounters;
+
+extern _Thread_local TetrisCounters tetrisCounters;
+
+bool *piecePartsForOrientation(const Orientation orientation, const PieceType pieceType);
+GridPieceParts constructGridPieceParts(const GridPiece *piece);
+
+bool isInsideGrid(const Vector2 coordinate);
+int gridIndexFromCoordinate(const Vector2 coordinate);
+bool isBlockInGrid(const Block grid[GRID_WIDTH * GRID_HEIGHT], Vector2 coordinate);
+
+HitResult checkCollisions(const Block grid[GRID_WIDTH * GRID_HEIGHT], const GridPiece *piece);
+LinesResult checkLines(const Block grid[GRID_WIDTH * GRID_HEIGHT], const GridPiece *piece);
+void applyGravityToBlocks(Block grid[GRID_WIDTH * GRID_HEIGHT], uint8_t firstLine, uint8_t numberOfLines);
+HitResult applyGravity(const Block grid[GRID_WIDTH * GRID_HEIGHT], GridPiece *piece);
+void movePieceToSides(const Block grid[GRID_WIDTH * GRID_HEIGHT], GridPiece *piece, int movement);
+// Moves the piece as far as it goes towards direction in one go, by how far each of its rows is
+// from the nearest block or wall, rather than one checkCollisions per cell.
+void slidePieceToWall(const Block grid[GRID_WIDTH * GRID_HEIGHT], GridPiece *piece, int direction);
+void rotatePiece(const Block grid[GRID_WIDTH * GRID_HEIGHT], GridPiece *piece);
+
+Piece makeRandomPiece(Game *game);
+GridPiece spawnPiece(const Piece piece);
+GridPiece dequeueNextPiece(Game *game);
+
+double nextTimeToLevelUp(int level);
+double gravityInterval(int level);
+
+void gameInit(Game *game, uint64_t seed);
+void gameRestart(Game *game);
+HitResult gameStep(Game *game, GameInput input);
+extern const GameHandling GAME_DEFAULT_HANDLING;
+
+// Whether movement, LEFT, RIGHT or SOFT_DROP, moves the piece by a cell in the next gameStep
+// rather than counting towards auto shift or waiting for the soft drop's next fall.
+bool gameMovementReady(const Game *game, GameInput movement);
+GridPiece gameGhostPiece(const Game *game);
+// Hash of everything that decides how the game goes on from here, to compare two simulations of
+// the same inputs. Fields are hashed one at a time, so struct padding never gets in.
+uint64_t gameChecksum(const Game *game);
+
+// snapshot points at GAME_SNAPSHOT_SIZE bytes, with no alignment requirement.
+void gameSave(const Game *game, void *snapshot);
+void gameRestore(Game *game, const void *snapshot);
+
+#endif // TETRIS_H
+
+#if defined(TETRIS_IMPLEMENTATION) && !defined(TETRIS_IMPLEMENTED)
+#define TETRIS_IMPLEMENTED
+
+#include <assert.h>
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+const Color INVALID_BLOCK_COLOR = (Color){
+    .r = 0xDE,
+    .g = 0xAD,
+    .b = 0xBE,
+    .a = 0xEF,
+};
+
+bool PIECE_O_PARTS[PIECE_PARTS_COUNT] = {
+    0, 1, 1, 0, //
+    0, 1, 1, 0, //
+    0, 0, 0, 0, //
+    0, 0, 0, 0, //
+};
+
+bool PIECE_I_PARTS_NORMAL[PIECE_PARTS_COUNT] = {
+    0, 0, 1, 0, //
+    0, 0, 1, 0, //
+    0, 0, 1, 0, //
+    0, 0, 1, 0, //
+};
+
+bool PIECE_I_PARTS_90[PIECE_PARTS_COUNT] = {
+    0, 0, 0, 0, //
+    0, 0, 0, 0, //
+    1, 1, 1, 1, //
+    0, 0, 0, 0, //
+};
+
+bool PIECE_I_PARTS_180[PIECE_PARTS_COUNT] = {
+    0, 1, 0, 0, //
+    0, 1, 0, 0, //
+    0, 1, 0, 0, //
+    0, 1, 0, 0, //
+};
+
+bool PIECE_I_PARTS_270[PIECE_PARTS_COUNT] = {
+    0, 0, 0, 0, //
+    1, 1, 1, 1, //
+    0, 0, 0, 0, //
+    0, 0, 0, 0, //
+};
+
+bool PIECE_S_PARTS_NORMAL[PIECE_PARTS_COUNT] = {
+    0, 1, 1, 0, //
+    1, 1, 0, 0, //
+    0, 0, 0, 0, //
+    0, 0, 0, 0, //
+};
+
+bool PIECE_S_PARTS_90[PIECE_PARTS_COUNT] = {
+    0, 1, 0, 0, //
+    0, 1, 1, 0, //
+    0, 0, 1, 0, //
+    0, 0, 0, 0, //
+};
+
+bool PIECE_S_PARTS_180[PIECE_PARTS_COUNT] = {
+    0, 0, 0, 0, //
+    0, 1, 1, 0, //
+    1, 1, 0, 0, //
+    0, 0, 0, 0, //
+};
+
+bool PIECE_S_PARTS_270[PIECE_PARTS_COUNT] = {
+    1, 0, 0, 0, //
+    1, 1, 0, 0, //
+    0, 1, 0, 0, //
+    0, 0, 0, 0, //
+};
+
+bool PIECE_Z_PARTS_NORMAL[PIECE_PARTS_COUNT] = {
+    1, 1, 0, 0, //
+    0, 1, 1, 0, //
+    0, 0, 0, 0, //
+    0, 0, 0, 0, //
+};
+
+bool PIECE_Z_PARTS_90[PIECE_PARTS_COUNT] = {
+    0, 0, 1, 0, //
+    0, 1, 1, 0, //
+    0, 1, 0, 0, //
+    0, 0, 0, 0, //
+};
+
+bool PIECE_Z_PARTS_180[PIECE_PARTS_COUNT] = {
+    0, 0, 0, 0, //
+    1, 1, 0, 0, //
+    0, 1, 1, 0, //
+    0, 0, 0, 0, //
+};
+
+bool PIECE_Z_PARTS_270[PIECE_PARTS_COUNT] = {
+    0, 1, 0, 0, //
+    1, 1, 0, 0, //
+    1, 0, 0, 0, //
+    0, 0, 0, 0, //
+};
+
+bool PIECE_L_PARTS_NORMAL[PIECE_PARTS_COUNT] = {
+    0, 1, 0, 0, //
+    0, 1, 0, 0, //
+    0, 1, 1, 0, //
+    0, 0, 0, 0, //
+};
+
+bool PIECE_L_PARTS_90[PIECE_PARTS_COUNT] = {
+    0, 0, 0, 0, //
+    0, 1, 1, 1, //
+    0, 1, 0, 0, //
+    0, 0, 0, 0, //
+};
+
+bool PIECE_L_PARTS_180[PIECE_PARTS_COUNT] = {
+    1, 1, 0, 0, //
+    0, 1, 0, 0, //
+    0, 1, 0, 0, //
+    0, 0, 0, 0, //
+};
+
+bool PIECE_L_PARTS_270[PIECE_PARTS_COUNT] = {
+    0, 0, 1, 0, //
+    1, 1, 1, 0, //
+    0, 0, 0, 0, //
+    0, 0, 0, 0, //
+};
+
+bool PIECE_J_PARTS_NORMAL[PIECE_PARTS_COUNT] = {
+    0, 1, 0, 0, //
+    0, 1, 0, 0, //
+    1, 1, 0, 0, //
+    0, 0, 0, 0, //
+};
+
+bool PIECE_J_PARTS_90[PIECE_PARTS_COUNT] = {
+    1, 0, 0, 0, //
+    1, 1, 1, 0, //
+    0, 0, 0, 0, //
+    0, 0, 0, 0, //
+};
+
+bool PIECE_J_PARTS_180[PIECE_PARTS_COUNT] = {
+    0, 1, 1, 0, //
+    0, 1, 0, 0, //
+    0, 1, 0, 0, //
+    0, 0, 0, 0, //
+};
+
+bool PIECE_J_PARTS_270[PIECE_PARTS_COUNT] = {
+    0, 0, 0, 0, //
+    1, 1, 1, 0, //
+    0, 0, 1, 0, //
+    0, 0, 0, 0, //
+};
+
+bool PIECE_T_PARTS_NORMAL[PIECE_PARTS_COUNT] = {
+    0, 0, 0, 0, //
+    1, 1, 1, 0, //
+    0, 1, 0, 0, //
+    0, 0, 0, 0, //
+};
+
+bool PIECE_T_PARTS_90[PIECE_PARTS_COUNT] = {
+    0, 1, 0, 0, //
+    1, 1, 0, 0, //
+    0, 1, 0, 0, //
+    0, 0, 0, 0, //
+};
+
+bool PIECE_T_PARTS_180[PIECE_PARTS_COUNT] = {
+    0, 1, 0, 0, //
+    1, 1, 1, 0, //
+    0, 0, 0, 0, //
+    0, 0, 0, 0, //
+};
+
+bool PIECE_T_PARTS_270[PIECE_PARTS_COUNT] = {
+    0, 1, 0, 0, //
+    0, 1, 1, 0, //
+    0, 1, 0, 0, //
+    0, 0, 0, 0, //
+};
+
+bool *piecePartsForOrientation(const Orientation orientation, const PieceType pieceType)
+{
+    switch (pieceType)
+    {
+    case PIECE_O:
+    {
+        return PIECE_O_PARTS;
+    }
+    case PIECE_I:
+    {
+        return (bool *[4]){PIECE_I_PARTS_NORMAL, PIECE_I_PARTS_90, PIECE_I_PARTS_180, PIECE_I_PARTS_270}[orientation];
+    }
+    case PIECE_S:
+    {
+        return (bool *[4]){PIECE_S_PARTS_NORMAL, PIECE_S_PARTS_90, PIECE_S_PARTS_180, PIECE_S_PARTS_270}[orientation];
+    }
+    case PIECE_Z:
+    {
+        return (bool *[4]){PIECE_Z_PARTS_NORMAL, PIECE_Z_PARTS_90, PIECE_Z_PARTS_180, PIECE_Z_PARTS_270}[orientation];
+    }
+    case PIECE_L:
+    {
+        return (bool *[4]){PIECE_L_PARTS_NORMAL, PIECE_L_PARTS_90, PIECE_L_PARTS_180, PIECE_L_PARTS_270}[orientation];
+    }
+    case PIECE_J:
+    {
+        return (bool *[4]){PIECE_J_PARTS_NORMAL, PIECE_J_PARTS_90, PIECE_J_PARTS_180, PIECE_J_PARTS_270}[orientation];
+    }
+    case PIECE_T:
+    {
+        return (bool *[4]){PIECE_T_PARTS_NORMAL, PIECE_T_PARTS_90, PIECE_T_PARTS_180, PIECE_T_PARTS_270}[orientation];
+    }
+    }
+
+    assert(0);
+    return NULL;
+}
+
+const Color colors[] = {
+    RED,
+    BLUE,
+    GREEN,
+    ORANGE,
+    YELLOW,
+};
+
+const uint8_t colorsLength = sizeof(colors) / sizeof(colors[1]);
+
+_Thread_local TetrisCounters tetrisCounters;
+
+// TODO: better name for this function?
+Vector2 partCoordinatesFromIndex(size_t i, const Vector2 origin)
+{
+    return (Vector2){
+        .x = origin.x + (i % 4),
+        .y = origin.y + (i / 4),
+    };
+}
+
+GridPieceParts constructGridPieceParts(const GridPiece *piece)
+{
+    GridPieceParts gridPieceParts;
+
+    bool *hasPart = piecePartsForOrientation(piece->orientation, piece->data.type);
+    size_t index = 0;
+
+    for (size_t i = 0; i < PIECE_PARTS_COUNT; i++)
+    {
+        if (!hasPart[i])
+        {
+            continue;
+        }
+
+        Vector2 pieceCoordinates = partCoordinatesFromIndex(i, piece->origin);
+        gridPieceParts.coordinates[index++] = pieceCoordinates;
+    }
+
+    return gridPieceParts;
+};
+
+bool isInsideGrid(const Vector2 coordinate)
+{
+    return !(
+        coordinate.x < 0 ||
+        coordinate.x >= GRID_WIDTH ||
+        coordinate.y < 0 ||
+        coordinate.y >= GRID_HEIGHT //
+    );
+}
+
+int gridIndexFromCoordinate(const Vector2 coordinate)
+{
+    return coordinate.y * GRID_WIDTH + coordinate.x;
+}
+
+bool isBlockInGrid(const Block grid[GRID_WIDTH * GRID_HEIGHT], Vector2 coordinate)
+{
+    int index = coordinate.y * GRID_WIDTH + coordinate.x;
+    return memcmp(&grid[index].color, &INVALID_BLOCK_COLOR, sizeof(grid[index].color));
+}
+
+HitResult checkCollisions(const Block grid[GRID_WIDTH * GRID_HEIGHT], const GridPiece *piece)
+{
+    tetrisCounters.collisionChecks++;
+
+    GridPieceParts parts = constructGridPieceParts(piece);
+
+    for (size_t i = 0; i < PIECE_PARTS_COUNT_1D; i++)
+    {
+        Vector2 partCoordinates = parts.coordinates[i];
+
+        if (!isInsideGrid(partCoordinates) || isBlockInGrid(grid, partCoordinates))
+        {
+            return (partCoordinates.y == 0 || piece->origin.y == 0) ? GAME_OVER : HIT;
+        }
+    }
+
+    return NO_HIT;
+}
+
+LinesResult checkLines(const Block grid[GRID_WIDTH * GRID_HEIGHT], const GridPiece *piece)
+{
+    TRACE_SCOPE("checkLines");
+
+    LinesResult result = {
+        .destroyed = {false, false, false, false},
+    };
+
+    bool seen[PIECE_PARTS_COUNT_1D] = {false, false, false, false};
+    GridPieceParts parts = constructGridPieceParts(piece);
+
+    for (size_t i = 0; i < PIECE_PARTS_COUNT_1D; ++i)
+    {
+        Vector2 partCoordinates = parts.coordinates[i];
+        int index = (int)partCoordinates.y - piece->origin.y;
+
+        if (seen[index])
+        {
+            continue;
+        }
+
+        seen[index] = true;
+        partCoordinates.x = 0;
+
+        for (size_t j = 0; j < GRID_WIDTH; ++j)
+        {
+            partCoordinates.x = j;
+            if (!isBlockInGrid(grid, partCoordinates))
+            {
+                goto outer;
+            }
+        }
+        result.destroyed[index] = true;
+    outer:
+    }
+
+    return result;
+}
+
+void memset32(void *buf, uint32_t c, uint32_t n)
+{
+    for (uint32_t i = 0; i < n; i++)
+    {
+        ((uint32_t *)buf)[i] = c;
+    }
+}
+
+void applyGravityToBlocks(Block grid[GRID_WIDTH * GRID_HEIGHT], uint8_t firstLine, uint8_t numberOfLines)
+{
+    uint8_t line = firstLine - numberOfLines + 1;
+    size_t indexDest = gridIndexFromCoordinate((Vector2){
+        .x = 0,
+        .y = numberOfLines,
+    });
+
+    size_t indexSrc = 0;
+
+    memmove(&grid[indexDest], &grid[indexSrc], (line * GRID_WIDTH) * sizeof(Block));
+
+    //
+    Block emptyBlock = {
+        .color = INVALID_BLOCK_COLOR,
+    };
+    uint32_t emptyBlockAsInt = ((uint32_t *)&emptyBlock)[0];
+
+    memset32(&grid[0], emptyBlockAsInt, (numberOfLines * GRID_WIDTH));
+}
+
+HitResult applyGravity(const Block grid[GRID_WIDTH * GRID_HEIGHT], GridPiece *piece)
+{
+    tetrisCounters.gravitySteps++;
+    piece->origin.y += 1;
+
+    HitResult result = checkCollisions(grid, piece);
+
+    if (result != NO_HIT)
+    {
+        piece->origin.y -= 1;
+    }
+
+    return result;
+}
+
+void movePieceToSides(const Block grid[GRID_WIDTH * GRID_HEIGHT], GridPiece *piece, int movement)
+{
+    TRACE_SCOPE("movePieceToSides");
+
+    if (movement == 0)
+    {
+        return;
+    }
+
+    piece->origin.x += movement;
+    HitResult result = checkCollisions(grid, piece);
+
+    if (result != NO_HIT)
+    {
+        piece->origin.x -= movement;
+    }
+}
+
+void slidePieceToWall(const Block grid[GRID_WIDTH * GRID_HEIGHT], GridPiece *piece, int direction)
+{
+    TRACE_SCOPE("slidePieceToWall");
+
+    if (direction == 0)
+    {
+        return;
+    }
+
+    GridPieceParts parts = constructGridPieceParts(piece);
+    int distance = GRID_WIDTH;
+
+    // The piece's own cells are not in the grid, so a part behind another in the same row runs
+    // into the same block as the leading one and the closest block over all parts decides.
+    for (size_t i = 0; i < PIECE_PARTS_COUNT_1D; i++)
+    {
+        Vector2 part = parts.coordinates[i];
+
+        if (!isInsideGrid(part))
+        {
+            return;
+        }
+
+        int free = 0;
+
+        for (Vector2 next = {part.x + direction, part.y}; free < distance && isInsideGrid(next) && !isBlockInGrid(grid, next); next.x += direction)
+        {
+            free++;
+        }
+
+        distance = free < distance ? free : distance;
+    }
+
+    piece->origin.x += direction * distance;
+}
+
+// TODO: rotate sometimes blocks where it could rotate
+void rotatePiece(const Block grid[GRID_WIDTH * GRID_HEIGHT], GridPiece *piece)
+{
+    TRACE_SCOPE("rotatePiece");
+
+    Orientation newOrientation = (piece->orientation + 1) % (ORIENTATION_COUNT + 1);
+    Orientation oldOrientation = piece->orientation;
+    piece->orientation = newOrientation;
+
+    HitResult result = checkCollisions(grid, piece);
+
+    if (result != NO_HIT)
+    {
+        piece->orientation = oldOrientation;
+    }
+}
+
+// splitmix64, so a whole game can be replayed from its seed
+static uint32_t gameRandom(Game *game)
+{
+    uint64_t z = (game->random += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return (uint32_t)((z ^ (z >> 31)) >> 32);
+}
+
+Piece makeRandomPiece(Game *game)
+{
+    PieceType type = gameRandom(game) % (PIECE_COUNT + 1);
+    Color color = colors[gameRandom(game) % colorsLength];
+
+    return (Piece){
+        color,
+        type,
+    };
+}
+
+void initGrid(Block grid[GRID_WIDTH * GRID_HEIGHT])
+{
+    for (size_t i = 0; i < GRID_WIDTH * GRID_HEIGHT; ++i)
+    {
+        grid[i].color = INVALID_BLOCK_COLOR;
+    }
+}
+
+#define MAX(x, y) (((x) > (y)) ? (x) : (y))
+
+double nextTimeToLevelUp(int level)
+{
+    // return 0.1;
+    return powf(level, 0.5f) * 10.0;
+}
+
+double gravityInterval(int level)
+{
+    return 1 / (0.5f + (level * 0.5));
+}
+
+static uint32_t secondsToTicks(double seconds)
+{
+    return (uint32_t)(seconds * GAME_TICKS_PER_SECOND);
+}
+
+GridPiece spawnPiece(const Piece piece)
+{
+    return (GridPiece){
+        .data = piece,
+        .orientation = ORIENTATION_NORMAL,
+        .origin = (Vector2){
+            .x = GRID_WIDTH / 2 - 1,
+            .y = 0,
+        },
+    };
+}
+
+GridPiece dequeueNextPiece(Game *game)
+{
+    Piece piece = game->nextPieces[0];
+
+    for (size_t i = 0; i < NEXT_PIECES_COUNT - 1; i++)
+    {
+        game->nextPieces[i] = game->nextPieces[i + 1];
+    }
+
+    game->nextPieces[NEXT_PIECES_COUNT - 1] = makeRandomPiece(game);
+
+    return spawnPiece(piece);
+}
+
+const GameHandling GAME_DEFAULT_HANDLING = {
+    .das = GAME_DEFAULT_DAS,
+    .arr = GAME_DEFAULT_ARR,
+    .softDropFactor = GAME_DEFAULT_SOFT_DROP_FACTOR,
+};
+
+void gameInit(Game *game, uint64_t seed)
+{
+    memset(game, 0, sizeof(*game));
+    game->level = 1;
+    game->random = seed;
+    game->handling = GAME_DEFAULT_HANDLING;
+
+    gameRestart(game);
+}
+
+// Restarting keeps the level and the timers running, like pressing R always did.
+void gameRestart(Game *game)
+{
+    game->games++;
+    game->score = 0;
+    game->lines = 0;
+    game->dead = false;
+    initGrid(game->grid);
+    game->savedThisPiece = false;
+    game->hasSavedPiece = false;
+
+    for (size_t i = 0; i < NEXT_PIECES_COUNT; ++i)
+    {
+        game->nextPieces[i] = makeRandomPiece(game);
+    }
+
+    game->piece = dequeueNextPiece(game);
+}
+
+static int shiftDirection(GameInput input)
+{
+    return (input & GAME_INPUT_LEFT) ? -1 : (input & GAME_INPUT_RIGHT) ? 1 : 0;
+}
+
+static uint32_t softDropTicks(const Game *game)
+{
+    uint32_t factor = game->handling.softDropFactor > 1 ? game->handling.softDropFactor : 1;
+    uint32_t ticks = secondsToTicks(gravityInterval(game->level)) / factor;
+
+    return ticks > 1 ? ticks : 1;
+}
+
+bool gameMovementReady(const Game *game, GameInput movement)
+{
+    if (movement & GAME_INPUT_SOFT_DROP)
+    {
+        return (game->tick + 1) - game->lastPhysicsTick >= softDropTicks(game);
+    }
+
+    return shiftDirection(movement) != game->shiftDirection;
+}
+
+// Auto shift, see GameHandling. shiftTicks counts up to das + arr and then goes back to das, so
+// every repeat lands on das.
+static void shiftPiece(Game *game, int direction)
+{
+    const GameHandling *handling = &game->handling;
+
+    if (direction != game->shiftDirection)
+    {
+        game->shiftDirection = direction;
+        game->shiftTicks = 0;
+        movePieceToSides(game->grid, &game->piece, direction);
+        return;
+    }
+
+    if (direction == 0 || ++game->shiftTicks < handling->das)
+    {
+        return;
+    }
+
+    if (handling->arr == 0)
+    {
+        game->shiftTicks = handling->das;
+        slidePieceToWall(game->grid, &game->piece, direction);
+        return;
+    }
+
+    if (game->shiftTicks == handling->das + handling->arr)
+    {
+        game->shiftTicks = handling->das;
+    }
+
+    if (game->shiftTicks == handling->das)
+    {
+        movePieceToSides(game->grid, &game->piece, direction);
+    }
+}
+
+static HitResult lockPiece(Game *game)
+{
+    TRACE_SCOPE("lockPiece");
+
+    GridPiece *piece = &game->piece;
+    GridPieceParts parts = constructGridPieceParts(piece);
+
+    for (size_t i = 0; i < PIECE_PARTS_COUNT_1D; ++i)
+    {
+        Vector2 partCoordinates = parts.coordinates[i];
+
+        int index = gridIndexFromCoordinate(partCoordinates);
+        game->grid[index] = (Block){
+            .color = piece->data.color,
+        };
+    }
+
+    LinesResult linesResult = checkLines(game->grid, piece);
+
+    uint8_t numberOfLines = 0;
+    int start = -1;
+
+    for (size_t i = 0; i < PIECE_PARTS_COUNT_1D; ++i)
+    {
+        if (linesResult.destroyed[i])
+        {
+            numberOfLines++;
+            start = MAX(start, piece->origin.y + i);
+        }
+    }
+
+    if (numberOfLines > 0)
+    {
+        applyGravityToBlocks(game->grid, start, numberOfLines);
+        uint16_t scores[] = {100, 300, 500, 800};
+        game->score += scores[numberOfLines - 1] * game->level;
+        game->lines += numberOfLines;
+    }
+
+    game->piecesLocked++;
+    game->piece = dequeueNextPiece(game);
+    game->savedThisPiece = false;
+
+    return checkCollisions(game->grid, &game->piece);
+}
+
+// Hard drop, soft drop or gravity, whichever comes first, and when the piece landed.
+static HitResult dropPiece(Game *game, bool instantDrop, bool fasterDrop, bool gravity)
+{
+    TRACE_SCOPE("gravity");
+
+    HitResult result = NO_HIT;
+    if (instantDrop)
+    {
+        while (result == NO_HIT)
+        {
+            result = applyGravity(game->grid, &game->piece);
+            game->score += 20 * game->level;
+        }
+        game->lastPhysicsTick = game->tick;
+    }
+    else if (fasterDrop)
+    {
+        result = applyGravity(game->grid, &game->piece);
+        game->score += 10 * game->level;
+        game->lastPhysicsTick = game->tick;
+    }
+    else if (gravity)
+    {
+        result = applyGravity(game->grid, &game->piece);
+        game->lastPhysicsTick = game->tick;
+    }
+
+    return result;
+}
+
+HitResult gameStep(Game *game, GameInput input)
+{
+    TRACE_SCOPE("gameStep");
+
+    game->tick++;
+
+    if (!game->dead && (input & GAME_INPUT_PAUSE))
+    {
+        game->paused = !game->paused;
+        game->shiftTicks = 0;
+        game->lastPhysicsTick = game->tick;
+        game->lastLevelUpTick = game->tick;
+    }
+
+    if (game->paused)
+    {
+        return NO_HIT;
+    }
+
+    bool dead = game->dead;
+
+    bool canLevelUp = !dead && game->level < GAME_MAX_LEVEL;
+    bool levelUp = (game->tick - game->lastLevelUpTick) > secondsToTicks(nextTimeToLevelUp(game->level));
+    if (canLevelUp && levelUp)
+    {
+        game->level++;
+        game->lastLevelUpTick = game->tick;
+    }
+
+    bool isPhysicsTime = (game->tick - game->lastPhysicsTick) >= secondsToTicks(gravityInterval(game->level));
+    bool isSoftDropTime = (game->tick - game->lastPhysicsTick) >= softDropTicks(game);
+
+    bool canSavePiece = !dead && !game->savedThisPiece;
+
+    bool doApplyGravity = !dead && isPhysicsTime;
+    bool doInstantDrop = !dead && (input & GAME_INPUT_HARD_DROP);
+    bool doFasterDrop = !dead && isSoftDropTime && (input & GAME_INPUT_SOFT_DROP);
+    bool doRotate = !dead && (input & GAME_INPUT_ROTATE);
+    bool doSave = canSavePiece && (input & GAME_INPUT_HOLD);
+
+    if (input & GAME_INPUT_RESTART)
+    {
+        gameRestart(game);
+    }
+
+    if (doSave)
+    {
+        Piece current = game->piece.data;
+
+        if (game->hasSavedPiece)
+        {
+            game->piece = spawnPiece(game->savedPiece);
+        }
+        else
+        {
+            game->piece = dequeueNextPiece(game);
+        }
+
+        game->savedPiece = current;
+        game->hasSavedPiece = true;
+        game->savedThisPiece = true;
+    }
+
+    if (doRotate)
+    {
+        rotatePiece(game->grid, &game->piece);
+    }
+
+    if (!dead)
+    {
+        shiftPiece(game, shiftDirection(input));
+    }
+
+    HitResult result = dropPiece(game, doInstantDrop, doFasterDrop, doApplyGravity);
+
+    if (result == HIT)
+    {
+        result = lockPiece(game);
+    }
+
+    if (result == GAME_OVER)
+    {
+        game->dead = true;
+    }
+
+    return result;
+}
+
+GridPiece gameGhostPiece(const Game *game)
+{
+    TRACE_SCOPE("gameGhostPiece");
+
+    GridPiece ghostPiece = game->piece;
+
+    while (applyGravity(game->grid, &ghostPiece) == NO_HIT)
+    {
+        ;
+    }
+
+    ghostPiece.data.color.a = game->piece.data.color.a * 0.3;
+
+    return ghostPiece;
+}
+
+#define GAME_FIELD_FOLLOWS(previous, field) \
+    _Static_assert(offsetof(Game, field) == offsetof(Game, previous) + sizeof(((Game *)0)->previous), "Game has padding before " #field)
+
+GAME_FIELD_FOLLOWS(grid, piece);
+GAME_FIELD_FOLLOWS(piece, nextPieces);
+GAME_FIELD_FOLLOWS(nextPieces, savedPiece);
+GAME_FIELD_FOLLOWS(savedPiece, hasSavedPiece);
+GAME_FIELD_FOLLOWS(hasSavedPiece, savedThisPiece);
+GAME_FIELD_FOLLOWS(savedThisPiece, dead);
+GAME_FIELD_FOLLOWS(dead, paused);
+GAME_FIELD_FOLLOWS(paused, random);
+GAME_FIELD_FOLLOWS(random, score);
+GAME_FIELD_FOLLOWS(score, level);
+GAME_FIELD_FOLLOWS(level, lines);
+GAME_FIELD_FOLLOWS(lines, tick);
+GAME_FIELD_FOLLOWS(tick, lastPhysicsTick);
+GAME_FIELD_FOLLOWS(lastPhysicsTick, shiftTicks);
+GAME_FIELD_FOLLOWS(shiftTicks, shiftDirection);
+GAME_FIELD_FOLLOWS(shiftDirection, reserved);
+GAME_FIELD_FOLLOWS(reserved, lastLevelUpTick);
+GAME_FIELD_FOLLOWS(lastLevelUpTick, piecesLocked);
+GAME_FIELD_FOLLOWS(piecesLocked, games);
+GAME_FIELD_FOLLOWS(games, handling);
+_Static_assert(sizeof(GameHandling) == 4, "GameHandling has padding");
+_Static_assert(sizeof(Game) == offsetof(Game, handling) + sizeof(GameHandling), "Game has padding at the end");
+_Static_assert(sizeof(GridPiece) == sizeof(Piece) + sizeof(Orientation) + sizeof(Vector2), "GridPiece has padding");
+_Static_assert(sizeof(Piece) == sizeof(Color) + sizeof(PieceType), "Piece has padding");
+
+void gameSave(const Game *game, void *snapshot)
+{
+    memcpy(snapshot, game, GAME_SNAPSHOT_SIZE);
+}
+
+void gameRestore(Game *game, const void *snapshot)
+{
+    memcpy(game, snapshot, GAME_SNAPSHOT_SIZE);
+}
+
+_Static_assert(sizeof(Block) == sizeof(uint32_t), "the grid is hashed as raw bytes");
+_Static_assert(sizeof(((Game *)0)->grid) % (4 * sizeof(uint64_t)) == 0, "the grid is hashed in four lanes");
+
+static uint64_t gameChecksumMix(uint64_t hash, uint64_t value)
+{
+    hash = (hash ^ value) * 0x9E3779B97F4A7C15ull;
+    return hash ^ hash >> 29;
+}
+
+static uint64_t colorBits(Color color)
+{
+    return (uint64_t)color.r | (uint64_t)color.g << 8 | (uint64_t)color.b << 16 | (uint64_t)color.a << 24;
+}
+
+static uint64_t pieceBits(Piece piece)
+{
+    return colorBits(piece.color) | (uint64_t)(uint32_t)piece.type << 32;
+}
+
+static uint64_t floatBits(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+uint64_t gameChecksum(const Game *game)
+{
+    const uint64_t fields[] = {
+        pieceBits(game->piece.data),
+        (uint64_t)game->piece.orientation << 32 | floatBits(game->piece.origin.x),
+        floatBits(game->piece.origin.y),
+        pieceBits(game->nextPieces[0]),
+        pieceBits(game->nextPieces[1]),
+        pieceBits(game->nextPieces[2]),
+        game->hasSavedPiece ? pieceBits(game->savedPiece) : 0,
+        game->hasSavedPiece | game->savedThisPiece << 1 | game->dead << 2 | game->paused << 3 | (uint64_t)game->lines << 32,
+        (uint64_t)(uint32_t)game->score << 32 | (uint32_t)game->level,
+        game->random,
+        (uint64_t)game->tick << 32 | game->lastPhysicsTick,
+        (uint64_t)game->shiftTicks << 48 | (uint64_t)(uint8_t)game->shiftDirection << 40 | game->lastLevelUpTick,
+        game->handling.das | game->handling.arr << 8 | game->handling.softDropFactor << 16,
+        (uint64_t)game->piecesLocked << 32 | game->games,
+    };
+    _Static_assert(NEXT_PIECES_COUNT == 3, "every queued piece is hashed");
+
+    // Four independent lanes keep the multiplies from waiting on each other.
+    uint64_t lanes[4] = {1, 2, 3, 4};
+    const uint8_t *grid = (const uint8_t *)game->grid;
+
+    for (size_t i = 0; i < sizeof(game->grid); i += sizeof(lanes))
+    {
+        for (size_t lane = 0; lane < 4; lane++)
+        {
+            uint64_t word;
+            memcpy(&word, grid + i + lane * sizeof(uint64_t), sizeof(word));
+            lanes[lane] = gameChecksumMix(lanes[lane], word);
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++)
+    {
+        lanes[i % 4] = gameChecksumMix(lanes[i % 4], fields[i]);
+    }
+
+    uint64_t hash = gameChecksumMix(gameChecksumMix(lanes[0], lanes[1]), gameChecksumMix(lanes[2], lanes[3]));
+
+    return hash ^ hash >> 32;
+}
+
+#endif // TETRIS_IMPLEMENTATION
@@ -0,0 +1,230 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Timing zones around the hot paths, written out as Chrome trace-event JSON for Perfetto or
+// chrome://tracing.
+//
+// TRACE_SCOPE("name") times the rest of the enclosing block. Zones only exist in builds with
+// TRACE_ENABLED defined; otherwise the macro expands to nothing and the zones cost nothing. Each
+// thread writes its zones to its own ring of the last TRACE_EVENTS_PER_THREAD events, with no lock
+// and no allocation after its first zone. traceWrite copies every ring while the threads keep
+// going, dropping the events that were overwritten during the copy.
+
+// A power of two, about two minutes of the main thread, 3 MiB.
+#define TRACE_EVENTS_PER_THREAD (1 << 17)
+
+#ifdef TRACE_ENABLED
+
+typedef struct TraceZone
+{
+    const char *name;
+    uint64_t start;
+} TraceZone;
+
+TraceZone traceZoneBegin(const char *name);
+void traceZoneEnd(TraceZone *zone);
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+// name must be a string literal, or live as long as the program.
+#define TRACE_SCOPE(name) \
+    TraceZone TRACE_CONCAT(traceZone, __LINE__) __attribute__((cleanup(traceZoneEnd))) = traceZoneBegin(name)
+
+// Shown instead of the thread number in the trace. name must live as long as the program.
+void traceSetThreadName(const char *name);
+// Writes the events every thread still has. Safe to call while they record.
+bool traceWrite(const char *path);
+
+#else
+
+#define TRACE_SCOPE(name)
+
+#endif // TRACE_ENABLED
+
+#endif // TRACE_H
+
+#if defined(TRACE_ENABLED) && defined(TRACE_IMPLEMENTATION) && !defined(TRACE_IMPLEMENTED)
+#define TRACE_IMPLEMENTED
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct TraceEvent
+{
+    const char *name;
+    uint64_t start; // nanoseconds, CLOCK_MONOTONIC
+    uint64_t duration;
+} TraceEvent;
+
+typedef struct TraceBuffer
+{
+    TraceEvent events[TRACE_EVENTS_PER_THREAD];
+    _Atomic uint64_t count; // events written since the thread started, only the thread writes it
+    const char *_Atomic threadName;
+    uint32_t thread;
+    struct TraceBuffer *next;
+} TraceBuffer;
+
+_Static_assert((TRACE_EVENTS_PER_THREAD & (TRACE_EVENTS_PER_THREAD - 1)) == 0, "the ring size must be a power of two");
+
+// Every thread that ever recorded a zone, newest first. Buffers are never freed, so a dump can
+// read one while its thread exits.
+static TraceBuffer *_Atomic traceBuffers;
+static _Atomic uint32_t traceThreads;
+static _Thread_local TraceBuffer *traceBuffer;
+
+static uint64_t traceNow(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+static TraceBuffer *traceThreadBuffer(void)
+{
+    if (traceBuffer != NULL)
+    {
+        return traceBuffer;
+    }
+
+    TraceBuffer *buffer = calloc(1, sizeof(TraceBuffer));
+
+    if (buffer == NULL)
+    {
+        return NULL;
+    }
+
+    buffer->thread = atomic_fetch_add(&traceThreads, 1) + 1;
+    buffer->next = atomic_load_explicit(&traceBuffers, memory_order_relaxed);
+
+    while (!atomic_compare_exchange_weak_explicit(&traceBuffers, &buffer->next, buffer, memory_order_release, memory_order_relaxed))
+    {
+        ;
+    }
+
+    traceBuffer = buffer;
+    return buffer;
+}
+
+TraceZone traceZoneBegin(const char *name)
+{
+    return (TraceZone){
+        .name = name,
+        .start = traceNow(),
+    };
+}
+
+void traceZoneEnd(TraceZone *zone)
+{
+    uint64_t end = traceNow();
+    TraceBuffer *buffer = traceThreadBuffer();
+
+    if (buffer == NULL)
+    {
+        return;
+    }
+
+    uint64_t count = atomic_load_explicit(&buffer->count, memory_order_relaxed);
+    buffer->events[count % TRACE_EVENTS_PER_THREAD] = (TraceEvent){
+        .name = zone->name,
+        .start = zone->start,
+        .duration = end - zone->start,
+    };
+    atomic_store_explicit(&buffer->count, count + 1, memory_order_release);
+}
+
+void traceSetThreadName(const char *name)
+{
+    TraceBuffer *buffer = traceThreadBuffer();
+
+    if (buffer != NULL)
+    {
+        atomic_store_explicit(&buffer->threadName, name, memory_order_release);
+    }
+}
+
+// Copies the events of buffer still in its ring into events and returns how many are intact.
+static uint64_t traceCopy(const TraceBuffer *buffer, TraceEvent *events)
+{
+    uint64_t end = atomic_load_explicit(&buffer->count, memory_order_acquire);
+    uint64_t first = end > TRACE_EVENTS_PER_THREAD ? end - TRACE_EVENTS_PER_THREAD : 0;
+
+    for (uint64_t i = first; i < end; i++)
+    {
+        events[i - first] = buffer->events[i % TRACE_EVENTS_PER_THREAD];
+    }
+
+    // Events the thread wrote meanwhile went over the oldest ones copied.
+    atomic_thread_fence(memory_order_acquire);
+    uint64_t now = atomic_load_explicit(&buffer->count, memory_order_relaxed);
+    uint64_t overwritten = now - first > TRACE_EVENTS_PER_THREAD ? now - first - TRACE_EVENTS_PER_THREAD : 0;
+
+    if (overwritten >= end - first)
+    {
+        return 0;
+    }
+
+    memmove(events, events + overwritten, (end - first - overwritten) * sizeof(TraceEvent));
+    return end - first - overwritten;
+}
+
+bool traceWrite(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    TraceEvent *events = malloc(sizeof(TraceEvent) * TRACE_EVENTS_PER_THREAD);
+
+    if (file == NULL || events == NULL)
+    {
+        perror(path);
+        free(events);
+
+        if (file != NULL)
+        {
+            fclose(file);
+        }
+
+        return false;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"tetris\"}}");
+
+    for (TraceBuffer *buffer = atomic_load_explicit(&traceBuffers, memory_order_acquire); buffer != NULL; buffer = buffer->next)
+    {
+        const char *threadName = atomic_load_explicit(&buffer->threadName, memory_order_acquire);
+
+        if (threadName != NULL)
+        {
+            fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}", buffer->thread, threadName);
+        }
+
+        uint64_t count = traceCopy(buffer, events);
+
+        for (uint64_t i = 0; i < count; i++)
+        {
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                    events[i].name, buffer->thread, events[i].start / 1000.0, events[i].duration / 1000.0);
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+    free(events);
+
+    bool written = !ferror(file);
+    written &= fclose(file) == 0;
+
+    if (!written)
+    {
+        perror(path);
+    }
+
+    return written;
+}
+
+#endif // TRACE_IMPLEMENTATION
@@ -0,0 +1,296 @@
+#define TETRIS_IMPLEMENTATION
+#include "tetris.h"
+
+#define REPLAY_IMPLEMENTATION
+#include "replay.h"
+
+#define CORPUS_IMPLEMENTATION
+#include "corpus.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Replays every game of a corpus on the current engine and reports the ones that no longer play
+// out as recorded.
+//
+// Each worker starts with an equal slice of the games. A worker whose slice runs out steals the
+// back half of the largest remaining one, so a few long games cannot leave the others idle.
+
+#define VERIFY_MAX_THREADS 256
+
+typedef enum VerifyStatus
+{
+    VERIFY_MATCHED = 0,
+    VERIFY_DIVERGED,
+    VERIFY_UNREADABLE,
+} VerifyStatus;
+
+typedef struct VerifyResult
+{
+    VerifyStatus status;
+    ReplayVerification verification;
+} VerifyResult;
+
+// begin in the low half, end in the high half, so both ends move with one compare and swap.
+typedef struct VerifyWorker
+{
+    _Alignas(64) _Atomic uint64_t range;
+    pthread_t thread;
+    bool started; // thread is only joined when it is, the others steal the slice of one that is not
+    uint64_t games;
+    uint64_t ticks;
+    uint64_t steals;
+} VerifyWorker;
+
+static const Corpus *verifyCorpus;
+static VerifyResult *verifyResults;
+static VerifyWorker verifyWorkers[VERIFY_MAX_THREADS];
+static int verifyWorkerCount;
+
+static uint64_t verifyRange(uint32_t begin, uint32_t end)
+{
+    return (uint64_t)end << 32 | begin;
+}
+
+static double verifyNow(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static bool verifyTakeOwn(VerifyWorker *worker, uint32_t *game)
+{
+    uint64_t range = atomic_load(&worker->range);
+
+    while ((uint32_t)range < (uint32_t)(range >> 32))
+    {
+        if (atomic_compare_exchange_weak(&worker->range, &range, range + 1))
+        {
+            *game = (uint32_t)range;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool verifySteal(VerifyWorker *thief)
+{
+    while (true)
+    {
+        VerifyWorker *victim = NULL;
+        uint64_t victimRange = 0;
+        uint32_t most = 0;
+
+        for (int i = 0; i < verifyWorkerCount; i++)
+        {
+            uint64_t range = atomic_load(&verifyWorkers[i].range);
+            uint32_t left = (uint32_t)(range >> 32) - (uint32_t)range;
+
+            if ((uint32_t)range < (uint32_t)(range >> 32) && left > most)
+            {
+                victim = &verifyWorkers[i];
+                victimRange = range;
+                most = left;
+            }
+        }
+
+        if (victim == NULL)
+        {
+            return false;
+        }
+
+        uint32_t begin = (uint32_t)victimRange;
+        uint32_t end = (uint32_t)(victimRange >> 32);
+        uint32_t split = end - (end - begin) / 2;
+
+        // With one game left, take it whole, otherwise the back half.
+        if (split == end)
+        {
+            split = begin;
+        }
+
+        if (atomic_compare_exchange_strong(&victim->range, &victimRange, verifyRange(begin, split)))
+        {
+            atomic_store(&thief->range, verifyRange(split, end));
+            thief->steals++;
+            return true;
+        }
+    }
+}
+
+static void verifyGame(VerifyWorker *worker, uint32_t game)
+{
+    size_t size = 0;
+    const uint8_t *replay = corpusReplay(verifyCorpus, game, &size);
+    VerifyResult *result = &verifyResults[game];
+
+    if (!replayVerify(replay, size, &result->verification))
+    {
+        result->status = VERIFY_UNREADABLE;
+        return;
+    }
+
+    result->status = result->verification.divergedAt != 0 ? VERIFY_DIVERGED : VERIFY_MATCHED;
+    worker->games++;
+    worker->ticks += result->verification.ticks;
+}
+
+static void *verifyThread(void *argument)
+{
+    VerifyWorker *worker = argument;
+    uint32_t game;
+
+    do
+    {
+        while (verifyTakeOwn(worker, &game))
+        {
+            verifyGame(worker, game);
+        }
+    } while (verifySteal(worker));
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = NULL;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            threads = atol(argv[++i]);
+        }
+        else if (path == NULL)
+        {
+            path = argv[i];
+        }
+        else
+        {
+            path = NULL;
+            break;
+        }
+    }
+
+    if (path == NULL)
+    {
+        fprintf(stderr, "usage: %s <corpus> [--threads n]\n", argv[0]);
+        return 1;
+    }
+
+    verifyWorkerCount = threads < 1 ? 1 : threads > VERIFY_MAX_THREADS ? VERIFY_MAX_THREADS : threads;
+
+    Corpus corpus;
+
+    if (!corpusOpen(&corpus, path))
+    {
+        return 1;
+    }
+
+    verifyCorpus = &corpus;
+    verifyResults = calloc(corpus.count + 1, sizeof(VerifyResult));
+
+    if (verifyResults == NULL)
+    {
+        perror("verify");
+        corpusClose(&corpus);
+        return 1;
+    }
+
+    double start = verifyNow();
+
+    for (int i = 0; i < verifyWorkerCount; i++)
+    {
+        uint32_t begin = corpus.count * i / verifyWorkerCount;
+        uint32_t end = corpus.count * (i + 1) / verifyWorkerCount;
+        atomic_store(&verifyWorkers[i].range, verifyRange(begin, end));
+    }
+
+    int started = 1;
+
+    for (int i = 1; i < verifyWorkerCount; i++)
+    {
+        verifyWorkers[i].started = pthread_create(&verifyWorkers[i].thread, NULL, verifyThread, &verifyWorkers[i]) == 0;
+        started += verifyWorkers[i].started;
+    }
+
+    verifyThread(&verifyWorkers[0]);
+
+    uint64_t games = verifyWorkers[0].games;
+    uint64_t ticks = verifyWorkers[0].ticks;
+    uint64_t steals = verifyWorkers[0].steals;
+
+    for (int i = 1; i < verifyWorkerCount; i++)
+    {
+        if (!verifyWorkers[i].started)
+        {
+            continue;
+        }
+
+        pthread_join(verifyWorkers[i].thread, NULL);
+        games += verifyWorkers[i].games;
+        ticks += verifyWorkers[i].ticks;
+        steals += verifyWorkers[i].steals;
+    }
+
+    double elapsed = verifyNow() - start;
+
+    size_t diverged = 0;
+    size_t unreadable = 0;
+    size_t incomplete = 0;
+
+    for (size_t i = 0; i < corpus.count; i++)
+    {
+        const VerifyResult *result = &verifyResults[i];
+        const ReplayVerification *verification = &result->verification;
+
+        if (result->status == VERIFY_UNREADABLE)
+        {
+            size_t size = 0;
+            const uint8_t *replay = corpusReplay(&corpus, i, &size);
+            ReplayReader reader;
+
+            if (replayReaderOpen(&reader, replay, size))
+            {
+                printf("game %zu: recorded in format version %d with rules version %d, "
+                       "this engine plays format %d or later with rules version %d\n",
+                       i, reader.header.formatVersion, reader.header.rulesVersion, REPLAY_OLDEST_PLAYABLE_VERSION, GAME_RULES_VERSION);
+            }
+            else
+            {
+                printf("game %zu: cannot be read\n", i);
+            }
+
+            unreadable++;
+        }
+        else if (result->status == VERIFY_DIVERGED)
+        {
+            printf("game %zu (seed %llu): diverged by tick %u, recorded score %u lines %u at tick %u, now score %u lines %u\n",
+                   i, (unsigned long long)corpus.entries[i].seed, verification->divergedAt,
+                   verification->expected.score, verification->expected.lines, verification->expected.tick,
+                   verification->actual.score, verification->actual.lines);
+            diverged++;
+        }
+        else if (!verification->complete)
+        {
+            incomplete++;
+        }
+    }
+
+    printf("%zu games, %zu diverged, %zu unreadable, %zu without an ending\n", corpus.count, diverged, unreadable, incomplete);
+    printf("%d threads, %llu steals, %.2f s, %.0f games/s, %.0f ticks/s\n", started, (unsigned long long)steals, elapsed,
+           games / elapsed, ticks / elapsed);
+
+    free(verifyResults);
+    corpusClose(&corpus);
+
+    return diverged || unreadable ? 1 : 0;
+}